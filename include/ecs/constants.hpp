@@ -12,6 +12,29 @@ static constexpr size_t kLargeBinSize = 1024 * 1024;
 static constexpr size_t kFastBinCapacity = 800;
 static constexpr size_t kSmallBinCapacity = 200;
 static constexpr size_t kLargeBinCapacity = 80;
+// thread local caches of pool_t, capacity is derived from block size
+static constexpr size_t kMagazineBytes = 1024 * 1024;
+static constexpr size_t kMagazineCapacity = 32;
+static constexpr size_t kMaxMagazinePools = 8;
+// address space reserved at once by chunk arenas, aligned to huge page
+static constexpr size_t kArenaRegionSize = 32 * 1024 * 1024;
+static constexpr size_t kHugePageSize = 2 * 1024 * 1024;
+// job blocks from 256B to 1MB, larger blocks fall back to dual_malloc
+static constexpr size_t kJobBinMinSize = 256;
+static constexpr size_t kJobBinCount = 13;
+static constexpr size_t kJobBinCapacity = 256;
+// bytes of blocks kept by one bin, bins of large blocks keep fewer of them
+static constexpr size_t kJobBinBytes = 16 * 1024 * 1024;
+// thread local lists in front of job bins up to 64KB, capacity is derived from block size like magazines
+static constexpr size_t kJobCachedBinCount = 9;
+static constexpr size_t kJobBinCacheBytes = 64 * 1024;
+static constexpr size_t kJobBinCacheCapacity = 32;
+// allocating or instantiating more entities than threshold at once fills chunks on workers, split into batches
+static constexpr size_t kParallelSpawnThreshold = 16 * 1024;
+static constexpr size_t kParallelSpawnBatch = 4 * 1024;
+// recycled entity ids are shared with reserving threads in segments, reserving threads keep one segment each
+static constexpr size_t kEntitySegmentSize = 256;
+static constexpr size_t kMaxReserveSlots = 64;
 static constexpr SIndex kInvalidSIndex = std::numeric_limits<SIndex>::max();
 static constexpr TIndex kInvalidTypeIndex = std::numeric_limits<TIndex>::max();
 
@@ -15,6 +15,9 @@ DUAL_DECLARE(chunk_t);
 DUAL_DECLARE(query_t);
 DUAL_DECLARE(storage_delta_t);
 DUAL_DECLARE(counter_t);
+DUAL_DECLARE(system_graph_t);
+DUAL_DECLARE(command_buffer_t);
+DUAL_DECLARE(snapshot_t);
 #undef DUAL_DECLARE
 
 // structs
@@ -52,6 +55,7 @@ typedef struct dual_callback_v {
 enum type_flags
 {
     DTF_PIN = 0x1,
+    DTF_SOA = 0x2,
 };
 
 /**
@@ -74,7 +78,8 @@ typedef struct dual_type_description_t {
     uint16_t size;
     /**
      * element size of this component, when this is a array component it would be equal to sizeof(T), otherwise it should be set to zero
-     *
+     * when DTF_SOA is set it is the size of each scalar field instead, the component is stored as size / elementSize sub columns inside the chunk
+     * soa component should not have any callback or entity fields, its fields are accessed by dualV_get_field_ro/rw instead of dualV_get_owned_ro/rw
      */
     uint16_t elementSize;
     uint16_t alignment;
@@ -179,8 +184,126 @@ typedef struct dual_meta_filter_t {
 // header data of a array component
 typedef struct dual_array_component_t dual_array_component_t;
 
+// a group of chunk image, could be read and loaded separately
+typedef struct dual_image_section_t {
+    // from beginning of image
+    uint64_t offset;
+    uint64_t size;
+    EIndex entityCount;
+} dual_image_section_t;
+
+/**
+ * @brief describes changes of one group in a storage delta
+ *
+ */
+typedef struct dual_group_delta_t {
+    const dual_entity_type_t* type;
+    // entities created in or moved into this group
+    const dual_entity_t* created;
+    EIndex createdCount;
+    // entities with modified components
+    const dual_entity_t* changed;
+    EIndex changedCount;
+} dual_group_delta_t;
+
 typedef uint32_t dual_mask_component_t;
 
+/**
+ * @brief statistics of a chunk pool
+ *
+ */
+typedef struct dual_pool_stats_t {
+    uint64_t hits;        // allocations served by thread local magazines or global queue
+    uint64_t misses;      // allocations fell back to dual_malloc
+    uint64_t refills;     // batches moved from global queue to magazines
+    uint64_t returns;     // batches moved from magazines to global queue
+    uint64_t globalCount; // approximate block count of global queue
+    uint64_t reservedBytes; // memory held by pool, blocks in use and cached blocks
+    uint64_t usedBytes;     // reserved bytes not cached by global queue, includes blocks cached by thread local magazines
+    uint64_t cachedBytes;   // approximate bytes cached by global queue
+    uint64_t releasedBytes; // bytes returned to os by trimming and budget
+    uint64_t mappedBytes;   // address space reserved by arena, zero if arena is not used
+    uint64_t budget;        // zero means unlimited
+} dual_pool_stats_t;
+
+/**
+ * @brief budget of one incremental defragment step
+ *
+ */
+typedef struct dual_defrag_options_t {
+    uint64_t timeBudget; // nanoseconds, zero means unlimited
+    uint64_t byteBudget; // bytes of entities moved, zero means unlimited
+    bool parallel;       // compact groups on workers, calling thread waits for them
+} dual_defrag_options_t;
+
+/**
+ * @brief result of one incremental defragment step
+ *
+ */
+typedef struct dual_defrag_stats_t {
+    uint32_t compactedGroups; // groups fully compacted by this step
+    uint32_t pendingGroups;   // groups still fragmented, accessed by jobs or out of budget
+    uint32_t freedChunks;
+    uint64_t movedBytes;
+    uint64_t time;   // nanoseconds spent by this step
+    float occupancy; // entities / capacity of all chunks after this step
+} dual_defrag_stats_t;
+
+/**
+ * @brief memory usage of a group, an archetype or a storage
+ *
+ */
+typedef struct dual_memory_stats_t {
+    EIndex entityCount;
+    uint32_t groupCount;
+    uint32_t chunkCount[3]; // indexed by small, default and large chunk pool
+    uint64_t chunkBytes;    // memory of chunks, including headers and empty slots
+    uint64_t usedBytes;     // memory of entities stored in chunks
+    uint64_t heapBytes;     // buffer components spilled out of chunks
+    EIndex managedCount;    // instances of managed components, their own heap usage is not visible
+    float fillRatio;        // entities / slots of chunks
+} dual_memory_stats_t;
+
+/**
+ * @brief memory usage of one component type in an archetype
+ *
+ */
+typedef struct dual_component_memory_t {
+    dual_type_index_t type;
+    uint64_t chunkBytes; // component data stored in chunks
+    uint64_t heapBytes;  // buffer elements spilled to heap
+} dual_component_memory_t;
+
+/**
+ * @brief memory usage of an archetype, accumulated from all groups of it
+ *
+ */
+typedef struct dual_archetype_stats_t {
+    const dual_type_set_t* type;
+    dual_memory_stats_t memory;
+    // one for each component of type, valid during callback
+    const dual_component_memory_t* components;
+} dual_archetype_stats_t;
+
+typedef void (*dual_archetype_stats_callback_t)(void* u, const dual_archetype_stats_t* stats);
+
+/**
+ * @brief configuration of chunk pools
+ *
+ */
+typedef struct dual_pool_config_t {
+    // carve chunks from huge page backed regions, MAP_HUGETLB is tried first then transparent huge pages
+    // only applied when context is created
+    bool hugePageArena;
+    // address space reserved by one region, rounded up to huge page size, zero uses default
+    size_t regionSize;
+    // bytes held by small, default and large pools, freed chunks are returned to os while pool exceeds its budget
+    // zero means unlimited
+    size_t smallBudget;
+    size_t normalBudget;
+    size_t largeBudget;
+} dual_pool_config_t;
+
 // APIS
 /**
  * @brief initialize context, user should store the context and pass it to library by implementing dual_get_context
@@ -199,6 +322,25 @@ RUNTIME_API dual_context_t* dual_get_context();
  *
  */
 RUNTIME_API void dual_shutdown();
+/**
+ * @brief get statistics of small, default and large chunk pools
+ * hits of other threads are published when their magazines exchange blocks with global queue
+ * @param small
+ * @param normal
+ * @param large
+ */
+RUNTIME_API void dual_get_pool_stats(dual_pool_stats_t* small, dual_pool_stats_t* normal, dual_pool_stats_t* large);
+/**
+ * @brief configure chunk pools, arena takes effect when context is created, budgets take effect immediately
+ * @param config
+ */
+RUNTIME_API void dual_set_pool_config(const dual_pool_config_t* config);
+/**
+ * @brief return cached chunks of all pools to os
+ * chunks cached by other threads are returned when those threads access the pools next time
+ * @return uint64_t bytes returned by this call
+ */
+RUNTIME_API uint64_t dual_trim_pools();
 
 RUNTIME_API void dual_make_guid(skr_guid_t* guid);
 
@@ -209,6 +351,7 @@ typedef void (*dual_view_callback_t)(void* u, dual_chunk_view_t* view);
 typedef void (*dual_group_callback_t)(void* u, dual_group_t* view);
 typedef void (*dual_entity_callback_t)(void* u, dual_entity_t e);
 typedef void (*dual_cast_callback_t)(void* u, dual_chunk_view_t* new_view, dual_chunk_view_t* old_view);
+typedef void (*dual_group_delta_callback_t)(void* u, const dual_group_delta_t* delta);
 
 /**
  * @brief register a new component
@@ -232,6 +375,12 @@ RUNTIME_API dual_type_index_t dualT_get_type(const dual_guid_t* guid);
  * @return component type
  */
 RUNTIME_API dual_type_index_t dualT_get_type_by_name(const char* name);
+/**
+ * @brief get type of builtin mask component, entity type containing it can toggle components per entity
+ * @see dualS_enable_components
+ * @return component type
+ */
+RUNTIME_API dual_type_index_t dualT_get_mask_type();
 /**
  * @brief get description of component type
  *
@@ -261,6 +410,8 @@ RUNTIME_API void dualS_release(dual_storage_t* storage);
 /**
  * @brief allocate entities
  * batch allocate numbers of entities with entity type
+ * large batches of a storage used by jobs are constructed on workers, component constructors should be thread safe
+ * callback is still called on calling thread, after all entities are constructed
  * @param storage
  * @param type
  * @param count
@@ -278,7 +429,7 @@ RUNTIME_API void dualS_allocate_type(dual_storage_t* storage, const dual_entity_
 RUNTIME_API void dualS_allocate_group(dual_storage_t* storage, dual_group_t* group, EIndex count, dual_view_callback_t callback, void* u);
 /**
  * @brief instantiate entity
- * instantiate an entity n times
+ * instantiate an entity n times, large batches are copied on workers as dualS_allocate_type
  * @param storage
  * @param prefab
  * @param count
@@ -377,8 +528,8 @@ RUNTIME_API void dualS_query_groups(dual_storage_t* storage, const dual_filter_t
 /**
  * @brief merge two storage
  * after merge, the source storage will be empty
- * small chunks and empty chunks (fragment) will appear when merge storages which just move chunks(which could be small one or empty one) from source storage
- * every time we merge storage, we get more fragment
+ * chunks of source are adopted without copy, only entity ids and references are remapped, partial chunks of touched groups are coalesced afterwards
+ * references to entities which are not in source are cleared
  * @see dualS_defragement
  * @param storage
  * @param source
@@ -386,11 +537,87 @@ RUNTIME_API void dualS_query_groups(dual_storage_t* storage, const dual_filter_t
 RUNTIME_API void dualS_merge(dual_storage_t* storage, dual_storage_t* source);
 /**
  * @brief diff two storage
- *
+ * entities are matched by id, the delta contains entities destroyed, created and changed in target
+ * once a delta of target is applied to storage, following diff only visit chunks written since then,
+ * so target should bump it's version with dualS_set_version every frame and storage should be kept in sync with only this target
+ * destroyed entities are found from entities freed in target since then, a storage lagging behind other storages synced with the same target
+ * or a target which is reset or packed falls back to scanning all entities
+ * @see dualS_apply_delta
  * @param storage
  * @param target
+ * @return dual_storage_delta_t* delta from storage to target, should be released by dualD_release
  */
 RUNTIME_API dual_storage_delta_t* dualS_diff(dual_storage_t* storage, dual_storage_t* target);
+/**
+ * @brief capture a read only snapshot of storage, e.g. for render extraction on other threads
+ * nothing is copied on capture, chunks are shared until storage is about to write, move or destroy their rows,
+ * then the chunk is copied for snapshots still sharing it, so the main world can keep running while snapshot is read
+ * shared components are read from live groups, storage should not be reset or merged into others while snapshots are alive
+ * @param storage
+ * @return dual_snapshot_t* should be released by dualS_release_snapshot
+ */
+RUNTIME_API dual_snapshot_t* dualS_snapshot(dual_storage_t* storage);
+/**
+ * @brief release snapshot and chunks copied for it, thread safe
+ * @param snapshot
+ */
+RUNTIME_API void dualS_release_snapshot(dual_snapshot_t* snapshot);
+/**
+ * @brief get chunk views of snapshot matching given filter, can be called from any thread
+ * views are only valid inside callback and should not be written, callback should not query the same snapshot recursively
+ * changed filter and per entity masks are not applied, chunks with disabled components are visited as a whole
+ * @param snapshot
+ * @param filter
+ * @param meta nullable
+ * @param callback callback for filtered chunk view
+ */
+RUNTIME_API void dualS_query_snapshot(dual_snapshot_t* snapshot, const dual_filter_t* filter, const dual_meta_filter_t* meta, dual_view_callback_t callback, void* u);
+/**
+ * @brief apply delta to storage, after that storage will be identical to the target of the delta
+ *
+ * @param storage
+ * @param delta
+ */
+RUNTIME_API void dualS_apply_delta(dual_storage_t* storage, const dual_storage_delta_t* delta);
+/**
+ * @brief release delta
+ *
+ * @param delta
+ */
+RUNTIME_API void dualD_release(dual_storage_delta_t* delta);
+/**
+ * @brief get destroyed entities of delta
+ *
+ * @param delta
+ * @param callback
+ * @param u
+ */
+RUNTIME_API void dualD_get_destroyed(const dual_storage_delta_t* delta, dual_entity_callback_t callback, void* u);
+/**
+ * @brief get changes of each group in delta
+ *
+ * @param delta
+ * @param callback
+ * @param u
+ */
+RUNTIME_API void dualD_get_groups(const dual_storage_delta_t* delta, dual_group_delta_callback_t callback, void* u);
+/**
+ * @brief serialize delta, used to replicate storage
+ *
+ * @param delta
+ * @param v serializer callback
+ * @param t serializer state
+ * @see dual_serializer_v
+ */
+RUNTIME_API void dualD_serialize(const dual_storage_delta_t* delta, const dual_serializer_v* v, void* t);
+/**
+ * @brief deserialize delta
+ *
+ * @param v serializer callback
+ * @param t serializer state
+ * @return dual_storage_delta_t*
+ */
+RUNTIME_API dual_storage_delta_t* dualD_deserialize(const dual_serializer_v* v, void* t);
 /**
  * @brief serialize the storage
  *
@@ -409,6 +636,63 @@ RUNTIME_API void dualS_serialize(dual_storage_t* storage, const dual_serializer_
  * @see dual_serializer_v
  */
 RUNTIME_API void dualS_deserialize(dual_storage_t* storage, const dual_serializer_v* v, void* t);
+/**
+ * @brief serialize the storage as chunk image
+ * components are written column by column as they are in chunk, only arrays outgrown inline capacity and
+ * components with serialize callback are written separately, image is only valid for the same type layouts and platform
+ * pointers of inline arrays are written as offsets, a loaded storage gives back the image it is loaded from
+ * large storages are written by chunk ranges on job system once it is initialized, serialize callbacks are then called from workers
+ * @param storage
+ * @param v serializer callback
+ * @param t serializer state
+ * @see dualS_deserialize_image
+ */
+RUNTIME_API void dualS_serialize_image(dual_storage_t* storage, const dual_serializer_v* v, void* t);
+/**
+ * @brief load chunk image from memory, e.g. a mapped file or a buffer read by io service
+ * columns are copied into chunks directly and arrays are relocated, entity ids are kept as dualS_deserialize
+ * storage should be empty, it is left partially loaded if image is truncated or type layouts changed
+ * chunks are allocated on calling thread and filled on job system for large images as dualS_serialize_image
+ * @param storage
+ * @param data
+ * @param size
+ * @return non zero if succeed
+ */
+RUNTIME_API int dualS_deserialize_image(dual_storage_t* storage, const void* data, size_t size);
+/**
+ * @brief get size of image prefix which holds group index of chunk image
+ * read image prefix of returned size and call again until size of data is not less than result
+ * @param data beginning of image
+ * @param size bytes of data available
+ * @return bytes of prefix needed, 0 if image is invalid or saved before group index is introduced
+ */
+RUNTIME_API size_t dualS_image_index_size(const void* data, size_t size);
+/**
+ * @brief select groups of chunk image to load, groups are matched by their type and meta entities
+ * dead groups are skipped unless filter asks for them, shared components are not checked since meta entities may not be loaded
+ * @param index image prefix of dualS_image_index_size bytes
+ * @param size
+ * @param filter nullable
+ * @param meta nullable, meta entities are ids saved in image
+ * @param sections selected sections, at most capacity sections are written
+ * @param capacity
+ * @return number of matched sections
+ */
+RUNTIME_API uint32_t dualS_select_image_sections(const void* index, size_t size, const dual_filter_t* filter, const dual_meta_filter_t* meta, dual_image_section_t* sections, uint32_t capacity);
+/**
+ * @brief load a section of chunk image, e.g. read asynchronously by io service
+ * entity ids are kept as in image, so storage should be a staging storage only loaded from the same image and
+ * each section should be loaded once, merge the staging storage into world afterwards by dualS_merge
+ * references to entities of sections not loaded are cleared by dualS_merge
+ * @param storage
+ * @param index image prefix of dualS_image_index_size bytes
+ * @param indexSize
+ * @param data section data
+ * @param size section size
+ * @return non zero if succeed
+ * @see dualS_select_image_sections
+ */
+RUNTIME_API int dualS_load_image_section(dual_storage_t* storage, const void* index, size_t indexSize, const void* data, size_t size);
 /**
  * @brief test if given entity exist in storage
  * entity can be invalid(id not exist) or be dead(version not match)
@@ -467,6 +751,39 @@ RUNTIME_API void dualS_validate_meta(dual_storage_t* storage);
  * @param storage
  */
 RUNTIME_API void dualS_defragement(dual_storage_t* storage);
+/**
+ * @brief compact the most fragmented groups within budget, call it every frame to keep occupancy high
+ * groups accessed by scheduled jobs are skipped instead of waited, they are compacted by later steps
+ * unlike dualS_defragement, chunks are only merged and never resized
+ * @see dualS_defragement
+ * @param storage
+ * @param options null means unlimited budget on calling thread
+ * @param stats optional
+ */
+RUNTIME_API void dualS_defragment_step(dual_storage_t* storage, const dual_defrag_options_t* options, dual_defrag_stats_t* stats);
+/**
+ * @brief get memory usage of whole storage
+ *
+ * @param storage
+ * @param stats
+ */
+RUNTIME_API void dualS_get_memory_stats(dual_storage_t* storage, dual_memory_stats_t* stats);
+/**
+ * @brief get memory usage of every archetype in storage, sorted by chunk bytes from large to small
+ *
+ * @param storage
+ * @param callback
+ * @param u
+ */
+RUNTIME_API void dualS_get_archetype_stats(dual_storage_t* storage, dual_archetype_stats_callback_t callback, void* u);
+/**
+ * @brief send memory usage of storage and its largest archetypes to tracy as plots
+ * plots are named as "name/entities", "name/chunk bytes", "name/fill", per archetype plots are "name/[components] bytes"
+ * @param storage
+ * @param name prefix of plot names
+ * @param archetypeCount max count of archetypes to plot, largest first
+ */
+RUNTIME_API void dualS_plot_memory_stats(dual_storage_t* storage, const char* name, uint32_t archetypeCount);
 /**
  * @brief pack entity id
  * when we destroy an entity, we don't "delete" it's id, we just left a hole awaiting reuse.
@@ -474,6 +791,22 @@ RUNTIME_API void dualS_defragement(dual_storage_t* storage);
  * @param storage
  */
 RUNTIME_API void dualS_pack_entities(dual_storage_t* storage);
+/**
+ * @brief reserve entity ids without touching storage, thread safe
+ * reserved ids are not alive until they are spawned by dualB_spawn_reserved, every reserved id should be spawned
+ * recycled ids are only handed out after dualS_share_free_entities, otherwise new ids are reserved
+ * @param storage
+ * @param ents output of reserved ids
+ * @param count
+ */
+RUNTIME_API void dualS_reserve_entities(dual_storage_t* storage, dual_entity_t* ents, EIndex count);
+/**
+ * @brief hand free ids over to dualS_reserve_entities so reserving threads can reuse destroyed ids
+ * should be called on main thread while no thread is reserving, ids not reserved are returned on pack or shrink
+ * @param storage
+ * @param count max count of free ids to share
+ */
+RUNTIME_API void dualS_share_free_entities(dual_storage_t* storage, EIndex count);
 /**
  * @brief create a query which combine filter and parameters
  * query can be overloaded
@@ -489,6 +822,8 @@ RUNTIME_API dual_query_t* dualQ_create(dual_storage_t* storage, const dual_filte
  * ? - optional
  * $ - shared
  * * - random access
+ * [rand] - random access to any entity, job with [rand] write runs in one task unless it is [atomic]
+ * [group] - random access inside the group of current entity, each group is processed by one task
  * | - any
  * ! - none
  * ' - stage
@@ -544,6 +879,13 @@ RUNTIME_API int dualG_share_components(const dual_group_t* group, const dual_typ
  * @return void const*
  */
 RUNTIME_API const void* dualG_get_shared_ro(const dual_group_t* group, dual_type_index_t type);
+/**
+ * @brief get memory usage of group
+ *
+ * @param group
+ * @param stats
+ */
+RUNTIME_API void dualG_get_memory_stats(const dual_group_t* group, dual_memory_stats_t* stats);
 /**
  * @brief get entity type from group
  *
@@ -591,6 +933,25 @@ RUNTIME_API const void* dualV_get_owned_ro_local(const dual_chunk_view_t* view,
  * @return void*
  */
 RUNTIME_API void* dualV_get_owned_rw_local(const dual_chunk_view_t* view, dual_type_index_t localType);
+/**
+ * @brief get sub column of a field of soa component from chunk view readonly return null if component is not exist or not owned
+ * fields are laid out contiguously for all entities of the chunk, so the result is an array of view->count fields
+ * @see DTF_SOA
+ * @param view
+ * @param type
+ * @param field index of the field, in range [0, size / elementSize)
+ * @return void const*
+ */
+RUNTIME_API const void* dualV_get_field_ro(const dual_chunk_view_t* view, dual_type_index_t type, uint32_t field);
+/**
+ * @brief get sub column of a field of soa component from chunk view readwrite return null if component is not exist or not owned
+ * @see dualV_get_field_ro
+ * @param view
+ * @param type
+ * @param field
+ * @return void*
+ */
+RUNTIME_API void* dualV_get_field_rw(const dual_chunk_view_t* view, dual_type_index_t type, uint32_t field);
 /**
  * @brief get entity list from chunk view
  *
@@ -615,6 +976,7 @@ RUNTIME_API void dualS_disable_components(const dual_chunk_view_t* view, const d
 
 /**
  * @brief set version of storage, useful when detecting changes
+ * components written after this will be marked with this version
  *
  * @param storage
  * @param number
@@ -658,6 +1020,7 @@ typedef struct dual_resource_operation_t {
  *
  * @param query
  * @param batchSize max entity count processed by a task, be aware of false sharing when batchSize is small
+ * 0 means adaptive, batch size is derived from measured cost of previous jobs of the query, see dualJ_set_target_task_time
  * @param callback processor function, called multiple times in parallel
  * @param u
  * @param init initializer function, called at the beginning of job
@@ -668,14 +1031,91 @@ RUNTIME_API void dualJ_schedule_ecs(const dual_query_t* query, EIndex batchSize,
 dual_system_init_callback_t init, dual_resource_operation_t* resources, dual_counter_t** counter);
 typedef void (*dual_for_callback_t)(void* u, uint32_t index);
 /**
- * @brief schedule multiple jobs
+ * @brief schedule a parallel for job, callback is called once for every index in [0, count)
+ * indices are split into batches which run in parallel, dependencies on resources are automatically resolved
  *
  * @param count
- * @param callback
+ * @param callback processor function, called multiple times in parallel
  * @param u
- * @return dual_job_t*
+ * @param resources
+ * @param counter counter of the job, should be released by dualJ_release_counter
  */
 RUNTIME_API void dualJ_schedule_for(uint32_t count, dual_for_callback_t callback, void* u, dual_resource_operation_t* resources, dual_counter_t** counter);
+/**
+ * @brief statistics of ecs jobs of a query, times are in nanoseconds
+ *
+ */
+typedef struct dual_job_stats_t {
+    // last finished job
+    EIndex entityCount;
+    uint32_t taskCount;
+    EIndex batchSize;
+    uint64_t waitTime; // from scheduling to running, waiting for dependencies and workers
+    uint64_t runTime;  // time spent in tasks, summed over all tasks
+    // accumulated across jobs
+    uint32_t jobCount;
+    double costPerEntity; // moving average of runTime / entityCount
+} dual_job_stats_t;
+/**
+ * @brief get statistics of ecs jobs scheduled with query, include jobs of system graph
+ *
+ * @param query
+ * @param stats
+ */
+RUNTIME_API void dualJ_get_stats(const dual_query_t* query, dual_job_stats_t* stats);
+/**
+ * @brief set the duration a task of adaptive ecs job (batchSize 0) is sized to, default is 100us
+ *
+ * @param nanoseconds
+ */
+RUNTIME_API void dualJ_set_target_task_time(uint64_t nanoseconds);
+/**
+ * @brief describe a system of system graph, parameters are the same as dualJ_schedule_ecs
+ * resources are copied into graph
+ */
+typedef struct dual_system_description_t {
+    const dual_query_t* query;
+    EIndex batchSize;
+    dual_system_callback_t callback;
+    void* userdata;
+    dual_system_init_callback_t init;
+    dual_resource_operation_t* resources;
+} dual_system_description_t;
+/**
+ * @brief create a system graph, systems are compiled into a static dag with precomputed group infomation
+ * graph is recompiled only when groups of storage are added or removed
+ *
+ * @param storage all queries of the graph should belong to this storage
+ * @return dual_system_graph_t* should be released by dualJ_release_graph
+ */
+RUNTIME_API dual_system_graph_t* dualJ_create_graph(dual_storage_t* storage);
+/**
+ * @brief add a system to graph, systems accessing same components are ordered by adding order
+ *
+ * @param graph
+ * @param system
+ * @return index of the system
+ */
+RUNTIME_API uint32_t dualJ_add_system(dual_system_graph_t* graph, const dual_system_description_t* system);
+/**
+ * @brief schedule all systems of graph, dependencies with other jobs are resolved as dualJ_schedule_ecs
+ *
+ * @param graph
+ * @param counter counter of the whole graph, should be released by dualJ_release_counter
+ */
+RUNTIME_API void dualJ_dispatch_graph(dual_system_graph_t* graph, dual_counter_t** counter);
+/**
+ * @brief force graph to be recompiled on next dispatch, should be called after changing meta filter of queries
+ *
+ * @param graph
+ */
+RUNTIME_API void dualJ_invalidate_graph(dual_system_graph_t* graph);
+/**
+ * @brief wait for dispatched systems and release the graph
+ *
+ * @param graph
+ */
+RUNTIME_API void dualJ_release_graph(dual_system_graph_t* graph);
 /**
  * @brief wait until counter equal to zero (when job is done)
  *
@@ -700,7 +1140,87 @@ RUNTIME_API void dualJ_wait_all();
  */
 RUNTIME_API void dualJ_wait_storage(dual_storage_t* storage);
 
+/**
+ * @brief create a command buffer, structural changes recorded from any thread are applied to storage by playback
+ *
+ * @param storage
+ * @return dual_command_buffer_t* should be released by dualB_release
+ */
+RUNTIME_API dual_command_buffer_t* dualB_create(dual_storage_t* storage);
+/**
+ * @brief release a command buffer, commands not played back are dropped
+ * ids of dropped reserved spawns are returned to storage, so it should be called on main thread
+ *
+ * @param buffer
+ */
+RUNTIME_API void dualB_release(dual_command_buffer_t* buffer);
+/**
+ * @brief record creation of entities, spawns of same type without callback are allocated together
+ *
+ * @param buffer
+ * @param type
+ * @param count
+ * @param callback called on main thread during playback with views of new entities, optional
+ * @param u
+ */
+RUNTIME_API void dualB_spawn(dual_command_buffer_t* buffer, const dual_entity_type_t* type, EIndex count, dual_view_callback_t callback, void* u);
+/**
+ * @brief record creation of entities with ids reserved by dualS_reserve_entities
+ * entities are spawned before casts and sets of the same buffer are applied, callback sees them before those commands
+ * @param buffer
+ * @param type
+ * @param ents reserved ids, copied when recording
+ * @param count
+ * @param callback called on main thread during playback with views of new entities, optional
+ * @param u
+ */
+RUNTIME_API void dualB_spawn_reserved(dual_command_buffer_t* buffer, const dual_entity_type_t* type, const dual_entity_t* ents, EIndex count, dual_view_callback_t callback, void* u);
+/**
+ * @brief record destruction of an entity, other commands of this entity in the same playback are ignored
+ *
+ * @param buffer
+ * @param ent
+ */
+RUNTIME_API void dualB_destroy(dual_command_buffer_t* buffer, dual_entity_t ent);
+/**
+ * @brief record adding or removing components, all deltas of an entity are merged and entity is moved once
+ * @see dualS_cast_view_delta
+ * @param buffer
+ * @param ent
+ * @param delta
+ */
+RUNTIME_API void dualB_cast(dual_command_buffer_t* buffer, dual_entity_t ent, const dual_delta_type_t* delta);
+/**
+ * @brief record writing a component, data is copied when recording and written after casts are applied
+ * component should not be a buffer or a managed type, ignored if entity does not own the component
+ * @param buffer
+ * @param ent
+ * @param type
+ * @param data
+ */
+RUNTIME_API void dualB_set(dual_command_buffer_t* buffer, dual_entity_t ent, dual_type_index_t type, const void* data);
+/**
+ * @brief apply recorded commands on main thread, order is destroy, reserved spawn, cast, set then spawn
+ * entities moving between the same groups are moved in batch
+ * commands recorded by one job are applied in recording order, order between jobs is undefined
+ * no job should record into the buffer during playback
+ * @param buffer
+ */
+RUNTIME_API void dualB_playback(dual_command_buffer_t* buffer);
+/**
+ * @brief drop recorded commands
+ * ids of dropped reserved spawns are returned to storage, so it should be called on main thread
+ *
+ * @param buffer
+ */
+RUNTIME_API void dualB_clear(dual_command_buffer_t* buffer);
+
 typedef struct dual_scheduler_t dual_scheduler_t;
+/**
+ * @brief attach job system, null detaches it after all jobs are done and storages are synced
+ *
+ * @param scheduler ftl::TaskScheduler
+ */
 RUNTIME_API void dualJ_initialize(dual_scheduler_t* scheduler);
 RUNTIME_API dual_scheduler_t* dualJ_get_scheduler();
 
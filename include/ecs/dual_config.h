@@ -20,16 +20,28 @@
 typedef uint32_t EIndex;
 typedef uint32_t TIndex;
 typedef uint16_t SIndex;
+#ifdef DUAL_ENTITY_64
+// 32 bit id and 32 bit version, for worlds with more than 16M entities or heavy churn
+typedef uint64_t dual_entity_t;
+#else
 typedef uint32_t dual_entity_t;
+#endif
 
 typedef struct dual_entity_debug_proxy_t {
     dual_entity_t value;
 } dual_entity_debug_proxy_t;
 
-#define ENTITY_ID_MASK 0x00FFFFFF
-#define ENTITY_VERSION_OFFSET 24
-#define ENTITY_VERSION_MASK 0x000000FF
-#define NULL_ENTITY 0xFFFFFFFF
+#ifdef DUAL_ENTITY_64
+    #define ENTITY_ID_MASK 0x00000000FFFFFFFFull
+    #define ENTITY_VERSION_OFFSET 32
+    #define ENTITY_VERSION_MASK 0x00000000FFFFFFFFull
+    #define NULL_ENTITY 0xFFFFFFFFFFFFFFFFull
+#else
+    #define ENTITY_ID_MASK 0x00FFFFFF
+    #define ENTITY_VERSION_OFFSET 24
+    #define ENTITY_VERSION_MASK 0x000000FF
+    #define NULL_ENTITY 0xFFFFFFFF
+#endif
 #define NULL_TYPE 0xFFFFFFFF
 
 #ifndef forloop
@@ -1,20 +1,52 @@
 #pragma once
+#include <atomic>
 #include <vector>
 #include "dual.h"
 namespace dual
 {
+struct entity_reservation_t;
 struct entity_registry_t {
     struct entry_t {
         dual_chunk_t* chunk;
+#ifdef DUAL_ENTITY_64
+        // wider version fits in padding after chunk pointer, entry keeps the same size
+        uint32_t indexInChunk;
+        uint32_t version;
+#else
         uint32_t indexInChunk : 24;
         uint32_t version : 8;
+#endif
     };
     std::vector<entry_t> entries;
     std::vector<EIndex> freeEntries;
+    // ids below high-water mark are used or reserved, entries may lag behind until reserved ids are bound
+    std::atomic<EIndex> highWater;
+    // reserved ids not bound to chunk yet
+    std::atomic<EIndex> pendingCount;
+    entity_reservation_t* reservation;
+    // ids freed since logging is enabled by dualS_diff, freeLogBase counts entries already trimmed
+    bool logFrees;
+    uint64_t freeLogBase;
+    std::vector<dual_entity_t> freeLog;
 
+    entity_registry_t();
+    ~entity_registry_t();
     void reset();
+    // invalidate logged frees when ids are no longer comparable, readers fall back to full scan
+    void drop_free_log();
     void shrink();
     void new_entities(dual_entity_t* dst, EIndex count);
+    // thread safe, slot should be unique to calling thread or kMaxReserveSlots
+    void reserve_entities(dual_entity_t* dst, EIndex count, uint32_t slot);
+    // make entries of reserved ids valid before binding them with fill_entities
+    void bind_reserved(EIndex count);
+    // return reserved ids which will never be bound to freelist
+    void release_reserved(const dual_entity_t* ents, EIndex count);
+    // share up to count free ids with reserve_entities
+    void share_free_entities(EIndex count);
+    // take shared ids back to freelist, no reservation should run concurrently
+    void reclaim_shared();
+    void claim_entities(const dual_entity_t* src, EIndex count);
     void free_entities(const dual_entity_t* dst, EIndex count);
     void fill_entities(const dual_chunk_view_t& view);
     void fill_entities(const dual_chunk_view_t& view, const dual_entity_t* src);
@@ -0,0 +1,189 @@
+#pragma once
+#include "dual.h"
+#include <algorithm>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#if defined(_MSC_VER)
+    #define DUAL_RESTRICT __restrict
+#else
+    #define DUAL_RESTRICT __restrict__
+#endif
+
+namespace dual
+{
+// access modifiers of query_T, same as [in] [inout] [out] [atomic] [rand] and ? of dualQ_from_literal
+template <class T>
+struct in {
+};
+template <class T>
+struct inout {
+};
+template <class T>
+struct out {
+};
+template <class T>
+struct atomic {
+};
+template <class A>
+struct rand {
+};
+template <class A>
+struct opt {
+};
+
+template <class A>
+struct access_traits_T;
+
+template <class T>
+struct access_traits_T<in<T>> {
+    using component_t = T;
+    using pointer_t = const T*;
+    static constexpr int readonly = true;
+    static constexpr int atomic = false;
+    static constexpr int phase = -1;
+    static constexpr int randomAccess = DOS_SEQ;
+    static constexpr bool optional = false;
+};
+
+// plain component is read only
+template <class A>
+struct access_traits_T : access_traits_T<in<A>> {
+};
+
+template <class T>
+struct access_traits_T<inout<T>> : access_traits_T<in<T>> {
+    using pointer_t = T*;
+    static constexpr int readonly = false;
+};
+
+template <class T>
+struct access_traits_T<out<T>> : access_traits_T<inout<T>> {
+    static constexpr int phase = 0;
+};
+
+template <class T>
+struct access_traits_T<atomic<T>> : access_traits_T<inout<T>> {
+    static constexpr int atomic = true;
+};
+
+template <class A>
+struct access_traits_T<rand<A>> : access_traits_T<A> {
+    static constexpr int randomAccess = DOS_GLOBAL;
+};
+
+template <class A>
+struct access_traits_T<opt<A>> : access_traits_T<A> {
+    static constexpr bool optional = true;
+};
+
+// contiguous column of a chunk view, null if optional component is missing
+template <class T>
+struct column_T {
+    T* DUAL_RESTRICT data;
+    EIndex count;
+
+    T& operator[](EIndex i) const { return data[i]; }
+    T* begin() const { return data; }
+    T* end() const { return data + count; }
+    explicit operator bool() const { return data != nullptr; }
+};
+
+/**
+ * @brief query with access modes derived from the component list, e.g. query_T<in<A>, inout<B>, opt<C>>
+ * columns are resolved once per chunk and passed to callback as typed columns, f(dual_chunk_view_t* view, column_T<const A>, column_T<B>, column_T<const C>)
+ * components are identified by dual_id_of, soa components are not supported since their rows are not contiguous
+ */
+template <class... As>
+class query_T
+{
+    static_assert(sizeof...(As) > 0, "query without component");
+
+public:
+    template <class A>
+    using column_t = column_T<std::remove_pointer_t<typename access_traits_T<A>::pointer_t>>;
+
+    explicit query_T(dual_storage_t* storage)
+    {
+        dual_type_index_t all[sizeof...(As)];
+        dual_type_index_t types[] = { dual_id_of<typename access_traits_T<As>::component_t>::get()... };
+        dual_operation_t accesses[] = { make_operation<As>()... };
+        bool optional[] = { access_traits_T<As>::optional... };
+        SIndex allCount = 0;
+        for (SIndex i = 0; i < (SIndex)sizeof...(As); ++i)
+            if (!optional[i])
+                all[allCount++] = types[i];
+        std::sort(all, all + allCount);
+        dual_filter_t filter = {};
+        filter.all = { all, allCount };
+        dual_parameters_t params;
+        params.types = types;
+        params.accesses = accesses;
+        params.length = (TIndex)sizeof...(As);
+        query = dualQ_create(storage, &filter, &params);
+    }
+
+    dual_query_t* get() const { return query; }
+
+    /**
+     * @brief schedule an ecs job for the query, see dualJ_schedule_ecs
+     * f is referenced by the job like DUAL_LAMBDA, it should outlive the job
+     */
+    template <class F>
+    void schedule(F& f, EIndex batchSize = 0, dual_counter_t** counter = nullptr) const
+    {
+        dualJ_schedule_ecs(query, batchSize, &run_local<F>, &f, nullptr, nullptr, counter);
+    }
+
+    /**
+     * @brief visit chunks of the query on calling thread, see dualQ_get_views
+     */
+    template <class F>
+    void each(F& f) const
+    {
+        dualQ_get_views(query, &run<F>, &f);
+    }
+
+private:
+    dual_query_t* query;
+
+    template <class A>
+    static constexpr dual_operation_t make_operation()
+    {
+        using traits = access_traits_T<A>;
+        return { traits::phase, traits::readonly, traits::atomic, traits::randomAccess };
+    }
+
+    template <class A, bool local>
+    static column_t<A> get_column(dual_chunk_view_t* view, dual_type_index_t type)
+    {
+        using traits = access_traits_T<A>;
+        using pointer_t = typename traits::pointer_t;
+        void* data;
+        if constexpr (local)
+            data = traits::readonly ? (void*)dualV_get_owned_ro_local(view, type) : dualV_get_owned_rw_local(view, type);
+        else
+            data = traits::readonly ? (void*)dualV_get_owned_ro(view, type) : dualV_get_owned_rw(view, type);
+        return { (pointer_t)data, data ? view->count : 0 };
+    }
+
+    template <class F, size_t... I>
+    static void invoke_local(F& f, dual_chunk_view_t* view, dual_type_index_t* localTypes, std::index_sequence<I...>)
+    {
+        f(view, get_column<As, true>(view, localTypes[I])...);
+    }
+
+    template <class F>
+    static void run_local(void* u, dual_storage_t* storage, dual_chunk_view_t* view, dual_type_index_t* localTypes, EIndex entityIndex)
+    {
+        invoke_local(*(F*)u, view, localTypes, std::index_sequence_for<As...>{});
+    }
+
+    template <class F>
+    static void run(void* u, dual_chunk_view_t* view)
+    {
+        (*(F*)u)(view, get_column<As, false>(view, dual_id_of<typename access_traits_T<As>::component_t>::get())...);
+    }
+};
+} // namespace dual
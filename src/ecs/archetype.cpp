@@ -41,12 +41,14 @@ dual::archetype_t* dual_storage_t::construct_archetype(const dual_type_set_t& in
     proto.storage = this;
     proto.type = clone(inType, buffer);
     proto.withMask = false;
+    proto.dependencyEntries = nullptr;
     proto.sizeToPatch = 0;
 
     proto.sizes = arena.allocate<uint32_t>(proto.type.length);
     forloop (i, 0, 3)
         proto.offsets[i] = arena.allocate<uint32_t>(proto.type.length);
     proto.elemSizes = arena.allocate<uint32_t>(proto.type.length);
+    proto.fieldCounts = arena.allocate<uint32_t>(proto.type.length);
     proto.callbacks = arena.allocate<dual_callback_v>(proto.type.length);
     proto.aligns = arena.allocate<uint32_t>(proto.type.length);
     std::memset(proto.callbacks, 0, sizeof(dual_callback_v) * proto.type.length);
@@ -64,7 +66,9 @@ dual::archetype_t* dual_storage_t::construct_archetype(const dual_type_set_t& in
             proto.withMask = true;
         auto& desc = registry.descriptions[type_index_t(t).index()];
         proto.sizes[i] = desc.size;
-        proto.elemSizes[i] = desc.elementSize;
+        bool soa = (desc.flags & DTF_SOA) != 0;
+        proto.elemSizes[i] = soa ? 0 : desc.elementSize;
+        proto.fieldCounts[i] = soa ? desc.size / desc.elementSize : 1;
         guids[i] = desc.guid;
         proto.aligns[i] = desc.alignment;
         stableOrder[i] = i;
@@ -83,7 +87,7 @@ dual::archetype_t* dual_storage_t::construct_archetype(const dual_type_set_t& in
         uint32_t* offsets = proto.offsets[i];
         uint32_t& capacity = proto.chunkCapacity[i];
         capacity = (uint32_t)(caps[i] - sizeof(dual_chunk_t) - versionSize - padding) / proto.entitySize;
-        proto.versionOffset[i] = caps[i] - versionSize;
+        proto.versionOffset[i] = (uint32_t)(caps[i] - sizeof(dual_chunk_t) - versionSize);
         if (capacity == 0)
             continue;
         uint32_t offset = sizeof(dual_entity_t) * capacity;
@@ -144,6 +148,7 @@ dual_group_t* dual_storage_t::construct_group(const dual_entity_type_t& inType)
     proto.chunkCount = 0;
     proto.firstChunk = proto.lastChunk = proto.firstFree = nullptr;
     proto.dead = nullptr;
+    proto.edges = nullptr;
     proto.cloned = proto.isDead ? nullptr : &proto;
     groups.insert({ type, &proto });
     update_query_cache(&proto, true);
@@ -196,6 +201,9 @@ void dual_storage_t::destruct_group(dual_group_t* group)
 {
     update_query_cache(group, false);
     groups.erase(group->type);
+    group->release_edges();
+    for (auto& pair : groups)
+        pair.second->remove_edges(group);
     groupPool.free(group);
 }
 
@@ -220,6 +228,8 @@ void dual_group_t::add_chunk(dual_chunk_t* chunk)
     size += chunk->count;
     chunk->type = archetype;
     chunk->group = this;
+    // chunks added after a snapshot are not shared with it
+    chunk->snapshotSerial.store(archetype->storage->snapshotSerial, std::memory_order_relaxed);
     chunkCount++;
     if (firstChunk == nullptr)
     {
@@ -235,13 +245,19 @@ void dual_group_t::add_chunk(dual_chunk_t* chunk)
             firstFree = chunk;
     }
     else
-        firstChunk->link(chunk);
+    {
+        // full chunks are kept in front of free ones
+        chunk->next = firstChunk->next;
+        chunk->link(firstChunk);
+        firstChunk = chunk;
+    }
 }
 
 void dual_group_t::resize_chunk(dual_chunk_t* chunk, EIndex newSize)
 {
     using namespace dual;
     size = size + newSize - chunk->count;
+    bool wasFull = chunk->count == chunk->get_capacity();
     chunk->count = newSize;
     if (newSize == 0)
     {
@@ -250,9 +266,11 @@ void dual_group_t::resize_chunk(dual_chunk_t* chunk, EIndex newSize)
     }
     else
     {
-        if (chunk->get_capacity() == newSize)
+        // free chunks must stay behind firstFree, only relink when chunk changes side
+        bool full = chunk->get_capacity() == newSize;
+        if (full && !wasFull)
             mark_full(chunk);
-        else
+        else if (!full && wasFull)
             mark_free(chunk);
     }
 }
@@ -316,6 +334,7 @@ void dual_group_t::clear()
     while (chunk != nullptr)
     {
         auto next = chunk->next;
+        archetype->storage->preserve(chunk);
         destruct_view({ chunk, 0, chunk->count });
         dual_chunk_t::destroy(chunk);
         chunk = next;
@@ -326,6 +345,84 @@ void dual_group_t::clear()
     size = 0;
 }
 
+namespace dual
+{
+struct delta_hasher {
+    size_t operator()(const dual_delta_type_t& value) const
+    {
+        return hash(value.removed, hash(value.added));
+    }
+};
+
+struct delta_equal {
+    bool operator()(const dual_delta_type_t& a, const dual_delta_type_t& b) const
+    {
+        return equal(a.added, b.added) && equal(a.removed, b.removed);
+    }
+};
+
+struct group_edges_t {
+    struct edge_t {
+        dual_group_t* target;
+        void* data; // owns the arrays of key
+    };
+    skr::flat_hash_map<dual_delta_type_t, edge_t, delta_hasher, delta_equal> edges;
+
+    ~group_edges_t()
+    {
+        for (auto& pair : edges)
+            ::dual_free(pair.second.data);
+    }
+};
+} // namespace dual
+
+bool dual_group_t::find_edge(const dual_delta_type_t& delta, dual_group_t*& target) const noexcept
+{
+    if (!edges)
+        return false;
+    auto iter = edges->edges.find(delta);
+    if (iter == edges->edges.end())
+        return false;
+    target = iter->second.target;
+    return true;
+}
+
+void dual_group_t::add_edge(const dual_delta_type_t& delta, dual_group_t* target)
+{
+    using namespace dual;
+    if (!edges)
+        edges = new group_edges_t;
+    size_t size = dual::data_size(delta.added) + dual::data_size(delta.removed);
+    void* data = size > 0 ? ::dual_malloc(size) : nullptr;
+    char* buffer = (char*)data;
+    dual_delta_type_t key;
+    key.added = clone(delta.added, buffer);
+    key.removed = clone(delta.removed, buffer);
+    edges->edges.insert({ key, { target, data } });
+}
+
+void dual_group_t::remove_edges(const dual_group_t* target)
+{
+    if (!edges)
+        return;
+    for (auto iter = edges->edges.begin(); iter != edges->edges.end();)
+    {
+        if (iter->second.target == target)
+        {
+            ::dual_free(iter->second.data);
+            edges->edges.erase(iter++);
+        }
+        else
+            ++iter;
+    }
+}
+
+void dual_group_t::release_edges()
+{
+    delete edges;
+    edges = nullptr;
+}
+
 SIndex dual_group_t::index(dual_type_index_t inType) const noexcept
 {
     using namespace dual;
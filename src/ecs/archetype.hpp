@@ -4,6 +4,8 @@
 
 namespace dual
 {
+struct job_dependency_entry_t;
+struct group_edges_t;
 // chunk data layout descriptor
 struct archetype_t {
     struct dual_storage_t* storage;
@@ -11,6 +13,8 @@ struct archetype_t {
     uint32_t* sizes;
     uint32_t* offsets[3];
     uint32_t* elemSizes;
+    // soa component stores each field in its own sub column, 1 for other components
+    uint32_t* fieldCounts;
     uint32_t* aligns;
     uint32_t versionOffset[3];
     dual_callback_v* callbacks;
@@ -18,6 +22,8 @@ struct archetype_t {
     uint32_t entitySize;
     uint32_t sizeToPatch;
     bool withMask;
+    // scheduled jobs accessing each component, see scheduler_t
+    job_dependency_entry_t* dependencyEntries;
 
     /*
         uint32_t offsets[3][firstTag];
@@ -26,6 +32,8 @@ struct archetype_t {
     */
 
     SIndex index(dual_type_index_t type) const noexcept;
+    // distance between sub columns of soa component
+    uint32_t field_stride(SIndex i, int pt) const noexcept { return sizes[i] / fieldCounts[i] * chunkCapacity[pt]; }
 };
 } // namespace dual
 
@@ -41,6 +49,8 @@ struct dual_group_t {
     dual::archetype_t* archetype;
     dual_group_t* dead;
     dual_group_t* cloned;
+    // groups reached by casting with a delta, lazily created
+    dual::group_edges_t* edges;
 
     bool isDead;
     bool disabled;
@@ -62,6 +72,11 @@ struct dual_group_t {
 
     void clear();
 
+    bool find_edge(const dual_delta_type_t& delta, dual_group_t*& target) const noexcept;
+    void add_edge(const dual_delta_type_t& delta, dual_group_t* target);
+    void remove_edges(const dual_group_t* target);
+    void release_edges();
+
     dual_chunk_t* new_chunk(uint32_t hint);
     void add_chunk(dual_chunk_t* chunk);
     void remove_chunk(dual_chunk_t* chunk);
@@ -12,6 +12,13 @@ fixed_arena_t::fixed_arena_t(size_t capacity)
 {
 }
 
+fixed_arena_t::fixed_arena_t(void* buffer, size_t capacity)
+    : buffer(buffer)
+    , size()
+    , capacity(capacity)
+{
+}
+
 fixed_arena_t::~fixed_arena_t()
 {
     if (buffer)
@@ -9,6 +9,8 @@ namespace dual
         std::atomic<size_t> size;
         size_t capacity;
         fixed_arena_t(size_t capacity);
+        // buffer is owned by arena as well, forget it if it is not allocated by dual_malloc
+        fixed_arena_t(void* buffer, size_t capacity);
         ~fixed_arena_t();
         void forget();
         void* allocate(size_t size, size_t align);
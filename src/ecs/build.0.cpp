@@ -4,6 +4,8 @@
 #include "cache.cpp"
 #include "chunk.cpp"
 #include "chunk_view.cpp"
+#include "command.cpp"
 #include "context.cpp"
+#include "delta.cpp"
 #include "entities.cpp"
 #include "dualX.cpp"
\ No newline at end of file
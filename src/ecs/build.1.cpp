@@ -3,7 +3,10 @@
 #include "scheduler.cpp"
 #include "serialize.cpp"
 #include "set.cpp"
+#include "snapshot.cpp"
 #include "stack.cpp"
+#include "stats.cpp"
 #include "storage.cpp"
+#include "system_graph.cpp"
 #include "type_registry.cpp"
 #include "type_builder.cpp"
\ No newline at end of file
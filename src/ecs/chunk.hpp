@@ -2,6 +2,7 @@
 
 #include "ecs/constants.hpp"
 #include "entity.hpp"
+#include <atomic>
 
 namespace dual
 {
@@ -18,6 +19,8 @@ struct dual_chunk_t {
     dual_group_t* group = nullptr;
     EIndex count = 0;
     dual::pool_type_t pt;
+    // latest snapshot serial the chunk is preserved for, chunks born after a snapshot are never shared with it
+    std::atomic<uint32_t> snapshotSerial{ 0 };
 
     char* data() { return (char*)(this + 1); }
     char* data() const { return (char*)(this + 1); }
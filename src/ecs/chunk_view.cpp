@@ -30,7 +30,9 @@ static dual_array_component_t* new_array(void* ptr, size_t cap, size_t elemSize,
 
 bool is_array_small(dual_array_component_t* ptr)
 {
-    return ptr->BeginX < ((char*)(ptr + 1) + alignof(std::max_align_t));
+    // inline storage follows the header, heap memory can be placed anywhere
+    char* inlineData = (char*)(ptr + 1);
+    return ptr->BeginX >= inlineData && ptr->BeginX < inlineData + alignof(std::max_align_t);
 }
 
 static void construct_impl(const dual_chunk_view_t& view, type_index_t type, EIndex offset, uint32_t size, uint32_t align, uint32_t elemSize, uint32_t maskValue, void (*constructor)(dual_chunk_t* chunk, EIndex index, char* data))
@@ -73,33 +75,39 @@ static void destruct_impl(const dual_chunk_view_t& view, type_index_t type, EInd
             destructor(view.chunk, view.start + j, (size_t)j * size + src);
 }
 
-static void move_impl(const dual_chunk_view_t& dstV, const dual_chunk_t* srcC, uint32_t srcStart, type_index_t type, EIndex offset, uint32_t size, uint32_t align, uint32_t elemSize, void (*move)(dual_chunk_t* chunk, EIndex index, char* dst, dual_chunk_t* schunk, EIndex sindex, char* src))
+static void move_impl(const dual_chunk_view_t& dstV, const dual_chunk_t* srcC, uint32_t srcStart, type_index_t type, EIndex srcOffset, EIndex dstOffset, uint32_t size, uint32_t align, uint32_t elemSize, void (*move)(dual_chunk_t* chunk, EIndex index, char* dst, dual_chunk_t* schunk, EIndex sindex, char* src))
 {
-    char* dst = dstV.chunk->data() + (size_t)offset + (size_t)size * dstV.start;
-    char* src = srcC->data() + (size_t)offset + (size_t)size * srcStart;
-    if (move)
+    // chunks of different size or archetype have different layout
+    char* dst = dstV.chunk->data() + (size_t)dstOffset + (size_t)size * dstV.start;
+    char* src = srcC->data() + (size_t)srcOffset + (size_t)size * srcStart;
+    if (type.is_buffer())
     {
-        if (type.is_buffer())
+        forloop (j, 0, dstV.count)
         {
-            forloop (j, 0, dstV.count)
+            auto arrayDst = (dual_array_component_t*)((size_t)j * size + dst);
+            auto arraySrc = (dual_array_component_t*)((size_t)j * size + src);
+            if (!is_array_small(arraySrc)) // memory is on heap
             {
-                auto arrayDst = (dual_array_component_t*)((size_t)j * size + dst);
-                auto arraySrc = (dual_array_component_t*)((size_t)j * size + src);
-                if (is_array_small(arraySrc)) // memory is on heap
-                    *arrayDst = *arraySrc;    // just steal it
-                else                          // memory is in chunk
-                {
-                    new_array(arrayDst, size, elemSize, align);
-                    for (char *currDst = (char*)arrayDst->BeginX, *currSrc = (char*)arraySrc->BeginX;
-                         currDst != arrayDst->EndX; currDst += elemSize, currSrc += elemSize)
-                        move(dstV.chunk, dstV.start + j, currDst, (dual_chunk_t*)srcC, srcStart + j, currSrc);
-                }
+                *arrayDst = *arraySrc; // just steal it
+                continue;
+            }
+            // memory is in chunk
+            new_array(arrayDst, size, elemSize, align);
+            size_t bytes = (char*)arraySrc->EndX - (char*)arraySrc->BeginX;
+            arrayDst->EndX = (char*)arrayDst->BeginX + bytes;
+            if (!move)
+            {
+                memcpy(arrayDst->BeginX, arraySrc->BeginX, bytes);
+                continue;
             }
+            for (char *currDst = (char*)arrayDst->BeginX, *currSrc = (char*)arraySrc->BeginX;
+                 currDst != arrayDst->EndX; currDst += elemSize, currSrc += elemSize)
+                move(dstV.chunk, dstV.start + j, currDst, (dual_chunk_t*)srcC, srcStart + j, currSrc);
         }
-        else
-            forloop (j, 0, dstV.count)
-                move(dstV.chunk, dstV.start + j, (size_t)j * size + dst, (dual_chunk_t*)srcC, srcStart + j, (size_t)j * size + src);
     }
+    else if (move)
+        forloop (j, 0, dstV.count)
+            move(dstV.chunk, dstV.start + j, (size_t)j * size + dst, (dual_chunk_t*)srcC, srcStart + j, (size_t)j * size + src);
     else
         memcpy(dst, src, dstV.count * (size_t)size);
 }
@@ -124,7 +132,7 @@ static void duplicate_impl(const dual_chunk_view_t& dstV, const dual_chunk_t* sr
     if (type == kGuidComponent)
     {
         auto guidDst = (guid_t*)dst;
-        auto registry = type_registry_t::get();
+        auto& registry = type_registry_t::get();
         forloop (j, 0, dstV.count)
             guidDst[j] = registry.make_guid();
         return;
@@ -180,6 +188,47 @@ static void duplicate_impl(const dual_chunk_view_t& dstV, const dual_chunk_t* sr
     }
 }
 
+// copy every row as is, guids are kept and arrays on heap are duplicated
+static void clone_impl(dual_chunk_t* dstC, const dual_chunk_t* srcC, EIndex count, type_index_t type, EIndex offset, uint32_t size, uint32_t elemSize, void (*copy)(dual_chunk_t* chunk, EIndex index, char* dst, dual_chunk_t* schunk, EIndex sindex, const char* src))
+{
+    char* dst = dstC->data() + (size_t)offset;
+    const char* src = srcC->data() + (size_t)offset;
+    if (type.is_buffer())
+    {
+        forloop (j, 0, count)
+        {
+            auto arrayDst = (dual_array_component_t*)((size_t)j * size + dst);
+            auto arraySrc = (dual_array_component_t*)((size_t)j * size + src);
+            size_t bytes = (char*)arraySrc->EndX - (char*)arraySrc->BeginX;
+            if (!is_array_small(arraySrc))
+            {
+                arrayDst->BeginX = dual_array_component_t::allocate(bytes);
+                arrayDst->EndX = arrayDst->CapacityX = (char*)arrayDst->BeginX + bytes;
+            }
+            else
+            {
+                size_t arrOffset = ((char*)arraySrc->BeginX - (char*)arraySrc);
+                size_t arraySize = ((char*)arraySrc->CapacityX - (char*)arraySrc->BeginX);
+                new (arrayDst) dual_array_component_t((char*)arrayDst + arrOffset, arraySize);
+                arrayDst->EndX = (char*)arrayDst->BeginX + bytes;
+            }
+            if (!copy)
+            {
+                memcpy(arrayDst->BeginX, arraySrc->BeginX, bytes);
+                continue;
+            }
+            for (char *currDst = (char*)arrayDst->BeginX, *currSrc = (char*)arraySrc->BeginX;
+                 currDst != arrayDst->EndX; currDst += elemSize, currSrc += elemSize)
+                copy(dstC, j, currDst, (dual_chunk_t*)srcC, j, currSrc);
+        }
+    }
+    else if (copy && type != kGuidComponent)
+        forloop (j, 0, count)
+            copy(dstC, j, (size_t)j * size + dst, (dual_chunk_t*)srcC, j, (size_t)j * size + src);
+    else
+        memcpy(dst, src, (size_t)size * count);
+}
+
 void construct_view(const dual_chunk_view_t& view) noexcept
 {
     archetype_t* type = view.chunk->type;
@@ -188,8 +237,10 @@ void construct_view(const dual_chunk_view_t& view) noexcept
     uint32_t* aligns = type->aligns;
     uint32_t* elemSizes = type->elemSizes;
     auto maskValue = uint32_t(1 << type->type.length) - 1;
+    uint32_t* fieldCounts = type->fieldCounts;
     for (auto i = 0; i < type->type.length; ++i)
-        construct_impl(view, type->type.data[i], offsets[i], sizes[i], aligns[i], elemSizes[i], maskValue, type->callbacks[i].constructor);
+        forloop (f, 0, fieldCounts[i])
+            construct_impl(view, type->type.data[i], offsets[i] + f * type->field_stride(i, view.chunk->pt), sizes[i] / fieldCounts[i], aligns[i], elemSizes[i], maskValue, type->callbacks[i].constructor);
 }
 
 void destruct_view(const dual_chunk_view_t& view) noexcept
@@ -210,12 +261,15 @@ void move_view(const dual_chunk_view_t& view, EIndex srcStart) noexcept
 void move_view(const dual_chunk_view_t& dstV, const dual_chunk_t* srcC, uint32_t srcStart) noexcept
 {
     archetype_t* type = dstV.chunk->type;
-    EIndex* offsets = type->offsets[(int)dstV.chunk->pt];
+    EIndex* srcOffsets = type->offsets[(int)srcC->pt];
+    EIndex* dstOffsets = type->offsets[(int)dstV.chunk->pt];
     uint32_t* sizes = type->sizes;
     uint32_t* aligns = type->aligns;
     uint32_t* elemSizes = type->elemSizes;
+    uint32_t* fieldCounts = type->fieldCounts;
     for (auto i = 0; i < type->type.length; ++i)
-        move_impl(dstV, srcC, srcStart, type->type.data[i], offsets[i], sizes[i], aligns[i], elemSizes[i], type->callbacks[i].move);
+        forloop (f, 0, fieldCounts[i])
+            move_impl(dstV, srcC, srcStart, type->type.data[i], srcOffsets[i] + f * type->field_stride(i, srcC->pt), dstOffsets[i] + f * type->field_stride(i, dstV.chunk->pt), sizes[i] / fieldCounts[i], aligns[i], elemSizes[i], type->callbacks[i].move);
 }
 
 void cast_view(const dual_chunk_view_t& dstV, dual_chunk_t* srcC, EIndex srcStart) noexcept
@@ -252,12 +306,14 @@ void cast_view(const dual_chunk_view_t& dstV, dual_chunk_t* srcC, EIndex srcStar
         type_index_t dstT = dstTypes.data[dstI];
         if (srcT < dstT) // destruct
         {
+            // soa component has no destructor, its fields need no visit
             destruct_impl({ srcC, srcStart, dstV.count }, srcT, srcOffsets[srcI], srcSizes[srcI], srcElemSizes[srcI], srcType->callbacks[srcI].destructor);
             ++srcI;
         }
         else if (srcT > dstT) // construct
         {
-            construct_impl(dstV, dstT, dstOffsets[dstI], dstSizes[dstI], dstAligns[dstI], dstElemSizes[dstI], maskValue, dstType->callbacks[dstI].constructor);
+            forloop (f, 0, dstType->fieldCounts[dstI])
+                construct_impl(dstV, dstT, dstOffsets[dstI] + f * dstType->field_stride(dstI, dstV.chunk->pt), dstSizes[dstI] / dstType->fieldCounts[dstI], dstAligns[dstI], dstElemSizes[dstI], maskValue, dstType->callbacks[dstI].constructor);
             if (dstMasks)
                 forloop (i, 0, dstV.count)
                     dstMasks[i]
@@ -267,7 +323,8 @@ void cast_view(const dual_chunk_view_t& dstV, dual_chunk_t* srcC, EIndex srcStar
         else
         {
             if (srcT != kMaskComponent)
-                move_impl(dstV, srcC, srcStart, srcT, srcOffsets[srcI], srcSizes[srcI], srcAligns[srcI], srcElemSizes[srcI], srcType->callbacks[srcI].move);
+                forloop (f, 0, srcType->fieldCounts[srcI])
+                    move_impl(dstV, srcC, srcStart, srcT, srcOffsets[srcI] + f * srcType->field_stride(srcI, srcC->pt), dstOffsets[dstI] + f * dstType->field_stride(dstI, dstV.chunk->pt), srcSizes[srcI] / srcType->fieldCounts[srcI], srcAligns[srcI], srcElemSizes[srcI], srcType->callbacks[srcI].move);
             if (dstMasks)
             {
                 if (srcMasks)
@@ -293,8 +350,28 @@ void duplicate_view(const dual_chunk_view_t& dstV, const dual_chunk_t* srcC, EIn
     EIndex* dstOffsets = dstType->offsets[(int)dstV.chunk->pt];
     uint32_t* sizes = type->sizes;
     uint32_t* elemSizes = type->elemSizes;
+    uint32_t* fieldCounts = type->fieldCounts;
+    for (auto i = 0; i < type->type.length; ++i)
+        forloop (f, 0, fieldCounts[i])
+            duplicate_impl(dstV, srcC, srcStart, type->type.data[i], offsets[i] + f * type->field_stride(i, srcC->pt), dstOffsets[i] + f * dstType->field_stride(i, dstV.chunk->pt), sizes[i] / fieldCounts[i], elemSizes[i], type->callbacks[i].copy);
+}
+
+void clone_view(dual_chunk_t* dst, const dual_chunk_t* src, EIndex count) noexcept
+{
+    archetype_t* type = src->type;
+    EIndex* offsets = type->offsets[(int)src->pt];
+    uint32_t* sizes = type->sizes;
+    uint32_t* elemSizes = type->elemSizes;
+    SKR_ASSERT(dst->pt == src->pt);
+    dst->type = type;
+    dst->group = src->group;
+    dst->count = count;
+    memcpy((char*)dst->get_entities(), src->get_entities(), sizeof(dual_entity_t) * count);
+    memcpy(dst->timestamps(), ((dual_chunk_t*)src)->timestamps(), sizeof(uint32_t) * type->type.length);
+    uint32_t* fieldCounts = type->fieldCounts;
     for (auto i = 0; i < type->type.length; ++i)
-        duplicate_impl(dstV, srcC, srcStart, type->type.data[i], offsets[i], dstOffsets[i], sizes[i], elemSizes[i], type->callbacks[i].copy);
+        forloop (f, 0, fieldCounts[i])
+            clone_impl(dst, src, count, type->type.data[i], offsets[i] + f * type->field_stride(i, src->pt), sizes[i] / fieldCounts[i], elemSizes[i], type->callbacks[i].copy);
 }
 
 bool full_view(const dual_chunk_view_t& view) noexcept
@@ -325,7 +402,7 @@ void disable_components(const dual_chunk_view_t& view, const dual_type_set_t& ty
 }
 } // namespace dual
 
-template <bool readonly, bool local>
+template <bool readonly, bool local, bool field = false>
 auto dualV_get_owned(const dual_chunk_view_t* view, dual_type_index_t type)
 {
     using namespace dual;
@@ -341,12 +418,33 @@ auto dualV_get_owned(const dual_chunk_view_t* view, dual_type_index_t type)
         id = structure->index(type);
     if (id == kInvalidSIndex)
         return (return_type) nullptr;
+    // rows of soa component are not contiguous
+    if constexpr (!field)
+        SKR_ASSERT(structure->fieldCounts[id] == 1 && "soa component should be accessed by dualV_get_field");
     if constexpr (!readonly)
+    {
+        structure->storage->preserve(chunk);
         chunk->timestamps()[id] = structure->storage->timestamp;
+    }
     auto scheduler = structure->storage->scheduler;
     if (scheduler && scheduler->is_main_thread(structure->storage))
         scheduler->sync_entry(structure, id);
-    return (return_type)(chunk->data() + structure->sizes[id] * view->start + structure->offsets[chunk->pt][id]);
+    // first field of soa component
+    return (return_type)(chunk->data() + structure->sizes[id] / structure->fieldCounts[id] * view->start + structure->offsets[chunk->pt][id]);
+}
+
+template <bool readonly>
+auto dualV_get_field(const dual_chunk_view_t* view, dual_type_index_t type, uint32_t field)
+{
+    using namespace dual;
+    using return_type = std::conditional_t<readonly, const char*, char*>;
+    auto data = (return_type)dualV_get_owned<readonly, false, true>(view, type);
+    if (!data) DUAL_UNLIKELY
+        return data;
+    auto structure = view->chunk->type;
+    SIndex id = structure->index(type);
+    SKR_ASSERT(field < structure->fieldCounts[id]);
+    return data + (size_t)field * structure->field_stride(id, view->chunk->pt);
 }
 
 extern "C" {
@@ -378,6 +476,16 @@ void* dualV_get_owned_rw_local(const dual_chunk_view_t* view, dual_type_index_t
     return dualV_get_owned<false, true>(view, type);
 }
 
+const void* dualV_get_field_ro(const dual_chunk_view_t* view, dual_type_index_t type, uint32_t field)
+{
+    return dualV_get_field<true>(view, type, field);
+}
+
+void* dualV_get_field_rw(const dual_chunk_view_t* view, dual_type_index_t type, uint32_t field)
+{
+    return dualV_get_field<false>(view, type, field);
+}
+
 const dual_entity_t* dualV_get_entities(const dual_chunk_view_t* view)
 {
     auto chunk = view->chunk;
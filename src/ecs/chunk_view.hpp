@@ -12,6 +12,8 @@ namespace dual
     void move_view(const dual_chunk_view_t& dst, const dual_chunk_t* src, uint32_t srcIndex) noexcept;
     void cast_view(const dual_chunk_view_t& dst, dual_chunk_t* src, EIndex srcIndex) noexcept;
     void duplicate_view(const dual_chunk_view_t& dst, const dual_chunk_t* src, EIndex srcIndex) noexcept;
+    // copy first count rows of src into dst, dst should be an empty chunk of the same pool type
+    void clone_view(dual_chunk_t* dst, const dual_chunk_t* src, EIndex count) noexcept;
     template<class F>
     void iterator_ref_view(const dual_chunk_view_t& s, F&& iter) noexcept;
     void serialize_view(const dual_chunk_view_t& v, serializer_t s, bool withEntities = true);
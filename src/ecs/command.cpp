@@ -0,0 +1,362 @@
+#include "command.hpp"
+#include "archetype.hpp"
+#include "chunk.hpp"
+#include "entity.hpp"
+#include "pool.hpp"
+#include "scheduler.hpp"
+#include "set.hpp"
+#include "storage.hpp"
+#include "type_registry.hpp"
+#include "utils/hashmap.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#ifndef forloop
+    #define forloop(i, z, n) for (auto i = std::decay_t<decltype(n)>(z); i < (n); ++i)
+#endif
+
+namespace dual
+{
+static std::atomic<uint64_t> commandBufferSerial{ 0 };
+// stream of the last buffer recorded by this thread, serial tells if the buffer is still the same one
+struct command_stream_cache_t {
+    uint64_t serial = 0;
+    command_stream_t* stream = nullptr;
+};
+static thread_local command_stream_cache_t commandStreamCache;
+
+command_stream_t::command_stream_t()
+    : owner(std::this_thread::get_id())
+    , arena(get_default_pool())
+    , lastDelta(nullptr)
+{
+}
+
+const dual_delta_type_t* command_stream_t::copy(const dual_delta_type_t& delta)
+{
+    if (lastDelta && equal(lastDelta->added, delta.added) && equal(lastDelta->removed, delta.removed))
+        return lastDelta;
+    size_t size = data_size(delta.added) + data_size(delta.removed);
+    auto result = arena.allocate<dual_delta_type_t>();
+    char* buffer = (char*)arena.allocate(size, alignof(dual_entity_t));
+    SKR_ASSERT(result && buffer);
+    result->added = clone(delta.added, buffer);
+    result->removed = clone(delta.removed, buffer);
+    return lastDelta = result;
+}
+
+const dual_entity_type_t* command_stream_t::copy(const dual_entity_type_t& type)
+{
+    auto result = arena.allocate<dual_entity_type_t>();
+    char* buffer = (char*)arena.allocate(data_size(type), alignof(dual_entity_t));
+    SKR_ASSERT(result && buffer);
+    *result = clone(type, buffer);
+    return result;
+}
+
+void command_stream_t::reset()
+{
+    arena.reset();
+    spawns.clear();
+    reservedSpawns.clear();
+    reserved.clear();
+    casts.clear();
+    sets.clear();
+    destroys.clear();
+    data.clear();
+    lastDelta = nullptr;
+}
+
+struct located_entity_t {
+    dual_chunk_t* chunk;
+    EIndex index;
+};
+
+// entities are processed from the back of each chunk, so removing a run only moves entities of runs already done
+template <class F>
+static void for_each_run(std::vector<located_entity_t>& ents, F&& f)
+{
+    std::sort(ents.begin(), ents.end(), [](const located_entity_t& lhs, const located_entity_t& rhs) {
+        return lhs.chunk != rhs.chunk ? lhs.chunk < rhs.chunk : lhs.index > rhs.index;
+    });
+    size_t i = 0;
+    while (i < ents.size())
+    {
+        size_t j = i + 1;
+        while (j < ents.size() && ents[j].chunk == ents[i].chunk && ents[j].index + 1 == ents[j - 1].index)
+            ++j;
+        dual_chunk_view_t view{ ents[i].chunk, ents[j - 1].index, (EIndex)(j - i) };
+        f(view);
+        i = j;
+    }
+}
+} // namespace dual
+
+dual_command_buffer_t::dual_command_buffer_t(dual_storage_t* storage)
+    : storage(storage)
+    , serial(++dual::commandBufferSerial)
+{
+}
+
+dual_command_buffer_t::~dual_command_buffer_t()
+{
+    clear();
+    for (auto stream : streams)
+        delete stream;
+}
+
+dual::command_stream_t& dual_command_buffer_t::get_stream()
+{
+    using namespace dual;
+    auto& cache = commandStreamCache;
+    if (cache.serial == serial)
+        return *cache.stream;
+    auto id = std::this_thread::get_id();
+    command_stream_t* result = nullptr;
+    skr_acquire_mutex(&mutex.mMutex);
+    for (auto stream : streams)
+        if (stream->owner == id)
+        {
+            result = stream;
+            break;
+        }
+    if (!result)
+    {
+        result = new command_stream_t();
+        streams.push_back(result);
+    }
+    skr_release_mutex(&mutex.mMutex);
+    cache.serial = serial;
+    cache.stream = result;
+    return *result;
+}
+
+void dual_command_buffer_t::clear()
+{
+    // reserved ids not played back are pending in registry until they are returned
+    for (auto stream : streams)
+    {
+        if (!stream->reserved.empty())
+            storage->entities.release_reserved(stream->reserved.data(), (EIndex)stream->reserved.size());
+        stream->reset();
+    }
+}
+
+void dual_command_buffer_t::playback()
+{
+    using namespace dual;
+    if (storage->scheduler)
+        SKR_ASSERT(storage->scheduler->is_main_thread(storage));
+    auto& entries = storage->entities.entries;
+    std::vector<located_entity_t> located;
+    // destroy first, later commands of destroyed entities are dropped
+    std::vector<dual_entity_t> destroys;
+    auto destroy_recorded = [&]() {
+        for (auto e : destroys)
+        {
+            if (!storage->exist(e))
+                continue;
+            auto& entry = entries[e_id(e)];
+            if (entry.chunk->group->isDead)
+                continue;
+            located.push_back({ entry.chunk, entry.indexInChunk });
+        }
+        for_each_run(located, [&](const dual_chunk_view_t& view) { storage->destroy(view); });
+        located.clear();
+    };
+    for (auto stream : streams)
+        destroys.insert(destroys.end(), stream->destroys.begin(), stream->destroys.end());
+    std::sort(destroys.begin(), destroys.end());
+    destroys.erase(std::unique(destroys.begin(), destroys.end()), destroys.end());
+    destroy_recorded();
+    // reserved ids are bound before casts and sets, so commands recorded for them in the same buffer are applied
+    // recycled ids used by them are handed out again
+    {
+        EIndex bound = 0;
+        bool destroyed = false;
+        for (auto stream : streams)
+            for (auto& spawn : stream->reservedSpawns)
+            {
+                auto group = storage->get_group(*spawn.type);
+                SKR_ASSERT(group);
+                auto ents = stream->reserved.data() + spawn.offset;
+                storage->allocate(group, spawn.count, spawn.callback, spawn.u, ents);
+                bound += spawn.count;
+                forloop (i, 0, spawn.count)
+                    destroyed |= std::binary_search(destroys.begin(), destroys.end(), ents[i]);
+            }
+        for (auto stream : streams)
+        {
+            stream->reservedSpawns.clear();
+            stream->reserved.clear();
+        }
+        if (bound != 0)
+            storage->entities.share_free_entities(bound);
+        // reserved entities destroyed in the same buffer are gone right after spawn
+        if (destroyed)
+            destroy_recorded();
+    }
+    // fold all casts of an entity into its final group, then move entities by (source, target) group
+    {
+        struct transition_t {
+            dual_group_t* src;
+            dual_group_t* dst;
+            dual_entity_t entity;
+        };
+        skr::flat_hash_map<std::pair<dual_group_t*, const dual_delta_type_t*>, dual_group_t*> transitions;
+        skr::flat_hash_map<dual_entity_t, size_t> indices;
+        std::vector<transition_t> moves;
+        for (auto stream : streams)
+            for (auto& cast : stream->casts)
+            {
+                if (!storage->exist(cast.entity))
+                    continue;
+                auto iter = indices.find(cast.entity);
+                if (iter == indices.end())
+                {
+                    auto group = entries[e_id(cast.entity)].chunk->group;
+                    if (group->isDead)
+                        continue;
+                    iter = indices.insert({ cast.entity, moves.size() }).first;
+                    moves.push_back({ group, group, cast.entity });
+                }
+                auto& move = moves[iter->second];
+                if (!move.dst) // all components removed
+                    continue;
+                auto key = std::make_pair(move.dst, cast.delta);
+                auto transition = transitions.find(key);
+                if (transition == transitions.end())
+                    transition = transitions.insert({ key, storage->cast(move.dst, *cast.delta) }).first;
+                move.dst = transition->second;
+            }
+        moves.erase(std::remove_if(moves.begin(), moves.end(), [](const transition_t& move) { return move.src == move.dst; }), moves.end());
+        std::sort(moves.begin(), moves.end(), [](const transition_t& lhs, const transition_t& rhs) {
+            return lhs.src != rhs.src ? lhs.src < rhs.src : lhs.dst < rhs.dst;
+        });
+        size_t i = 0;
+        while (i < moves.size())
+        {
+            // entities of a source group are shuffled by previous batch, so locate them right before moving
+            located.clear();
+            size_t j = i;
+            for (; j < moves.size() && moves[j].src == moves[i].src && moves[j].dst == moves[i].dst; ++j)
+            {
+                auto& entry = entries[e_id(moves[j].entity)];
+                located.push_back({ entry.chunk, entry.indexInChunk });
+            }
+            auto dst = moves[i].dst;
+            for_each_run(located, [&](const dual_chunk_view_t& view) { storage->cast(view, dst, nullptr, nullptr); });
+            i = j;
+        }
+    }
+    for (auto stream : streams)
+        for (auto& set : stream->sets)
+        {
+            if (!storage->exist(set.entity))
+                continue;
+            auto view = storage->entity_view(set.entity);
+            if (view.chunk->group->isDead)
+                continue;
+            auto data = (char*)dualV_get_field_rw(&view, set.type, 0);
+            if (!data)
+                continue;
+            auto type = view.chunk->type;
+            SIndex id = type->index(set.type);
+            // payload of soa component is scattered to its sub columns
+            auto fieldCount = type->fieldCounts[id];
+            auto fieldSize = set.size / fieldCount;
+            forloop (f, 0, fieldCount)
+                std::memcpy(data + f * type->field_stride(id, view.chunk->pt), stream->data.data() + set.offset + f * fieldSize, fieldSize);
+        }
+    // spawns without callback are merged by group
+    {
+        skr::flat_hash_map<dual_group_t*, EIndex> counts;
+        std::vector<dual_group_t*> groups;
+        for (auto stream : streams)
+            for (auto& spawn : stream->spawns)
+            {
+                auto group = storage->get_group(*spawn.type);
+                SKR_ASSERT(group);
+                if (spawn.callback)
+                {
+                    storage->allocate(group, spawn.count, spawn.callback, spawn.u);
+                    continue;
+                }
+                auto iter = counts.find(group);
+                if (iter == counts.end())
+                {
+                    counts.insert({ group, spawn.count });
+                    groups.push_back(group);
+                }
+                else
+                    iter->second += spawn.count;
+            }
+        for (auto group : groups)
+            storage->allocate(group, counts[group], nullptr, nullptr);
+    }
+    clear();
+}
+
+extern "C" {
+dual_command_buffer_t* dualB_create(dual_storage_t* storage)
+{
+    return new dual_command_buffer_t(storage);
+}
+
+void dualB_release(dual_command_buffer_t* buffer)
+{
+    delete buffer;
+}
+
+void dualB_spawn(dual_command_buffer_t* buffer, const dual_entity_type_t* type, EIndex count, dual_view_callback_t callback, void* u)
+{
+    assert(dual::ordered(*type));
+    auto& stream = buffer->get_stream();
+    stream.spawns.push_back({ stream.copy(*type), count, callback, u, 0 });
+}
+
+void dualB_spawn_reserved(dual_command_buffer_t* buffer, const dual_entity_type_t* type, const dual_entity_t* ents, EIndex count, dual_view_callback_t callback, void* u)
+{
+    assert(dual::ordered(*type));
+    auto& stream = buffer->get_stream();
+    size_t offset = stream.reserved.size();
+    stream.reserved.insert(stream.reserved.end(), ents, ents + count);
+    stream.reservedSpawns.push_back({ stream.copy(*type), count, callback, u, offset });
+}
+
+void dualB_destroy(dual_command_buffer_t* buffer, dual_entity_t ent)
+{
+    buffer->get_stream().destroys.push_back(ent);
+}
+
+void dualB_cast(dual_command_buffer_t* buffer, dual_entity_t ent, const dual_delta_type_t* delta)
+{
+    assert(dual::ordered(*delta));
+    auto& stream = buffer->get_stream();
+    stream.casts.push_back({ ent, stream.copy(*delta) });
+}
+
+void dualB_set(dual_command_buffer_t* buffer, dual_entity_t ent, dual_type_index_t type, const void* data)
+{
+    using namespace dual;
+    type_index_t index = type;
+    // data is copied bitwise at playback
+    SKR_ASSERT(!index.is_tag() && !index.is_buffer() && !index.is_managed());
+    auto& desc = type_registry_t::get().descriptions[index.index()];
+    auto& stream = buffer->get_stream();
+    size_t offset = stream.data.size();
+    stream.data.resize(offset + desc.size);
+    std::memcpy(stream.data.data() + offset, data, desc.size);
+    stream.sets.push_back({ ent, type, desc.size, offset });
+}
+
+void dualB_playback(dual_command_buffer_t* buffer)
+{
+    buffer->playback();
+}
+
+void dualB_clear(dual_command_buffer_t* buffer)
+{
+    buffer->clear();
+}
+}
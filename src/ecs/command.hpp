@@ -0,0 +1,60 @@
+#pragma once
+#include "ecs/dual.h"
+#include "arena.hpp"
+#include "platform/thread.h"
+#include <thread>
+#include <vector>
+
+namespace dual
+{
+// commands recorded by one thread, only touched by its owner until playback
+struct command_stream_t {
+    struct spawn_t {
+        const dual_entity_type_t* type;
+        EIndex count;
+        dual_view_callback_t callback;
+        void* u;
+        size_t offset; // into reserved, only for reserved spawns
+    };
+    struct cast_t {
+        dual_entity_t entity;
+        const dual_delta_type_t* delta;
+    };
+    struct set_t {
+        dual_entity_t entity;
+        dual_type_index_t type;
+        uint32_t size;
+        size_t offset; // into data
+    };
+    std::thread::id owner;
+    block_arena_t arena; // copied types and deltas
+    std::vector<spawn_t> spawns;
+    std::vector<spawn_t> reservedSpawns;
+    std::vector<dual_entity_t> reserved;
+    std::vector<cast_t> casts;
+    std::vector<set_t> sets;
+    std::vector<dual_entity_t> destroys;
+    std::vector<char> data;
+    // consecutive casts with same delta share one copy, which also keeps transition lookup cheap
+    const dual_delta_type_t* lastDelta;
+
+    command_stream_t();
+    const dual_delta_type_t* copy(const dual_delta_type_t& delta);
+    const dual_entity_type_t* copy(const dual_entity_type_t& type);
+    void reset();
+};
+} // namespace dual
+
+// structural changes recorded from jobs and applied on main thread by playback
+struct dual_command_buffer_t {
+    dual_storage_t* storage;
+    uint64_t serial;
+    SMutexObject mutex;
+    std::vector<dual::command_stream_t*> streams;
+
+    dual_command_buffer_t(dual_storage_t* storage);
+    ~dual_command_buffer_t();
+    dual::command_stream_t& get_stream();
+    void playback();
+    void clear();
+};
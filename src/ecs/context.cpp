@@ -3,6 +3,7 @@
 #include "type_registry.hpp"
 
 dual_context_t* g_dual_ctx;
+static dual_pool_config_t g_dual_pool_config = {};
 
 RUNTIME_API dual_context_t* dual_get_context()
 {
@@ -28,6 +29,10 @@ pool_t& get_default_pool_large()
 {
     return dual_get_context()->largePool;
 }
+binned_pool_t& get_job_pool()
+{
+    return dual_get_context()->jobPool;
+}
 scheduler_t& scheduler_t::get()
 {
     return dual_get_context()->scheduler;
@@ -38,13 +43,29 @@ std::string& get_error()
 }
 } // namespace dual
 
+static size_t arena_region_size()
+{
+    if (!g_dual_pool_config.hugePageArena)
+        return 0;
+    return g_dual_pool_config.regionSize ? g_dual_pool_config.regionSize : dual::kArenaRegionSize;
+}
+
+static void apply_pool_budgets(dual_context_t* ctx)
+{
+    ctx->smallPool.budget.store(g_dual_pool_config.smallBudget, std::memory_order_relaxed);
+    ctx->normalPool.budget.store(g_dual_pool_config.normalBudget, std::memory_order_relaxed);
+    ctx->largePool.budget.store(g_dual_pool_config.largeBudget, std::memory_order_relaxed);
+}
+
 dual_context_t::dual_context_t()
-    : normalPool(dual::kFastBinSize, dual::kFastBinCapacity)
-    , largePool(dual::kLargeBinSize, dual::kLargeBinCapacity)
-    , smallPool(dual::kSmallBinSize, dual::kSmallBinCapacity)
+    : normalPool(dual::kFastBinSize, dual::kFastBinCapacity, arena_region_size())
+    , largePool(dual::kLargeBinSize, dual::kLargeBinCapacity, arena_region_size())
+    , smallPool(dual::kSmallBinSize, dual::kSmallBinCapacity, arena_region_size())
+    , jobPool(dual::kJobBinMinSize, dual::kJobBinCount, dual::kJobBinCapacity)
     , typeRegistry(smallPool)
     , scheduler()
 {
+    apply_pool_budgets(this);
 }
 
 extern "C" {
@@ -56,5 +77,30 @@ dual_context_t* dual_initialize()
 void dual_shutdown()
 {
     delete dual_get_context();
+    g_dual_ctx = nullptr;
+}
+
+void dual_get_pool_stats(dual_pool_stats_t* small, dual_pool_stats_t* normal, dual_pool_stats_t* large)
+{
+    auto ctx = dual_get_context();
+    if (small)
+        ctx->smallPool.get_stats(small);
+    if (normal)
+        ctx->normalPool.get_stats(normal);
+    if (large)
+        ctx->largePool.get_stats(large);
+}
+
+void dual_set_pool_config(const dual_pool_config_t* config)
+{
+    g_dual_pool_config = *config;
+    if (g_dual_ctx)
+        apply_pool_budgets(g_dual_ctx);
+}
+
+uint64_t dual_trim_pools()
+{
+    auto ctx = dual_get_context();
+    return ctx->smallPool.trim() + ctx->normalPool.trim() + ctx->largePool.trim();
 }
 }
\ No newline at end of file
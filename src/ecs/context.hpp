@@ -10,6 +10,8 @@ struct dual_context_t {
     dual::pool_t normalPool;
     dual::pool_t largePool;
     dual::pool_t smallPool;
+    // declared before scheduler, jobs are released to it when scheduler is destroyed
+    dual::binned_pool_t jobPool;
     dual::type_registry_t typeRegistry;
     dual::scheduler_t scheduler;
     std::string error;
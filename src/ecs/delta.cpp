@@ -0,0 +1,367 @@
+#include "delta.hpp"
+#include "archetype.hpp"
+#include "chunk.hpp"
+#include "chunk_view.hpp"
+#include "ecs/dual.h"
+#include "ecs/entities.hpp"
+#include "entity.hpp"
+#include "scheduler.hpp"
+#include "serialize.hpp"
+#include "set.hpp"
+#include "storage.hpp"
+#include "type.hpp"
+#include <cstring>
+#ifndef forloop
+    #define forloop(i, z, n) for (auto i = std::decay_t<decltype(n)>(z); i < (n); ++i)
+#endif
+
+namespace dual
+{
+void blob_stream_t::stream(void* u, void* data, uint32_t bytes)
+{
+    auto s = (blob_stream_t*)u;
+    if (s->writing)
+    {
+        auto offset = s->buffer->size();
+        s->buffer->resize(offset + bytes);
+        std::memcpy(s->buffer->data() + offset, data, bytes);
+    }
+    else
+    {
+        std::memcpy(data, s->buffer->data() + s->cursor, bytes);
+        s->cursor += bytes;
+    }
+}
+
+void blob_stream_t::peek(void* u, void* data, uint32_t bytes)
+{
+    auto s = (blob_stream_t*)u;
+    std::memcpy(data, s->buffer->data() + s->cursor, bytes);
+}
+
+int blob_stream_t::is_serialize(void* u)
+{
+    return ((blob_stream_t*)u)->writing;
+}
+
+const dual_serializer_v blob_stream_v = { &blob_stream_t::stream, &blob_stream_t::peek, &blob_stream_t::is_serialize };
+
+static bool alive(const dual_storage_t& storage, dual_entity_t e)
+{
+    return storage.exist(e) && storage.entities.entries[e_id(e)].chunk != nullptr;
+}
+
+static bool chunk_changed(dual_chunk_t* chunk, uint32_t since)
+{
+    auto timestamps = chunk->timestamps();
+    forloop (i, 0, chunk->type->type.length)
+        if ((int32_t)(timestamps[i] - since) >= 0)
+            return true;
+    return false;
+}
+
+// compare one entity from both storage, only components written after since are checked
+static bool equal_row(const dual_chunk_view_t& a, const dual_chunk_view_t& b, bool incremental, uint32_t since, std::vector<char> (&buffers)[2])
+{
+    archetype_t* ta = a.chunk->type;
+    archetype_t* tb = b.chunk->type;
+    auto timestamps = b.chunk->timestamps();
+    bool complex = false;
+    forloop (i, 0, ta->type.length)
+    {
+        if (incremental && (int32_t)(timestamps[i] - since) < 0)
+            continue;
+        auto size = ta->sizes[i];
+        if (size == 0)
+            continue;
+        if (type_index_t(ta->type.data[i]).is_buffer() || ta->callbacks[i].serialize)
+        {
+            // compare persistent format instead of pointer data
+            complex = true;
+            continue;
+        }
+        auto fieldCount = ta->fieldCounts[i];
+        size /= fieldCount;
+        auto da = a.chunk->data() + (size_t)ta->offsets[a.chunk->pt][i] + (size_t)size * a.start;
+        auto db = b.chunk->data() + (size_t)tb->offsets[b.chunk->pt][i] + (size_t)size * b.start;
+        forloop (f, 0, fieldCount)
+            if (std::memcmp(da + f * ta->field_stride(i, a.chunk->pt), db + f * tb->field_stride(i, b.chunk->pt), size) != 0)
+                return false;
+    }
+    if (!complex)
+        return true;
+    buffers[0].clear();
+    buffers[1].clear();
+    blob_stream_t sa{ &buffers[0], 0, true };
+    blob_stream_t sb{ &buffers[1], 0, true };
+    serialize_view(a, { &sa, &blob_stream_v }, false);
+    serialize_view(b, { &sb, &blob_stream_v }, false);
+    return buffers[0] == buffers[1];
+}
+} // namespace dual
+
+dual_storage_delta_t* dual_storage_t::diff(dual_storage_t& target)
+{
+    using namespace dual;
+    if (scheduler)
+    {
+        SKR_ASSERT(scheduler->is_main_thread(this));
+        scheduler->sync_storage(this);
+    }
+    if (target.scheduler)
+    {
+        SKR_ASSERT(target.scheduler->is_main_thread(&target));
+        target.scheduler->sync_storage(&target);
+    }
+    auto delta = new dual_storage_delta_t;
+    delta->timestamp = target.timestamp;
+    // chunks untouched since last applied delta can be skipped
+    const bool incremental = deltaSynced;
+    const uint32_t since = deltaTimestamp;
+
+    auto& log = target.entities.freeLog;
+    const uint64_t logBase = target.entities.freeLogBase;
+    if (incremental && deltaFreeCursor >= logBase)
+    {
+        // only entities freed in target since last delta can be destroyed
+        forloop (i, (size_t)(deltaFreeCursor - logBase), log.size())
+        {
+            dual_entity_t e = log[i];
+            if (alive(*this, e) && !alive(target, e))
+                delta->destroyed.push_back(e);
+        }
+        // entries before cursor are consumed, other readers behind it fall back to full scan
+        log.erase(log.begin(), log.begin() + (deltaFreeCursor - logBase));
+        target.entities.freeLogBase = deltaFreeCursor;
+    }
+    else
+    {
+        auto& entries = entities.entries;
+        forloop (i, 0, entries.size())
+        {
+            if (entries[i].chunk == nullptr)
+                continue;
+            dual_entity_t e = e_version((dual_entity_t)i, entries[i].version);
+            if (!alive(target, e))
+                delta->destroyed.push_back(e);
+        }
+        target.entities.logFrees = true;
+    }
+    delta->freeCursor = target.entities.freeLogBase + log.size();
+
+    std::vector<char> buffers[2];
+    for (auto& pair : target.groups)
+    {
+        dual_group_t* group = pair.second;
+        dual_storage_delta_t::group_delta_t* gd = nullptr;
+        auto get_delta = [&]() {
+            if (gd)
+                return;
+            delta->groups.emplace_back();
+            gd = &delta->groups.back();
+            gd->typeData.reset(new char[data_size(group->type)]);
+            char* buffer = gd->typeData.get();
+            gd->type = clone(group->type, buffer);
+        };
+        blob_stream_t changedStream;
+        std::vector<char> changedStore;
+        changedStream.buffer = &changedStore;
+        changedStream.writing = true;
+        changedStream.cursor = 0;
+        std::vector<dual_entity_t> changed;
+        for (dual_chunk_t* c = group->firstChunk; c; c = c->next)
+        {
+            if (incremental && !chunk_changed(c, since))
+                continue;
+            auto ents = c->get_entities();
+            EIndex runStart = 0;
+            EIndex runCount = 0;
+            auto flush = [&]() {
+                if (runCount == 0)
+                    return;
+                get_delta();
+                blob_stream_t stream{ &gd->store, 0, true };
+                serialize_view({ c, runStart, runCount }, { &stream, &blob_stream_v }, false);
+                gd->created.insert(gd->created.end(), ents + runStart, ents + runStart + runCount);
+                runCount = 0;
+            };
+            forloop (i, 0, c->count)
+            {
+                dual_entity_t e = ents[i];
+                bool created = !alive(*this, e);
+                if (!created)
+                {
+                    auto view = entity_view(e);
+                    created = !equal(view.chunk->group->type, group->type);
+                    if (!created && !equal_row(view, { c, i, 1 }, incremental, since, buffers))
+                    {
+                        serialize_view({ c, i, 1 }, { &changedStream, &blob_stream_v }, false);
+                        changed.push_back(e);
+                    }
+                }
+                if (created)
+                {
+                    if (runCount == 0)
+                        runStart = i;
+                    runCount++;
+                }
+                else
+                    flush();
+            }
+            flush();
+        }
+        if (changed.empty())
+            continue;
+        get_delta();
+        gd->changed = std::move(changed);
+        gd->store.insert(gd->store.end(), changedStore.begin(), changedStore.end());
+    }
+    return delta;
+}
+
+void dual_storage_t::apply(const dual_storage_delta_t& delta)
+{
+    using namespace dual;
+    if (scheduler)
+    {
+        SKR_ASSERT(scheduler->is_main_thread(this));
+        scheduler->sync_storage(this);
+    }
+    for (auto e : delta.destroyed)
+    {
+        if (!exist(e))
+            continue;
+        auto view = entity_view(e);
+        preserve(view.chunk);
+        destruct_view(view);
+        entities.free_entities(view);
+        free(view);
+    }
+    for (auto& gd : delta.groups)
+    {
+        auto group = get_group(gd.type);
+        blob_stream_t stream{ (std::vector<char>*)&gd.store, 0, false };
+        serializer_t s{ &stream, &blob_stream_v };
+        // entities moved from other group, release old slot but keep the id
+        for (auto e : gd.created)
+        {
+            if (!exist(e) || entities.entries[e_id(e)].chunk == nullptr)
+                continue;
+            auto view = entity_view(e);
+            preserve(view.chunk);
+            destruct_view(view);
+            free(view);
+        }
+        entities.claim_entities(gd.created.data(), (EIndex)gd.created.size());
+        EIndex k = 0;
+        while (k < gd.created.size())
+        {
+            EIndex count;
+            s.peek(count);
+            auto view = allocate_view_strict(group, count);
+            serialize_view(view, s, false);
+            entities.fill_entities(view, gd.created.data() + k);
+            k += count;
+        }
+        for (auto e : gd.changed)
+        {
+            auto view = entity_view(e);
+            SKR_ASSERT(view.chunk->group == group);
+            preserve(view.chunk);
+            destruct_view(view);
+            serialize_view(view, s, false);
+        }
+    }
+    deltaTimestamp = delta.timestamp;
+    deltaFreeCursor = delta.freeCursor;
+    deltaSynced = true;
+}
+
+extern "C" {
+dual_storage_delta_t* dualS_diff(dual_storage_t* storage, dual_storage_t* target)
+{
+    return storage->diff(*target);
+}
+
+void dualS_apply_delta(dual_storage_t* storage, const dual_storage_delta_t* delta)
+{
+    storage->apply(*delta);
+}
+
+void dualD_release(dual_storage_delta_t* delta)
+{
+    delete delta;
+}
+
+void dualD_get_destroyed(const dual_storage_delta_t* delta, dual_entity_callback_t callback, void* u)
+{
+    for (auto e : delta->destroyed)
+        callback(u, e);
+}
+
+void dualD_get_groups(const dual_storage_delta_t* delta, dual_group_delta_callback_t callback, void* u)
+{
+    for (auto& gd : delta->groups)
+    {
+        dual_group_delta_t info;
+        info.type = &gd.type;
+        info.created = gd.created.data();
+        info.createdCount = (EIndex)gd.created.size();
+        info.changed = gd.changed.data();
+        info.changedCount = (EIndex)gd.changed.size();
+        callback(u, &info);
+    }
+}
+
+void dualD_serialize(const dual_storage_delta_t* delta, const dual_serializer_v* v, void* t)
+{
+    using namespace dual;
+    serializer_t s{ t, v };
+    s.archive(delta->timestamp);
+    s.archive((uint32_t)delta->destroyed.size());
+    s.archive(delta->destroyed.data(), (uint32_t)delta->destroyed.size());
+    s.archive((uint32_t)delta->groups.size());
+    for (auto& gd : delta->groups)
+    {
+        dual_storage_t::serialize_type(gd.type, s, true);
+        s.archive((uint32_t)gd.created.size());
+        s.archive(gd.created.data(), (uint32_t)gd.created.size());
+        s.archive((uint32_t)gd.changed.size());
+        s.archive(gd.changed.data(), (uint32_t)gd.changed.size());
+        s.archive((uint32_t)gd.store.size());
+        s.archive(gd.store.data(), (uint32_t)gd.store.size());
+    }
+}
+
+dual_storage_delta_t* dualD_deserialize(const dual_serializer_v* v, void* t)
+{
+    using namespace dual;
+    serializer_t s{ t, v };
+    auto delta = new dual_storage_delta_t;
+    s.archive(delta->timestamp);
+    uint32_t size;
+    s.archive(size);
+    delta->destroyed.resize(size);
+    s.archive(delta->destroyed.data(), size);
+    s.archive(size);
+    delta->groups.resize(size);
+    for (auto& gd : delta->groups)
+    {
+        fixed_stack_scope_t _(localStack);
+        auto type = dual_storage_t::deserialize_type(localStack, s, true);
+        gd.typeData.reset(new char[data_size(type)]);
+        char* buffer = gd.typeData.get();
+        gd.type = clone(type, buffer);
+        s.archive(size);
+        gd.created.resize(size);
+        s.archive(gd.created.data(), size);
+        s.archive(size);
+        gd.changed.resize(size);
+        s.archive(gd.changed.data(), size);
+        s.archive(size);
+        gd.store.resize(size);
+        s.archive(gd.store.data(), size);
+    }
+    return delta;
+}
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include "ecs/dual.h"
+#include <memory>
+#include <vector>
+
+// difference between two storages, entities are matched by id and version
+struct dual_storage_delta_t {
+    struct group_delta_t {
+        dual_entity_type_t type;
+        std::unique_ptr<char[]> typeData;
+        // entities created in (or moved into) this group, rows are stored as runs
+        std::vector<dual_entity_t> created;
+        // entities with modified components, rows are stored one by one after created runs
+        std::vector<dual_entity_t> changed;
+        std::vector<char> store;
+    };
+    // version of target storage when the delta is taken
+    uint32_t timestamp;
+    // end of free log of target storage when the delta is taken
+    uint64_t freeCursor;
+    std::vector<dual_entity_t> destroyed;
+    std::vector<group_delta_t> groups;
+};
+
+namespace dual
+{
+// in-memory serializer used to store component rows
+struct blob_stream_t {
+    std::vector<char>* buffer;
+    size_t cursor;
+    bool writing;
+
+    static void stream(void* u, void* data, uint32_t bytes);
+    static void peek(void* u, void* data, uint32_t bytes);
+    static int is_serialize(void* u);
+};
+extern const dual_serializer_v blob_stream_v;
+} // namespace dual
@@ -2,29 +2,96 @@
 #include "chunk_view.hpp"
 #include "chunk.hpp"
 #include "entity.hpp"
+#include "ecs/constants.hpp"
+#include "ftl/coqueue.h"
 #include <cstring>
+#include <algorithm>
 #ifndef forloop
     #define forloop(i, z, n) for (auto i = std::decay_t<decltype(n)>(z); i < (n); ++i)
 #endif
 dual_entity_debug_proxy_t dummy;
 namespace dual
 {
+struct entity_reservation_t {
+    struct segment_t {
+        EIndex count;
+        dual_entity_t ents[kEntitySegmentSize];
+    };
+    moodycamel::ConcurrentQueue<segment_t*> segments;
+    // partially used segment of each reserving thread
+    segment_t* slots[kMaxReserveSlots] = {};
+
+    ~entity_reservation_t() { clear(); }
+    template <class F>
+    void drain(F&& f)
+    {
+        segment_t* segment;
+        while (segments.try_dequeue(segment))
+        {
+            f(segment);
+            delete segment;
+        }
+        for (auto& slot : slots)
+        {
+            if (slot)
+                f(slot);
+            delete slot;
+            slot = nullptr;
+        }
+    }
+    void clear()
+    {
+        drain([](segment_t*) {});
+    }
+};
+
+entity_registry_t::entity_registry_t()
+    : highWater(0)
+    , pendingCount(0)
+    , reservation(new entity_reservation_t)
+    , logFrees(false)
+    , freeLogBase(0)
+{
+}
+
+entity_registry_t::~entity_registry_t()
+{
+    delete reservation;
+}
+
 void entity_registry_t::reset()
 {
     entries.clear();
     freeEntries.clear();
+    reservation->clear();
+    highWater = 0;
+    pendingCount = 0;
+    drop_free_log();
+}
+
+void entity_registry_t::drop_free_log()
+{
+    // skip one more position so cursors at the end of log fall behind too
+    freeLogBase += freeLog.size() + 1;
+    freeLog.clear();
 }
 
 void entity_registry_t::shrink()
 {
+    // reserved ids may lie anywhere above the last valid entry
+    if (pendingCount.load() != 0)
+        return;
+    reclaim_shared();
     if (entries.size() == 0)
         return;
     EIndex lastValid = (EIndex)(entries.size() - 1);
     while (lastValid != 0 && entries[lastValid].chunk == nullptr)
         --lastValid;
-    if (entries[lastValid].indexInChunk == 0)
+    if (entries[lastValid].chunk == nullptr)
     {
         entries.clear();
+        freeEntries.clear();
+        highWater = 0;
         return;
     }
     entries.resize(lastValid + 1);
@@ -33,6 +100,91 @@ void entity_registry_t::shrink()
         return i > lastValid;
     }),
     freeEntries.end());
+    highWater = lastValid + 1;
+}
+
+void entity_registry_t::reserve_entities(dual_entity_t* dst, EIndex count, uint32_t slot)
+{
+    using segment_t = entity_reservation_t::segment_t;
+    pendingCount.fetch_add(count, std::memory_order_relaxed);
+    segment_t** local = slot < kMaxReserveSlots ? &reservation->slots[slot] : nullptr;
+    segment_t* segment = local ? *local : nullptr;
+    EIndex i = 0;
+    while (i < count)
+    {
+        if (!segment || segment->count == 0)
+        {
+            delete segment;
+            segment = nullptr;
+            if (!reservation->segments.try_dequeue(segment))
+                break;
+        }
+        EIndex n = std::min(count - i, segment->count);
+        segment->count -= n;
+        std::memcpy(dst + i, segment->ents + segment->count, n * sizeof(dual_entity_t));
+        i += n;
+    }
+    if (local)
+        *local = segment;
+    else if (segment && segment->count != 0)
+        reservation->segments.enqueue(segment);
+    else
+        delete segment;
+    if (i == count)
+        return;
+    // entries of new ids are created when they are bound, their version is 0
+    EIndex newId = highWater.fetch_add(count - i, std::memory_order_relaxed);
+    SKR_ASSERT((size_t)newId + count - i <= kEntityMaxCount && "entity id overflow, build with DUAL_ENTITY_64");
+    while (i < count)
+        dst[i++] = newId++;
+}
+
+void entity_registry_t::bind_reserved(EIndex count)
+{
+    EIndex size = highWater.load();
+    if (entries.size() < size)
+        entries.resize(size);
+    pendingCount.fetch_sub(count, std::memory_order_relaxed);
+}
+
+void entity_registry_t::release_reserved(const dual_entity_t* ents, EIndex count)
+{
+    bind_reserved(count);
+    freeEntries.reserve(freeEntries.size() + count);
+    // handles of dropped ids may have been seen by user, so they are invalidated like freed ones
+    forloop (i, 0, count)
+    {
+        auto id = (EIndex)e_id(ents[i]);
+        entries[id].version = (uint32_t)e_inc_version(e_version(ents[i]));
+        freeEntries.push_back(id);
+    }
+}
+
+void entity_registry_t::share_free_entities(EIndex count)
+{
+    using segment_t = entity_reservation_t::segment_t;
+    count = std::min(count, (EIndex)freeEntries.size());
+    while (count != 0)
+    {
+        auto segment = new segment_t;
+        segment->count = std::min(count, (EIndex)kEntitySegmentSize);
+        forloop (i, 0, segment->count)
+        {
+            auto id = freeEntries.back();
+            freeEntries.pop_back();
+            segment->ents[i] = e_version(id, entries[id].version);
+        }
+        count -= segment->count;
+        reservation->segments.enqueue(segment);
+    }
+}
+
+void entity_registry_t::reclaim_shared()
+{
+    reservation->drain([&](entity_reservation_t::segment_t* segment) {
+        forloop (i, 0, segment->count)
+            freeEntries.push_back((EIndex)e_id(segment->ents[i]));
+    });
 }
 
 void entity_registry_t::new_entities(dual_entity_t* dst, EIndex count)
@@ -51,9 +203,11 @@ void entity_registry_t::new_entities(dual_entity_t* dst, EIndex count)
     freeEntries.resize(fn - rn);
     if (i == count)
         return;
-    // new entities
-    EIndex newId = static_cast<EIndex>(entries.size());
-    entries.resize(entries.size() + count - i);
+    // new entities, other threads may reserve ids at the same time
+    EIndex newId = highWater.fetch_add(count - i, std::memory_order_relaxed);
+    SKR_ASSERT((size_t)newId + count - i <= kEntityMaxCount && "entity id overflow, build with DUAL_ENTITY_64");
+    if (entries.size() < (size_t)newId + count - i)
+        entries.resize((size_t)newId + count - i);
     while (i < count)
     {
         dst[i] = e_version(newId, entries[newId].version);
@@ -62,6 +216,34 @@ void entity_registry_t::new_entities(dual_entity_t* dst, EIndex count)
     }
 }
 
+void entity_registry_t::claim_entities(const dual_entity_t* src, EIndex count)
+{
+    // make given ids alive with given versions, used when entity ids are dictated by another storage
+    bind_reserved(0);
+    EIndex size = (EIndex)entries.size();
+    EIndex newSize = size;
+    forloop (i, 0, count)
+        newSize = std::max(newSize, (EIndex)e_id(src[i]) + 1);
+    if (newSize > size)
+    {
+        entries.resize(newSize);
+        forloop (i, size, newSize)
+            freeEntries.push_back(i);
+        highWater = newSize;
+    }
+    forloop (i, 0, count)
+        entries[e_id(src[i])].version = e_version(src[i]);
+    if (freeEntries.empty())
+        return;
+    std::vector<bool> claimed(newSize, false);
+    forloop (i, 0, count)
+        claimed[e_id(src[i])] = true;
+    freeEntries.erase(std::remove_if(freeEntries.begin(), freeEntries.end(), [&](EIndex i) {
+        return claimed[i];
+    }),
+    freeEntries.end());
+}
+
 void entity_registry_t::free_entities(const dual_entity_t* dst, EIndex count)
 {
     // build freelist in input order
@@ -71,9 +253,11 @@ void entity_registry_t::free_entities(const dual_entity_t* dst, EIndex count)
     {
         auto id = e_id(dst[i]);
         entry_t& freeData = entries[id];
-        freeData = { nullptr, 0, e_inc_version(freeData.version) };
+        freeData = { nullptr, 0, (uint32_t)e_inc_version(freeData.version) };
         freeEntries.push_back(id);
     }
+    if (logFrees)
+        freeLog.insert(freeLog.end(), dst, dst + count);
 }
 
 void entity_registry_t::fill_entities(const dual_chunk_view_t& view)
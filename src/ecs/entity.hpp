@@ -4,7 +4,8 @@
 namespace dual
 {
 	constexpr static dual_entity_t kEntityNull = std::numeric_limits<dual_entity_t>::max();
-	constexpr static dual_entity_t kEntityTransientVersion = ((1 << (sizeof(dual_entity_t) * 8 - ENTITY_VERSION_OFFSET)) - 1);
+	constexpr static dual_entity_t kEntityTransientVersion = ((dual_entity_t(1) << (sizeof(dual_entity_t) * 8 - ENTITY_VERSION_OFFSET)) - 1);
+	constexpr static size_t kEntityMaxCount = size_t(ENTITY_ID_MASK) + 1;
 
 	DUAL_FORCEINLINE dual_entity_t e_id(dual_entity_t e)
 	{
@@ -16,7 +17,7 @@ namespace dual
 	}
 	DUAL_FORCEINLINE dual_entity_t e_id(dual_entity_t e, dual_entity_t value)
 	{
-		return e_version(e) | e_id(value);
+		return (e & ~dual_entity_t(ENTITY_ID_MASK)) | e_id(value);
 	}
 	DUAL_FORCEINLINE dual_entity_t e_version(dual_entity_t e, dual_entity_t value)
 	{
@@ -2,35 +2,633 @@
 #include "ecs/constants.hpp"
 #include <vector>
 #include <numeric>
+#include <algorithm>
 #include "ecs/dual_config.h"
+#ifndef _WIN32
+    #include <sys/mman.h>
+    #include <unistd.h>
+#endif
 
 namespace dual
 {
-pool_t::pool_t(size_t blockSize, size_t blockCount)
+static size_t page_size()
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+#else
+    return (size_t)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+static char* map_region(size_t size)
+{
+#ifdef _WIN32
+    // large pages require SeLockMemoryPrivilege, regions use normal pages on windows
+    return (char*)VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+    #ifdef MAP_HUGETLB
+    // reserved huge pages are used first, they are not available by default
+    void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (ptr != MAP_FAILED)
+        return (char*)ptr;
+    #endif
+    // align to huge page so transparent huge pages can back the whole region
+    char* raw = (char*)mmap(nullptr, size + kHugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if ((void*)raw == MAP_FAILED)
+        return nullptr;
+    char* base = (char*)(((uintptr_t)raw + kHugePageSize - 1) & ~(uintptr_t)(kHugePageSize - 1));
+    if (base != raw)
+        munmap(raw, base - raw);
+    if (base + size != raw + size + kHugePageSize)
+        munmap(base + size, raw + kHugePageSize - base);
+    #ifdef MADV_HUGEPAGE
+    madvise(base, size, MADV_HUGEPAGE);
+    #endif
+    return base;
+#endif
+}
+
+static void unmap_region(char* base, size_t size)
+{
+#ifdef _WIN32
+    VirtualFree(base, 0, MEM_RELEASE);
+#else
+    munmap(base, size);
+#endif
+}
+
+static void decommit_block(void* block, size_t size)
+{
+    // pages of huge page mappings can not be returned partially, they are kept until region is unmapped
+#ifdef _WIN32
+    VirtualFree(block, size, MEM_DECOMMIT);
+#else
+    static const size_t pageSize = page_size();
+    uintptr_t begin = ((uintptr_t)block + pageSize - 1) & ~(uintptr_t)(pageSize - 1);
+    uintptr_t end = ((uintptr_t)block + size) & ~(uintptr_t)(pageSize - 1);
+    if (begin < end)
+        madvise((void*)begin, end - begin, MADV_DONTNEED);
+#endif
+}
+
+static void commit_block(void* block, size_t size)
+{
+#ifdef _WIN32
+    VirtualAlloc(block, size, MEM_COMMIT, PAGE_READWRITE);
+#else
+    // decommitted pages are zero filled when they are touched
+    (void)block;
+    (void)size;
+#endif
+}
+
+chunk_arena_t::chunk_arena_t(size_t blockSize, size_t regionSize)
+    : blockSize(blockSize)
+    , cursor(nullptr)
+    , cursorEnd(nullptr)
+    , mappedBytes(0)
+{
+    regionSize = std::max(regionSize, blockSize);
+    regionSize = (regionSize + kHugePageSize - 1) / kHugePageSize * kHugePageSize;
+    this->regionSize = regionSize;
+}
+
+chunk_arena_t::~chunk_arena_t()
+{
+    for (auto& region : regions)
+        unmap_region(region.base, region.size);
+}
+
+chunk_arena_t::region_t* chunk_arena_t::find_region(void* block)
+{
+    auto iter = std::upper_bound(regions.begin(), regions.end(), (char*)block, [](char* ptr, const region_t& region) {
+        return ptr < region.base;
+    });
+    SKR_ASSERT(iter != regions.begin());
+    return &*(iter - 1);
+}
+
+void* chunk_arena_t::allocate()
+{
+    void* block = nullptr;
+    bool reused = false;
+    skr_acquire_mutex(&mutex.mMutex);
+    if (!releasedBlocks.empty())
+    {
+        block = releasedBlocks.back();
+        releasedBlocks.pop_back();
+        find_region(block)->released--;
+        reused = true;
+    }
+    else
+    {
+        if (cursor + blockSize > cursorEnd)
+        {
+            if (char* base = map_region(regionSize))
+            {
+                region_t region{ base, regionSize, 0, 0 };
+                regions.insert(std::upper_bound(regions.begin(), regions.end(), base, [](char* ptr, const region_t& region) {
+                    return ptr < region.base;
+                }),
+                region);
+                mappedBytes.fetch_add(regionSize, std::memory_order_relaxed);
+                cursor = base;
+                cursorEnd = base + regionSize / blockSize * blockSize;
+            }
+        }
+        if (cursor + blockSize <= cursorEnd)
+        {
+            block = cursor;
+            cursor += blockSize;
+            find_region(block)->carved++;
+        }
+    }
+    skr_release_mutex(&mutex.mMutex);
+    if (reused)
+        commit_block(block, blockSize);
+    return block;
+}
+
+void chunk_arena_t::release(void* block)
+{
+    decommit_block(block, blockSize);
+    skr_acquire_mutex(&mutex.mMutex);
+    releasedBlocks.push_back(block);
+    find_region(block)->released++;
+    skr_release_mutex(&mutex.mMutex);
+}
+
+void chunk_arena_t::trim()
+{
+    skr_acquire_mutex(&mutex.mMutex);
+    auto isEmpty = [](const region_t& region) { return region.carved == region.released; };
+    // blocks of empty regions are forgotten with their region
+    auto blockEnd = std::remove_if(releasedBlocks.begin(), releasedBlocks.end(), [&](void* block) {
+        return isEmpty(*find_region(block));
+    });
+    releasedBlocks.erase(blockEnd, releasedBlocks.end());
+    for (auto& region : regions)
+    {
+        if (!isEmpty(region))
+            continue;
+        if (cursor >= region.base && cursor <= region.base + region.size)
+            cursor = cursorEnd = nullptr;
+        unmap_region(region.base, region.size);
+        mappedBytes.fetch_sub(region.size, std::memory_order_relaxed);
+    }
+    regions.erase(std::remove_if(regions.begin(), regions.end(), isEmpty), regions.end());
+    skr_release_mutex(&mutex.mMutex);
+}
+
+struct magazine_t {
+    // pool owning the blocks, blocks of a destroyed pool are freed directly
+    uint64_t serial = 0;
+    uint32_t count = 0;
+    uint32_t trim = 0;
+    // blocks are carved from arena, they are gone with the pool
+    bool mapped = false;
+    uint64_t hits = 0;
+    void* blocks[kMagazineCapacity];
+};
+
+static std::atomic<pool_t*> magazinePools[kMaxMagazinePools];
+static std::atomic<uint64_t> poolSerial{ 0 };
+
+static void drop_magazine(magazine_t& magazine)
+{
+    if (!magazine.mapped)
+    {
+        for (uint32_t j = 0; j < magazine.count; ++j)
+            ::dual_free(magazine.blocks[j]);
+    }
+    magazine.count = 0;
+}
+
+struct thread_magazines_t {
+    magazine_t magazines[kMaxMagazinePools];
+    ~thread_magazines_t()
+    {
+        // pools are expected to outlive worker threads, or to be destroyed already
+        for (uint32_t i = 0; i < kMaxMagazinePools; ++i)
+        {
+            auto& magazine = magazines[i];
+            pool_t* pool = magazinePools[i].load(std::memory_order_acquire);
+            if (magazine.count == 0)
+                continue;
+            if (pool && pool->serial == magazine.serial)
+                pool->flush(magazine, magazine.count);
+            else
+                drop_magazine(magazine);
+        }
+    }
+};
+static thread_local thread_magazines_t threadMagazines;
+
+pool_t::pool_t(size_t blockSize, size_t blockCount, size_t arenaRegionSize)
     : blockSize(blockSize)
     , blocks(blockCount)
+    , slot(kMaxMagazinePools)
+    , magazineCapacity((uint32_t)std::clamp<size_t>(kMagazineBytes / blockSize, 2, kMagazineCapacity))
+    , serial(++poolSerial)
+    , hits(0)
+    , misses(0)
+    , refills(0)
+    , returns(0)
+    , reservedBytes(0)
+    , releasedBytes(0)
+    , budget(0)
+    , trimCount(0)
+    , arena(nullptr)
 {
+    if (arenaRegionSize != 0)
+        arena = new chunk_arena_t(blockSize, arenaRegionSize);
+    for (uint32_t i = 0; i < kMaxMagazinePools; ++i)
+    {
+        pool_t* expected = nullptr;
+        if (magazinePools[i].compare_exchange_strong(expected, this))
+        {
+            slot = i;
+            break;
+        }
+    }
 }
 
 pool_t::~pool_t()
 {
+    if (slot < kMaxMagazinePools)
+    {
+        // magazines of other threads are freed when thread exits or slot is reused
+        auto& magazine = threadMagazines.magazines[slot];
+        if (magazine.serial == serial)
+        {
+            drop_magazine(magazine);
+            magazine.serial = 0;
+        }
+        magazinePools[slot].store(nullptr, std::memory_order_release);
+    }
     void* block;
     while (blocks.try_dequeue(block))
-        delete (char*)block;
+    {
+        if (!arena)
+            ::dual_free(block);
+    }
+    delete arena;
+}
+
+void* pool_t::acquire()
+{
+    void* block = arena ? arena->allocate() : ::dual_malloc(blockSize);
+    SKR_ASSERT(block);
+    reservedBytes.fetch_add(blockSize, std::memory_order_relaxed);
+    return block;
+}
+
+void pool_t::release(void* block)
+{
+    if (arena)
+        arena->release(block);
+    else
+        ::dual_free(block);
+    reservedBytes.fetch_sub(blockSize, std::memory_order_relaxed);
+    releasedBytes.fetch_add(blockSize, std::memory_order_relaxed);
+}
+
+magazine_t* pool_t::get_magazine()
+{
+    if (slot >= kMaxMagazinePools)
+        return nullptr;
+    auto& magazine = threadMagazines.magazines[slot];
+    if (magazine.serial != serial)
+    {
+        // left by a destroyed pool of same slot
+        drop_magazine(magazine);
+        magazine.hits = 0;
+        magazine.serial = serial;
+        magazine.mapped = arena != nullptr;
+        magazine.trim = trimCount.load(std::memory_order_relaxed);
+    }
+    else if (magazine.trim != trimCount.load(std::memory_order_relaxed)) DUAL_UNLIKELY
+    {
+        // pool is trimmed by another thread since last access
+        for (uint32_t j = 0; j < magazine.count; ++j)
+            release(magazine.blocks[j]);
+        magazine.count = 0;
+        magazine.trim = trimCount.load(std::memory_order_relaxed);
+    }
+    return &magazine;
+}
+
+void pool_t::refill(magazine_t& magazine)
+{
+    magazine.count = (uint32_t)blocks.try_dequeue_bulk(magazine.blocks, magazineCapacity / 2);
+    refills.fetch_add(1, std::memory_order_relaxed);
+    hits.fetch_add(magazine.hits, std::memory_order_relaxed);
+    magazine.hits = 0;
+}
+
+void pool_t::flush(magazine_t& magazine, uint32_t count)
+{
+    // return blocks from top of magazine, the rest are still hot in cache
+    void** first = magazine.blocks + magazine.count - count;
+    if (over_budget() || !blocks.try_enqueue_bulk(first, count))
+    {
+        for (uint32_t j = 0; j < count; ++j)
+            release(first[j]);
+    }
+    magazine.count -= count;
+    returns.fetch_add(1, std::memory_order_relaxed);
+    hits.fetch_add(magazine.hits, std::memory_order_relaxed);
+    magazine.hits = 0;
 }
 
 void* pool_t::allocate()
 {
-    void* block;
-    if (blocks.try_dequeue(block))
-        return block;
-    return ::dual_malloc(blockSize);
+    if (auto magazine = get_magazine())
+    {
+        if (magazine->count == 0)
+            refill(*magazine);
+        if (magazine->count != 0)
+        {
+            ++magazine->hits;
+            return magazine->blocks[--magazine->count];
+        }
+    }
+    else
+    {
+        void* block;
+        if (blocks.try_dequeue(block))
+        {
+            hits.fetch_add(1, std::memory_order_relaxed);
+            return block;
+        }
+    }
+    misses.fetch_add(1, std::memory_order_relaxed);
+    return acquire();
 }
 
 void pool_t::free(void* block)
 {
+    if (over_budget()) DUAL_UNLIKELY
+    {
+        release(block);
+        return;
+    }
+    if (auto magazine = get_magazine())
+    {
+        if (magazine->count == magazineCapacity)
+            flush(*magazine, magazineCapacity / 2);
+        magazine->blocks[magazine->count++] = block;
+        return;
+    }
     if (blocks.try_enqueue(block))
         return;
+    release(block);
+}
+
+size_t pool_t::trim()
+{
+    size_t before = releasedBytes.load(std::memory_order_relaxed);
+    // magazines of other threads are released when they access the pool next time
+    trimCount.fetch_add(1, std::memory_order_relaxed);
+    get_magazine();
+    void* batch[kMagazineCapacity];
+    while (size_t count = blocks.try_dequeue_bulk(batch, kMagazineCapacity))
+    {
+        for (size_t j = 0; j < count; ++j)
+            release(batch[j]);
+    }
+    if (arena)
+        arena->trim();
+    return releasedBytes.load(std::memory_order_relaxed) - before;
+}
+
+void pool_t::get_stats(dual_pool_stats_t* stats)
+{
+    // hits of current thread are not published yet
+    uint64_t localHits = 0;
+    if (slot < kMaxMagazinePools && threadMagazines.magazines[slot].serial == serial)
+        localHits = threadMagazines.magazines[slot].hits;
+    stats->hits = hits.load(std::memory_order_relaxed) + localHits;
+    stats->misses = misses.load(std::memory_order_relaxed);
+    stats->refills = refills.load(std::memory_order_relaxed);
+    stats->returns = returns.load(std::memory_order_relaxed);
+    stats->globalCount = blocks.size_approx();
+    stats->reservedBytes = reservedBytes.load(std::memory_order_relaxed);
+    stats->cachedBytes = std::min<uint64_t>(stats->globalCount * blockSize, stats->reservedBytes);
+    stats->usedBytes = stats->reservedBytes - stats->cachedBytes;
+    stats->releasedBytes = releasedBytes.load(std::memory_order_relaxed);
+    stats->mappedBytes = arena ? arena->mappedBytes.load(std::memory_order_relaxed) : 0;
+    stats->budget = budget.load(std::memory_order_relaxed);
+}
+
+// blocks of binned pools are allocated one by one, so cached blocks can be freed without their pool
+static void free_list(void* block)
+{
+    while (block)
+    {
+        void* next = *(void**)block;
+        ::dual_free(block);
+        block = next;
+    }
+}
+
+struct bin_cache_t {
+    // pool owning the blocks, cache is dropped when thread switches to another pool
+    uint64_t serial = 0;
+    void* heads[kJobCachedBinCount] = {};
+    uint32_t counts[kJobCachedBinCount] = {};
+    void drop()
+    {
+        for (size_t i = 0; i < kJobCachedBinCount; ++i)
+        {
+            free_list(heads[i]);
+            heads[i] = nullptr;
+            counts[i] = 0;
+        }
+    }
+    ~bin_cache_t()
+    {
+        drop();
+    }
+};
+static thread_local bin_cache_t threadBinCache;
+
+binned_pool_t::binned_pool_t(size_t minSize, size_t binCount, size_t blockCount)
+    : minSize(minSize)
+    , binCount(binCount)
+    , blockCount(blockCount)
+    , serial(++poolSerial)
+{
+    bins = new bin_t[binCount];
+}
+
+binned_pool_t::~binned_pool_t()
+{
+    // caches of other threads are freed when thread exits or switches pool
+    if (threadBinCache.serial == serial)
+    {
+        threadBinCache.drop();
+        threadBinCache.serial = 0;
+    }
+    for (size_t i = 0; i < binCount; ++i)
+        free_list(bins[i].head);
+    delete[] bins;
+}
+
+bin_cache_t& binned_pool_t::get_cache()
+{
+    auto& cache = threadBinCache;
+    if (cache.serial != serial) DUAL_UNLIKELY
+    {
+        cache.drop();
+        cache.serial = serial;
+    }
+    return cache;
+}
+
+uint32_t binned_pool_t::cache_capacity(size_t bin) const
+{
+    return (uint32_t)std::clamp<size_t>(kJobBinCacheBytes / (minSize << bin), 2, kJobBinCacheCapacity);
+}
+
+size_t binned_pool_t::bin_capacity(size_t bin) const
+{
+    return std::clamp<size_t>(kJobBinBytes / (minSize << bin), 1, blockCount);
+}
+
+void binned_pool_t::refill(bin_cache_t& cache, size_t bin)
+{
+    auto& b = bins[bin];
+    uint32_t count = cache_capacity(bin) / 2;
+    skr_acquire_mutex(&b.mutex.mMutex);
+    // detach first blocks of bin as a whole list
+    void* head = b.head;
+    void* tail = nullptr;
+    uint32_t taken = 0;
+    for (void* block = head; block && taken < count; block = *(void**)block)
+    {
+        tail = block;
+        ++taken;
+    }
+    if (tail)
+    {
+        b.head = *(void**)tail;
+        b.count -= taken;
+    }
+    skr_release_mutex(&b.mutex.mMutex);
+    if (!tail)
+        return;
+    *(void**)tail = cache.heads[bin];
+    cache.heads[bin] = head;
+    cache.counts[bin] += taken;
+}
+
+// hand a null terminated list back to bin, blocks beyond capacity of bin are freed
+void binned_pool_t::flush(size_t bin, void* head, uint32_t count)
+{
+    auto& b = bins[bin];
+    void* rest = head;
+    skr_acquire_mutex(&b.mutex.mMutex);
+    size_t capacity = bin_capacity(bin);
+    size_t accepted = b.count < capacity ? std::min<size_t>(count, capacity - b.count) : 0;
+    if (accepted != 0)
+    {
+        void* last = head;
+        for (size_t i = 1; i < accepted; ++i)
+            last = *(void**)last;
+        rest = *(void**)last;
+        *(void**)last = b.head;
+        b.head = head;
+        b.count += accepted;
+    }
+    skr_release_mutex(&b.mutex.mMutex);
+    free_list(rest);
+}
+
+void* binned_pool_t::allocate(size_t size)
+{
+    size += kHeaderSize;
+    size_t bin = 0;
+    while (bin < binCount && (minSize << bin) < size)
+        ++bin;
+    char* block = nullptr;
+    if (bin < binCount)
+    {
+        if (bin < kJobCachedBinCount)
+        {
+            auto& cache = get_cache();
+            if (cache.counts[bin] == 0)
+                refill(cache, bin);
+            if (cache.counts[bin] != 0)
+            {
+                block = (char*)cache.heads[bin];
+                cache.heads[bin] = *(void**)block;
+                --cache.counts[bin];
+            }
+        }
+        else
+        {
+            auto& b = bins[bin];
+            skr_acquire_mutex(&b.mutex.mMutex);
+            if (b.head)
+            {
+                block = (char*)b.head;
+                b.head = *(void**)block;
+                --b.count;
+            }
+            skr_release_mutex(&b.mutex.mMutex);
+        }
+        if (!block)
+            block = (char*)::dual_malloc(minSize << bin);
+    }
+    else
+        block = (char*)::dual_malloc(size);
+    *(size_t*)block = bin;
+    return block + kHeaderSize;
+}
+
+void binned_pool_t::free(void* ptr)
+{
+    if (!ptr)
+        return;
+    char* block = (char*)ptr - kHeaderSize;
+    size_t bin = *(size_t*)block;
+    if (bin < kJobCachedBinCount && bin < binCount)
+    {
+        auto& cache = get_cache();
+        *(void**)block = cache.heads[bin];
+        cache.heads[bin] = block;
+        if (++cache.counts[bin] > cache_capacity(bin)) DUAL_UNLIKELY
+        {
+            // newest half is still hot in cache, the rest is returned to bin
+            uint32_t keep = cache.counts[bin] / 2;
+            void* last = cache.heads[bin];
+            for (uint32_t i = 1; i < keep; ++i)
+                last = *(void**)last;
+            void* cold = *(void**)last;
+            *(void**)last = nullptr;
+            flush(bin, cold, cache.counts[bin] - keep);
+            cache.counts[bin] = keep;
+        }
+        return;
+    }
+    if (bin < binCount)
+    {
+        auto& b = bins[bin];
+        skr_acquire_mutex(&b.mutex.mMutex);
+        bool cached = b.count < bin_capacity(bin);
+        if (cached)
+        {
+            *(void**)block = b.head;
+            b.head = block;
+            ++b.count;
+        }
+        skr_release_mutex(&b.mutex.mMutex);
+        if (cached)
+            return;
+    }
     ::dual_free(block);
 }
 
@@ -1,20 +1,108 @@
 #pragma once
 
 #include "ftl/coqueue.h"
+#include "platform/thread.h"
+#include "ecs/dual.h"
+#include <atomic>
+#include <vector>
 namespace dual
 {
+struct magazine_t;
+struct bin_cache_t;
+// carves blocks of one size from regions of virtual memory, regions prefer huge pages
+// released blocks keep their address, physical pages are returned to os and regions are unmapped when fully released
+struct chunk_arena_t {
+    struct region_t {
+        char* base;
+        size_t size;
+        size_t carved;
+        size_t released;
+    };
+    size_t blockSize;
+    size_t regionSize;
+    SMutexObject mutex;
+    // sorted by base
+    std::vector<region_t> regions;
+    std::vector<void*> releasedBlocks;
+    char* cursor;
+    char* cursorEnd;
+    std::atomic<size_t> mappedBytes;
+    chunk_arena_t(size_t blockSize, size_t regionSize);
+    ~chunk_arena_t();
+    void* allocate();
+    void release(void* block);
+    void trim();
+    region_t* find_region(void* block);
+};
+// blocks are cached by thread local magazines first, magazines exchange half of their blocks with global queue
 struct pool_t {
     size_t blockSize;
     moodycamel::ConcurrentQueue<void*> blocks;
-    pool_t(size_t blockSize, size_t blockCount);
+    // identify magazines of this pool, slot is kMaxMagazinePools if there is no free slot
+    uint32_t slot;
+    uint32_t magazineCapacity;
+    uint64_t serial;
+    // hits of magazines are published in batches
+    std::atomic<uint64_t> hits;
+    std::atomic<uint64_t> misses;
+    std::atomic<uint64_t> refills;
+    std::atomic<uint64_t> returns;
+    // bytes of blocks owned by pool, freed blocks are returned to os while it exceeds budget
+    std::atomic<size_t> reservedBytes;
+    std::atomic<size_t> releasedBytes;
+    std::atomic<size_t> budget;
+    // magazines release their blocks when they see a new trim count
+    std::atomic<uint32_t> trimCount;
+    chunk_arena_t* arena;
+    pool_t(size_t blockSize, size_t blockCount, size_t arenaRegionSize = 0);
     ~pool_t();
     void* allocate();
     void free(void* block);
+    size_t trim();
+    void get_stats(dual_pool_stats_t* stats);
+    magazine_t* get_magazine();
+    void refill(magazine_t& magazine);
+    void flush(magazine_t& magazine, uint32_t count);
+    void* acquire();
+    void release(void* block);
+    bool over_budget() const
+    {
+        size_t limit = budget.load(std::memory_order_relaxed);
+        return limit != 0 && reservedBytes.load(std::memory_order_relaxed) > limit;
+    }
+};
+
+// pools of power of two sized blocks, bin of block is recorded in front of it
+// freed blocks are linked intrusively, cheaper than pool_t for blocks living shorter than a frame
+// blocks are cached by thread local lists first, lists exchange half of their blocks with locked bins
+struct binned_pool_t {
+    static constexpr size_t kHeaderSize = 16;
+    struct bin_t {
+        SMutexObject mutex;
+        void* head = nullptr;
+        size_t count = 0;
+    };
+    size_t minSize;
+    size_t binCount;
+    size_t blockCount;
+    // identify thread caches of this pool
+    uint64_t serial;
+    bin_t* bins;
+    binned_pool_t(size_t minSize, size_t binCount, size_t blockCount);
+    ~binned_pool_t();
+    void* allocate(size_t size);
+    void free(void* block);
+    bin_cache_t& get_cache();
+    uint32_t cache_capacity(size_t bin) const;
+    size_t bin_capacity(size_t bin) const;
+    void refill(bin_cache_t& cache, size_t bin);
+    void flush(size_t bin, void* head, uint32_t count);
 };
 
 pool_t& get_default_pool();
 pool_t& get_default_pool_small();
 pool_t& get_default_pool_large();
+binned_pool_t& get_job_pool();
 
 struct fixed_pool_t {
     char* buffer;
@@ -27,14 +27,17 @@ namespace eastl
 {
 inline void split(const string_view& s, vector<string_view>& tokens, const string_view& delimiters = " ")
 {
-    string::size_type lastPos = s.find_first_not_of(delimiters, 0);
-    string::size_type pos = s.find_first_of(delimiters, lastPos);
-    while (string::npos != pos || string::npos != lastPos)
+    // pass delimiter length explicitly, find_first_of(string_view) reads past the delimiters
+    string::size_type lastPos = s.find_first_not_of(delimiters.data(), 0, delimiters.size());
+    string::size_type pos = s.find_first_of(delimiters.data(), lastPos, delimiters.size());
+    while (string::npos != lastPos)
     {
         auto substr = s.substr(lastPos, pos - lastPos);
         tokens.push_back(substr); // use emplace_back after C++11
-        lastPos = s.find_first_not_of(delimiters, pos);
-        pos = s.find_first_of(delimiters, lastPos);
+        if (string::npos == pos)
+            break;
+        lastPos = s.find_first_not_of(delimiters.data(), pos, delimiters.size());
+        pos = s.find_first_of(delimiters.data(), lastPos, delimiters.size());
     }
 }
 
@@ -87,7 +90,7 @@ bool match_chunk_changed(const dual_type_set_t& type, uint32_t* timestamp, const
             j++;
         else if (changed.data[i] < type.data[j])
             i++;
-        else if (timestamp[j] - filter.timestamp > 0)
+        else if ((int32_t)(timestamp[j] - (uint32_t)filter.timestamp) > 0) // written after filter timestamp, safe for wrapped timestamps
             return true;
         else
             (j++, i++);
@@ -145,6 +148,7 @@ const dual::query_cache_t& dual_storage_t::get_query_cache(const dual_filter_t&
 void dual_storage_t::update_query_cache(dual_group_t* group, bool isAdd)
 {
     using namespace dual;
+    ++structureVersion;
     auto match_cache = [&](query_cache_t& cache) {
         if (cache.includeDead < group->isDead)
             return false;
@@ -186,6 +190,8 @@ dual_query_t* dual_storage_t::make_query(const dual_filter_t& filter, const dual
     result->buildedFilter = filter;
     result->built = false;
     result->storage = this;
+    std::memset(&result->meta, 0, sizeof(dual_meta_filter_t));
+    std::memset(&result->stats, 0, sizeof(dual_job_stats_t));
     queries.push_back(result);
     return result;
 }
@@ -269,7 +275,7 @@ dual_query_t* dual_storage_t::make_query(const char* inDesc)
             }
             i++;
         }
-        if (part[i] == '[') // attr: [rand] [seq]
+        if (part[i] == '[') // attr: [rand] [group] [seq]
         {
             auto j = i + 1;
             errorPos = partBegin + i;
@@ -280,10 +286,12 @@ dual_query_t* dual_storage_t::make_query(const char* inDesc)
                 error = fmt::format("unexpected [ without ], loc {}.", errorPos);
                 return nullptr;
             }
-            auto attr = part.substr(j, j - i);
+            auto attr = part.substr(j, i - j);
             errorPos = partBegin + j;
             if (attr.compare("rand") == 0)
                 operation.randomAccess = DOS_GLOBAL;
+            else if (attr.compare("group") == 0)
+                operation.randomAccess = DOS_GROUP;
             else if (attr.compare("seq") == 0)
                 operation.randomAccess = DOS_SEQ;
             else
@@ -339,9 +347,9 @@ dual_query_t* dual_storage_t::make_query(const char* inDesc)
         else
         {
             auto j = i;
-            while (i < part.size() && std::isalpha(part[i]))
+            while (i < part.size() && (std::isalnum(part[i]) || part[i] == '_'))
                 ++i;
-            auto name = part.substr(j, j - i);
+            auto name = part.substr(j, i - j);
             type = reg.get_type(name);
             if (type == kInvalidTypeIndex)
             {
@@ -360,13 +368,16 @@ dual_query_t* dual_storage_t::make_query(const char* inDesc)
                 error = fmt::format("unexpected character, ',' expected, loc {}.", errorPos);
                 return nullptr;
             }
-            if (operation.phase == 0)
+            if (i != j)
             {
-                errorPos = partBegin + j;
-                error = fmt::format("unexpected phase modifier.([out] is always phase 0), loc {}.", errorPos);
-                return nullptr;
+                if (operation.phase == 0)
+                {
+                    errorPos = partBegin + j;
+                    error = fmt::format("unexpected phase modifier.([out] is always phase 0), loc {}.", errorPos);
+                    return nullptr;
+                }
+                operation.phase = i - j;
             }
-            operation.phase = j - i;
         }
         if (shared)
         {
@@ -435,6 +446,7 @@ dual_query_t* dual_storage_t::make_query(const char* inDesc)
     result->storage = this;
     result->built = false;
     std::memset(&result->meta, 0, sizeof(dual_meta_filter_t));
+    std::memset(&result->stats, 0, sizeof(dual_job_stats_t));
     queries.push_back(result);
     return result;
 }
@@ -568,45 +580,60 @@ void dual_storage_t::query_groups(const dual_filter_t& filter, const dual_meta_f
 
 namespace dual
 {
-DUAL_FORCEINLINE int CountLeadingZeros64(uint64_t n)
+DUAL_FORCEINLINE int CountTrailingZeros64(uint64_t n)
 {
+    // n is never zero here
 #if defined(_MSC_VER) && defined(_M_X64)
-    // MSVC does not have __buitin_clzll. Use _BitScanReverse64.
     unsigned long result = 0; // NOLINT(runtime/int)
-    if (_BitScanReverse64(&result, n))
-    {
-        return (int)(63 - result);
-    }
-    return 64;
+    _BitScanForward64(&result, n);
+    return (int)result;
 #elif defined(_MSC_VER) && !defined(__clang__)
-    // MSVC does not have __buitin_clzll. Compose two calls to _BitScanReverse
     unsigned long result = 0; // NOLINT(runtime/int)
-    if ((n >> 32) && _BitScanReverse(&result, (unsigned long)(n >> 32)))
-    {
-        return 31 - result;
-    }
-    if (_BitScanReverse(&result, (unsigned long)n))
-    {
-        return 63 - result;
-    }
-    return 64;
+    if (_BitScanForward(&result, (unsigned long)n))
+        return (int)result;
+    _BitScanForward(&result, (unsigned long)(n >> 32));
+    return (int)result + 32;
 #elif defined(__GNUC__) || defined(__clang__)
-    // Use __builtin_clzll, which uses the following instructions:
-    //  x86: bsr
-    //  ARM64: clz
-    //  PPC: cntlzd
     static_assert(sizeof(unsigned long long) == sizeof(n), // NOLINT(runtime/int)
-    "__builtin_clzll does not take 64-bit arg");
+    "__builtin_ctzll does not take 64-bit arg");
+    return __builtin_ctzll(n);
+#else
+    int result = 0;
+    while ((n & 1) == 0)
+        (n >>= 1, ++result);
+    return result;
+#endif
+}
 
-    // Handle 0 as a special case because __builtin_clzll(0) is undefined.
-    if (n == 0)
+// bit j of result is set if masks[j] passes the filter, count is at most 64
+static uint64_t match_masks(const dual_mask_component_t* masks, EIndex count, dual_mask_component_t allmask, dual_mask_component_t nonemask, dual_mask_component_t anymask)
+{
+    uint64_t bits = 0;
+    EIndex j = 0;
+#if __SSE2__
+    const __m128i all = _mm_set1_epi32((int)allmask);
+    const __m128i none = _mm_set1_epi32((int)nonemask);
+    const __m128i any = _mm_set1_epi32((int)anymask);
+    const __m128i zero = _mm_setzero_si128();
+    // any test passes when there is no any mask
+    const __m128i anyEmpty = anymask == 0 ? _mm_set1_epi32(-1) : zero;
+    // mask column is aligned to __m128i by registry and count starts at multiple of 64
+    for (; j + 4 <= count; j += 4)
     {
-        return 64;
+        __m128i m = _mm_load_si128((const __m128i*)(masks + j));
+        __m128i ok = _mm_cmpeq_epi32(_mm_and_si128(m, all), all);
+        ok = _mm_and_si128(ok, _mm_cmpeq_epi32(_mm_and_si128(m, none), zero));
+        ok = _mm_and_si128(ok, _mm_or_si128(anyEmpty, _mm_andnot_si128(_mm_cmpeq_epi32(_mm_and_si128(m, any), zero), _mm_set1_epi32(-1))));
+        bits |= (uint64_t)_mm_movemask_ps(_mm_castsi128_ps(ok)) << j;
     }
-    return __builtin_clzll(n);
-#else
-    return CountLeadingZeros64Slow(n);
 #endif
+    for (; j < count; ++j)
+    {
+        auto mask = masks[j];
+        bool ok = (mask & allmask) == allmask && (mask & nonemask) == 0 && (anymask == 0 || (mask & anymask) != 0);
+        bits |= (uint64_t)ok << j;
+    }
+    return bits;
 }
 } // namespace dual
 
@@ -628,120 +655,44 @@ void dual_storage_t::query(const dual_group_t* group, const dual_filter_t& filte
     }
     else
     {
-        dual_chunk_t* c = group->firstChunk;
-
         auto allmask = group->get_mask(filter.all);
         auto nonemask = group->get_mask(filter.none);
         auto anymask = group->get_mask(filter.any);
-        // todo:benchmark this
-#if __SSE2__
-        if (nonemask == 0 && anymask == 0) // fastpath
+        for (dual_chunk_t* c = group->firstChunk; c != nullptr; c = c->next)
         {
-            __m128i allmask_128 = _mm_set1_epi32(allmask);
-            while (c != nullptr)
+            if (!match_chunk_changed(c->type->type, c->timestamps(), meta))
+                continue;
+            auto count = c->count;
+            dual_chunk_view_t view = { c, 0, count };
+            auto masks = (const dual_mask_component_t*)dualV_get_owned_ro(&view, kMaskComponent);
+            // matches of 64 entities are packed into a word, runs are found by scanning set and cleared bits
+            bool inRun = false;
+            for (EIndex base = 0; base < count; base += 64)
             {
-                if (match_chunk_changed(c->type->type, c->timestamps(), meta))
-                {
-                    c = c->next;
-                    continue;
-                    ;
-                }
-                auto count = c->count;
-                dual_chunk_view_t view = { c, 0, c->count };
-                // todo: ensure mask component aligned
-                auto masks = (dual_mask_component_t*)dualV_get_owned_ro(&view, kMaskComponent);
-                EIndex i = 0;
-                while (i < count)
+                EIndex n = std::min<EIndex>(64, count - base);
+                uint64_t bits = match_masks(masks + base, n, allmask, nonemask, anymask);
+                EIndex offset = 0;
+                while (offset < n)
                 {
-                    while (i < count && !((masks[i] & allmask) == allmask) && i % 4 != 0)
-                        ++i;
-                    if (i % 4 == 0)
-                    {
-                        while (i < count - 4)
-                        {
-                            __m128i m = _mm_load_si128((__m128i*)(masks + i));
-                            m = _mm_and_si128(allmask_128, m);
-                            uint16_t cmp = _mm_movemask_epi8(_mm_cmpeq_epi32(m, allmask_128));
-                            if (cmp == 0)
-                            {
-                                i += 4;
-                                continue;
-                            }
-                            else
-                            {
-                                unsigned long index = dual::CountLeadingZeros64(cmp);
-                                i += index / 4;
-                                break;
-                            }
-                        }
-                        if (i >= count - 4)
-                            while (i < count && !((masks[i] & allmask) == allmask))
-                                ++i;
-                    }
-                    view.start = i;
-
-                    while (i < count && (masks[i] & allmask) == allmask && i % 4 != 0)
-                        ++i;
-                    if (i % 4 == 0)
+                    // bits past n are cleared in bits and set in ~bits, so runs stop at the end of chunk
+                    uint64_t rest = (inRun ? ~bits : bits) >> offset;
+                    if (rest == 0)
+                        break;
+                    offset += (EIndex)CountTrailingZeros64(rest);
+                    if (!inRun)
+                        view.start = base + offset;
+                    else
                     {
-                        while (i < count - 4)
-                        {
-                            __m128i m = _mm_load_si128((__m128i*)(masks + i));
-                            m = _mm_and_si128(allmask_128, m);
-                            uint16_t cmp = _mm_movemask_epi8(_mm_cmpeq_epi32(m, allmask_128));
-                            if (cmp == 0xFFFF)
-                            {
-                                i += 4;
-                                continue;
-                            }
-                            else
-                            {
-                                unsigned long index = dual::CountLeadingZeros64((~cmp) & 0xFFFF);
-                                i += index / 4;
-                                break;
-                            }
-                        }
-                        if (i >= count - 4)
-                            while (i < count && ((masks[i] & allmask) == allmask))
-                                ++i;
-                    }
-                    view.count = i - view.start;
-                    if (view.count > 0)
+                        view.count = base + offset - view.start;
                         callback(u, &view);
+                    }
+                    inRun = !inRun;
                 }
-                c = c->next;
             }
-        }
-        else
-#endif
-        { // todo: should we simd this snipest too
-            auto match = [&](dual_mask_component_t mask) {
-                return (mask & allmask) == allmask && (mask & nonemask) == 0 && (anymask == 0 || (mask & anymask) != 0);
-            };
-            while (c != nullptr)
+            if (inRun)
             {
-                if (match_chunk_changed(c->type->type, c->timestamps(), meta))
-                {
-                    c = c->next;
-                    continue;
-                    ;
-                }
-                auto count = c->count;
-                dual_chunk_view_t view = { c, 0, c->count };
-                auto masks = (dual_mask_component_t*)dualV_get_owned_ro(&view, kMaskComponent);
-                EIndex i = 0;
-                while (i < count)
-                {
-                    while (i < count && !match(masks[i]))
-                        ++i;
-                    view.start = i;
-                    while (i < count && match(masks[i]))
-                        ++i;
-                    view.count = i - view.start;
-                    if (view.count > 0)
-                        callback(u, &view);
-                }
-                c = c->next;
+                view.count = count - view.start;
+                callback(u, &view);
             }
         }
     }
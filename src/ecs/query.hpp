@@ -17,6 +17,8 @@ struct query_cache_t {
 };
 
 std::string& get_error();
+bool match_group_type(const dual_entity_type_t& type, const dual_filter_t& filter, bool skipNone);
+bool match_group_meta(const dual_entity_type_t& type, const dual_meta_filter_t& filter);
 } // namespace dual
 
 struct dual_query_t {
@@ -26,4 +28,6 @@ struct dual_query_t {
     bool built = false;
     dual_filter_t buildedFilter;
     dual_parameters_t parameters;
+    // written by finished ecs jobs, guarded by scheduler
+    dual_job_stats_t stats;
 };
\ No newline at end of file
@@ -15,27 +15,50 @@
 #include "ecs/callback.hpp"
 #include "type.hpp"
 #include "set.hpp"
+#include <chrono>
+
+namespace dual
+{
+uint64_t clock_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+} // namespace dual
 
 dual::scheduler_t::scheduler_t()
+    : scheduler(nullptr)
+    , epoch(0)
+    , targetTaskTime(100000)
 {
 }
 
 void dual::scheduler_t::initialize(ftl::TaskScheduler* inScheduler)
 {
     scheduler = inScheduler;
-    allCounter = eastl::make_shared<ftl::TaskCounter>(scheduler);
+    // null detaches job system, no job should be running then
+    if (scheduler)
+        allCounter = eastl::make_shared<ftl::TaskCounter>(scheduler);
+    else
+        allCounter.reset();
 }
 
 dual_entity_t dual::scheduler_t::add_resource()
 {
     dual_entity_t result;
+    skr_acquire_mutex(&resourceMutex.mMutex);
     registry.new_entities(&result, 1);
+    if (allResources.size() <= e_id(result))
+        allResources.resize(e_id(result) + 1);
+    skr_release_mutex(&resourceMutex.mMutex);
     return result;
 }
 
 void dual::scheduler_t::remove_resource(dual_entity_t id)
 {
+    skr_acquire_mutex(&resourceMutex.mMutex);
+    allResources[e_id(id)].clear();
     registry.free_entities(&id, 1);
+    skr_release_mutex(&resourceMutex.mMutex);
 }
 
 bool dual::scheduler_t::is_main_thread(const dual_storage_t* storage)
@@ -55,62 +78,63 @@ void dual::scheduler_t::set_main_thread(const dual_storage_t* storage)
 void dual::scheduler_t::sync_archetype(dual::archetype_t* type)
 {
     SKR_ASSERT(is_main_thread(type->storage));
-    // TODO: performance optimization
-    eastl::vector<eastl::shared_ptr<ftl::TaskCounter>> deps;
-    skr_acquire_mutex(&entryMutex.mMutex);
-    auto pair = dependencyEntries.find(type);
-    if (pair == dependencyEntries.end())
+    auto entries = type->dependencyEntries;
+    if (!entries)
         return;
-    auto entries = pair->second.data();
     auto count = type->type.length;
     forloop (i, 0, count)
     {
         if (type_index_t(type->type.data[i]).is_tag())
             break;
         for (auto dep : entries[i].owned)
-            deps.push_back(dep);
-        for (auto p : entries[i].shared)
-            deps.push_back(p);
-        entries[i].shared.clear();
-        entries[i].owned.clear();
+            scheduler->WaitForCounter(dep->counter.get(), true);
+        for (auto dep : entries[i].shared)
+            scheduler->WaitForCounter(dep->counter.get(), true);
+        entries[i].clear();
     }
-    dependencyEntries.erase(pair);
-    skr_release_mutex(&entryMutex.mMutex);
-    for (auto dep : deps)
-        scheduler->WaitForCounter(dep.get());
 }
 
 void dual::scheduler_t::sync_entry(dual::archetype_t* type, dual_type_index_t i)
 {
     SKR_ASSERT(is_main_thread(type->storage));
-    // TODO: performance optimization
-    eastl::vector<eastl::shared_ptr<ftl::TaskCounter>> deps;
-    skr_acquire_mutex(&entryMutex.mMutex);
-    auto pair = dependencyEntries.find(type);
-    if (pair == dependencyEntries.end()) return;
-    auto entries = pair->second.data();
+    auto entries = type->dependencyEntries;
+    if (!entries)
+        return;
     for (auto dep : entries[i].owned)
-        deps.push_back(dep);
-    for (auto p : entries[i].shared)
-        deps.push_back(p);
-    entries[i].shared.clear();
-    entries[i].owned.clear();
-    skr_release_mutex(&entryMutex.mMutex);
-    for (auto dep : deps)
-        scheduler->WaitForCounter(dep.get());
+        scheduler->WaitForCounter(dep->counter.get(), true);
+    for (auto dep : entries[i].shared)
+        scheduler->WaitForCounter(dep->counter.get(), true);
+    entries[i].clear();
+}
+
+bool dual::scheduler_t::is_archetype_busy(dual::archetype_t* type)
+{
+    SKR_ASSERT(is_main_thread(type->storage));
+    auto entries = type->dependencyEntries;
+    if (!entries)
+        return false;
+    bool busy = false;
+    forloop (i, 0, type->type.length)
+    {
+        remove_done(entries[i].owned);
+        remove_done(entries[i].shared);
+        busy |= !entries[i].owned.empty() || !entries[i].shared.empty();
+    }
+    return busy;
 }
 
 void dual::scheduler_t::sync_all()
 {
     SKR_ASSERT(scheduler->GetCurrentThreadIndex() == 0);
-    scheduler->WaitForCounter(allCounter.get());
+    // waits of main thread are pinned, otherwise main fiber could be resumed on worker thread
+    scheduler->WaitForCounter(allCounter.get(), true);
 }
 
 void dual::scheduler_t::sync_storage(const dual_storage_t* storage)
 {
     if (!storage->counter)
         return;
-    scheduler->WaitForCounter(storage->counter.get());
+    scheduler->WaitForCounter(storage->counter.get(), true);
     storage->counter.reset();
     storage->scheduler = nullptr;
     storage->mainFiber = nullptr;
@@ -118,42 +142,351 @@ void dual::scheduler_t::sync_storage(const dual_storage_t* storage)
 
 namespace dual
 {
-struct hash_shared_ptr {
-    template <class T>
-    size_t operator()(const eastl::shared_ptr<T>& value) const
+job_dependency_entry_t::~job_dependency_entry_t()
+{
+    clear();
+}
+
+void job_dependency_entry_t::clear()
+{
+    for (auto dep : owned)
+        dep->release();
+    for (auto dep : shared)
+        dep->release();
+    owned.clear();
+    shared.clear();
+}
+
+job_dependency_entry_t* get_dependency_entries(archetype_t* type)
+{
+    if (!type->dependencyEntries)
     {
-        return std::hash<void*>{}(value.get());
+        auto entries = (job_dependency_entry_t*)dual_malloc(sizeof(job_dependency_entry_t) * type->type.length);
+        forloop (i, 0, type->type.length)
+            new (&entries[i]) job_dependency_entry_t();
+        type->dependencyEntries = entries;
     }
-};
-using DependencySet = skr::flat_hash_set<eastl::shared_ptr<ftl::TaskCounter>, hash_shared_ptr>;
-void update_entry(job_dependency_entry_t& entry, eastl::shared_ptr<ftl::TaskCounter> job, bool readonly, bool atomic, DependencySet& dependencies)
+    return type->dependencyEntries;
+}
+
+void release_dependency_entries(archetype_t* type)
+{
+    auto entries = type->dependencyEntries;
+    if (!entries)
+        return;
+    forloop (i, 0, type->type.length)
+        entries[i].~job_dependency_entry_t();
+    dual_free(entries);
+    type->dependencyEntries = nullptr;
+}
+
+void remove_done(job_list_t& list)
 {
+    auto end = std::remove_if(list.begin(), list.end(), [](dual_job_t* dep) {
+        if (!dep->done())
+            return false;
+        dep->release();
+        return true;
+    });
+    list.erase(end, list.end());
+}
+
+void update_entry(job_dependency_entry_t& entry, dual_job_t* job, bool readonly, bool atomic)
+{
+    auto& dependencies = job->dependencies;
+    auto depend = [&](dual_job_t* dep) {
+        if (dep == job || dep->done())
+            return;
+        if (std::find(dependencies.begin(), dependencies.end(), dep) != dependencies.end())
+            return;
+        dep->retain();
+        dependencies.push_back(dep);
+    };
     if (readonly)
     {
-        for (auto& dp : entry.owned)
-            dependencies.insert(dp);
+        for (auto dep : entry.owned)
+            depend(dep);
+        // readers are never cleared unless written, drop finished ones
+        remove_done(entry.shared);
+        job->retain();
         entry.shared.push_back(job);
     }
     else
     {
-        for (auto& dp : entry.shared)
-            dependencies.insert(dp);
+        for (auto dep : entry.shared)
+            depend(dep);
         if (atomic)
         {
-            entry.owned.push_back(job);
+            remove_done(entry.owned);
         }
         else
         {
-            for (auto& dp : entry.owned)
-                dependencies.insert(dp);
-            entry.shared.clear();
-            entry.owned.clear();
-            entry.owned.push_back(job);
+            for (auto dep : entry.owned)
+                depend(dep);
+            entry.clear();
+        }
+        job->retain();
+        entry.owned.push_back(job);
+    }
+}
+
+void build_layout(ecs_job_layout_t& layout, const dual_query_t* query)
+{
+    auto& params = query->parameters;
+    layout.hasRandomWrite = false;
+    layout.hasGroupWrite = false;
+    forloop (i, 0, params.length)
+    {
+        auto& op = params.accesses[i];
+        // random read and atomic random write are safe to be parallel
+        if (op.readonly || op.atomic)
+            continue;
+        layout.hasRandomWrite |= op.randomAccess == DOS_GLOBAL;
+        layout.hasGroupWrite |= op.randomAccess == DOS_GROUP;
+    }
+    forloop (groupIndex, 0, layout.groupCount)
+    {
+        auto group = layout.groups[groupIndex];
+        new (&layout.readonly[groupIndex]) std::bitset<32>();
+        new (&layout.atomic[groupIndex]) std::bitset<32>();
+        new (&layout.randomAccess[groupIndex]) std::bitset<32>();
+        forloop (i, 0, params.length)
+        {
+            auto idx = group->index(params.types[i]);
+            layout.localTypes[groupIndex * params.length + i] = idx;
+            auto& op = params.accesses[i];
+            if (idx == kInvalidSIndex)
+                continue;
+            layout.readonly[groupIndex].set(idx, op.readonly);
+            layout.randomAccess[groupIndex].set(idx, op.randomAccess == DOS_GLOBAL);
+            layout.atomic[groupIndex].set(idx, op.atomic);
+        }
+    }
+}
+
+void for_each_access(const ecs_job_layout_t& layout, const dual_query_t* query, dual_access_callback_t callback, void* u)
+{
+    auto& params = query->parameters;
+    forloop (i, 0, params.length)
+    {
+        if (type_index_t(params.types[i]).is_tag())
+            continue;
+        auto readonly = params.accesses[i].readonly;
+        auto atomic = params.accesses[i].atomic;
+        if (params.accesses[i].randomAccess == DOS_GLOBAL)
+        {
+            // random access may touch any entity
+            for (auto& pair : query->storage->groups)
+            {
+                auto group = pair.second;
+                auto idx = group->index(params.types[i]);
+                if (idx != kInvalidSIndex)
+                    callback(u, group, idx, readonly, atomic);
+            }
+            continue;
+        }
+        forloop (groupIndex, 0, layout.groupCount)
+        {
+            auto group = layout.groups[groupIndex];
+            auto localType = layout.localTypes[groupIndex * params.length + i];
+            if (localType == kInvalidSIndex)
+            {
+                // shared component, owned by meta entity
+                auto g = group->get_owner(params.types[i]);
+                if (g)
+                    callback(u, g, g->index(params.types[i]), readonly, atomic);
+            }
+            else
+                callback(u, group, localType, readonly, atomic);
         }
     }
 }
+
+void release_for_job(dual_for_job_t* job)
+{
+    job->task_done();
+    job->scheduler->allCounter->Decrement();
+    job->release();
+}
+
+static void ecs_job_teardown(void* data)
+{
+    dual_ecs_job_t* job = (dual_ecs_job_t*)data;
+    auto storageCounter = job->query->storage->counter;
+    job->task_done();
+    job->scheduler->allCounter->Decrement();
+    storageCounter->Decrement();
+    job->release();
+}
+
+static void ecs_job_body(ftl::TaskScheduler*, void* data)
+{
+    auto job = (dual_ecs_job_t*)data;
+    job->startTime = clock_ns();
+    if (job->batchSize == 0)
+        job->batchSize = job->scheduler->adaptive_batch_size(job->query, job->entityCount);
+    if (job->init)
+        job->init(job->userdata, job->entityCount);
+    auto query = job->query;
+    fixed_stack_scope_t _(localStack);
+    dual_meta_filter_t validatedMeta;
+    {
+        auto& meta = query->meta;
+        auto data = (char*)localStack.allocate(data_size(meta));
+        validatedMeta = clone(meta, data);
+        query->storage->validate(validatedMeta.all_meta);
+        query->storage->validate(validatedMeta.any_meta);
+        query->storage->validate(validatedMeta.none_meta);
+    }
+    if (job->hasRandomWrite)
+    {
+        auto start = clock_ns();
+        uint32_t startIndex = 0;
+        auto processView = [&](dual_chunk_view_t* view) {
+            job->callback(job->userdata, job->query->storage, view, job->localTypes, startIndex);
+            startIndex += view->count;
+        };
+        forloop (i, 0, job->groupCount)
+        {
+            auto group = job->groups[i];
+            query->storage->query(group, query->filter, validatedMeta, DUAL_LAMBDA(processView));
+        }
+        job->batchCount = 1;
+        job->runTime.fetch_add(clock_ns() - start, std::memory_order_relaxed);
+    }
+    else
+    {
+        struct task_t {
+            uint32_t groupIndex;
+            uint32_t startIndex;
+            dual_chunk_view_t view;
+        };
+        struct batch_t {
+            intptr_t startTask;
+            intptr_t endTask;
+        };
+        eastl::vector<batch_t, job_allocator_t> batchs;
+        eastl::vector<task_t, job_allocator_t> tasks;
+        // with group write, a group is never split and a batch never crosses groups
+        const uint32_t batchSize = job->hasGroupWrite ? UINT32_MAX : job->batchSize;
+        batchs.reserve(job->hasGroupWrite ? job->groupCount : job->entityCount / batchSize);
+        tasks.reserve(batchs.capacity());
+        {
+
+            uint32_t batchRemain = batchSize;
+            EIndex startIndex = 0;
+            batch_t currBatch;
+            currBatch.startTask = currBatch.endTask = 0;
+            forloop (i, 0, job->groupCount)
+            {
+                auto scheduleView = [&](dual_chunk_view_t* view) {
+                    uint32_t allocated = 0;
+                    while (allocated != view->count)
+                    {
+                        uint32_t subViewCount = std::min(view->count - allocated, batchRemain);
+                        task_t newTask;
+                        newTask.groupIndex = i;
+                        newTask.startIndex = startIndex;
+                        newTask.view = dual_chunk_view_t{ view->chunk, view->start + allocated, subViewCount };
+                        allocated += subViewCount;
+                        startIndex += subViewCount;
+                        batchRemain -= subViewCount;
+                        tasks.push_back(newTask);
+                        if (batchRemain == 0) // batch filled
+                        {
+                            currBatch.endTask = tasks.size();
+                            batchs.push_back(currBatch);
+                            currBatch.startTask = currBatch.endTask; // new batch
+                            batchRemain = batchSize;
+                        }
+                    }
+                };
+                auto group = job->groups[i];
+                query->storage->query(group, query->filter, validatedMeta, DUAL_LAMBDA(scheduleView));
+                if (job->hasGroupWrite && currBatch.startTask != (intptr_t)tasks.size())
+                {
+                    currBatch.endTask = tasks.size();
+                    batchs.push_back(currBatch);
+                    currBatch.startTask = currBatch.endTask;
+                }
+            };
+            if (currBatch.endTask != (intptr_t)tasks.size())
+            {
+                currBatch.endTask = tasks.size();
+                batchs.push_back(currBatch);
+            }
+        }
+        struct task_payload_t {
+            batch_t batch;
+            dual_ecs_job_t* job;
+        };
+        // tasks are kept with payloads, batches are running after this body returns
+        task_payload_t* payloads = (task_payload_t*)get_job_pool().allocate(sizeof(task_payload_t) * batchs.size() + sizeof(task_t) * tasks.size() + sizeof(ftl::Task) * batchs.size());
+        task_t* taskData = (task_t*)(payloads + batchs.size());
+        std::memcpy(taskData, tasks.data(), sizeof(task_t) * tasks.size());
+        uint32_t payloadIndex = 0;
+        for (auto& batch : batchs)
+        {
+            batch.startTask = (intptr_t)&taskData[batch.startTask];
+            batch.endTask = (intptr_t)&taskData[batch.endTask];
+            payloads[payloadIndex++] = { batch, job };
+        }
+        job->payloads = payloads;
+
+        auto taskBody = +[](ftl::TaskScheduler* taskScheduler, void* data) {
+            task_payload_t* payload = (task_payload_t*)data;
+            auto job = payload->job;
+            auto start = clock_ns();
+            for (auto task = (task_t*)payload->batch.startTask; task != (task_t*)payload->batch.endTask; ++task)
+                job->callback(job->userdata, job->query->storage, &task->view, &job->localTypes[job->query->parameters.length * task->groupIndex], task->startIndex);
+            job->runTime.fetch_add(clock_ns() - start, std::memory_order_relaxed);
+        };
+        auto _tasks = (ftl::Task*)(taskData + tasks.size());
+
+        auto TearDown = +[](void* data) {
+            task_payload_t* payload = (task_payload_t*)data;
+            ecs_job_teardown(payload->job);
+        };
+        forloop (i, 0, batchs.size())
+            _tasks[i] = { taskBody, &payloads[i], TearDown };
+        job->refCount.fetch_add((uint32_t)batchs.size(), std::memory_order_relaxed);
+        job->taskCount.fetch_add((uint32_t)batchs.size(), std::memory_order_relaxed);
+        job->batchCount = (uint32_t)batchs.size();
+        job->scheduler->allCounter->Add(batchs.size());
+        job->query->storage->counter->Add(batchs.size());
+        job->scheduler->scheduler->AddTasks((unsigned int)batchs.size(), _tasks, ftl::TaskPriority::Normal, job->counter.get());
+    }
+}
 } // namespace dual
 
+void dual::scheduler_t::dispatch_job(dual_job_t* job)
+{
+    // count unfinished dependencies, the last one finished enqueues the job
+    for (auto dep : job->dependencies)
+    {
+        job->pendingCount.fetch_add(1, std::memory_order_relaxed);
+        if (!dep->add_successor(job))
+            job->pendingCount.fetch_sub(1, std::memory_order_relaxed);
+        dep->release();
+    }
+    job->dependencies.clear();
+    job->dependency_done();
+}
+
+void dual::scheduler_t::run_ecs_job(dual_ecs_job_t* job)
+{
+    auto storage = job->query->storage;
+    allCounter->Add(1);
+    if (!storage->counter)
+        storage->counter = eastl::make_shared<ftl::TaskCounter>(scheduler);
+    storage->counter->Add(1);
+    job->scheduleTime = clock_ns();
+    job->runTime.store(0, std::memory_order_relaxed);
+    job->batchCount = 0;
+    job->task = { &ecs_job_body, job, &ecs_job_teardown };
+    dispatch_job(job);
+}
+
 eastl::shared_ptr<ftl::TaskCounter> dual::scheduler_t::schedule_ecs_job(const dual_query_t* query, EIndex batchSize, dual_system_callback_t callback, void* u,
 dual_system_init_callback_t init, dual_resource_operation_t* resources)
 {
@@ -172,12 +505,11 @@ dual_system_init_callback_t init, dual_resource_operation_t* resources)
     query->storage->query_groups(query->filter, query->meta, DUAL_LAMBDA(add_group));
     auto groupCount = (uint32_t)groups.size();
     size_t arenaSize = 0;
-    arenaSize += sizeof(dual_job_t);
-    arenaSize += resources->count * (sizeof(dual_entity_t) + sizeof(int)); // job.resources
-    arenaSize += groupCount * sizeof(dual_type_index_t) * params.length;   // job.localTypes
-    arenaSize += groupCount * sizeof(std::bitset<32>);                     // job.readonly
-    arenaSize += groupCount * sizeof(std::bitset<32>);                     // job.randomAccess
-    fixed_arena_t arena{ arenaSize };                                      // todo: pool?
+    arenaSize += sizeof(dual_ecs_job_t) + alignof(dual_ecs_job_t);
+    arenaSize += groupCount * sizeof(dual_group_t*) + alignof(dual_group_t*);                  // job.groups
+    arenaSize += groupCount * sizeof(dual_type_index_t) * params.length + alignof(dual_type_index_t); // job.localTypes
+    arenaSize += 3 * (groupCount * sizeof(std::bitset<32>) + alignof(std::bitset<32>));      // job.readonly, job.atomic, job.randomAccess
+    fixed_arena_t arena{ get_job_pool().allocate(arenaSize), arenaSize };
     dual_ecs_job_t* job = new (arena.allocate<dual_ecs_job_t>()) dual_ecs_job_t(*this);
     job->type = dual_job_type::ecs;
     job->groups = arena.allocate<dual_group_t*>(groupCount);
@@ -186,276 +518,107 @@ dual_system_init_callback_t init, dual_resource_operation_t* resources)
     job->readonly = arena.allocate<std::bitset<32>>(groupCount);
     job->atomic = arena.allocate<std::bitset<32>>(groupCount);
     job->randomAccess = arena.allocate<std::bitset<32>>(groupCount);
-    job->hasRandomWrite = false;
     job->entityCount = 0;
+    job->query = (dual_query_t*)query;
     job->callback = callback;
     job->userdata = u;
     job->batchSize = batchSize;
     job->init = init;
+    job->payloads = nullptr;
     arena.forget();
     std::memcpy(job->groups, groups.data(), groupCount * sizeof(dual_group_t*));
-    int groupIndex = 0;
-    for (auto group : groups)
-    {
-        job->entityCount += group->size;
-        forloop (i, 0, params.length)
-        {
-            auto idx = group->index(params.types[i]);
-            job->localTypes[groupIndex * params.length + i] = idx;
-            auto& op = params.accesses[i];
-            job->readonly[groupIndex].set(idx, op.readonly);
-            job->randomAccess[groupIndex].set(idx, op.randomAccess == DOS_GLOBAL);
-            job->atomic[groupIndex].set(idx, op.atomic);
-            job->hasRandomWrite |= op.randomAccess == DOS_GLOBAL;
-        }
-        ++groupIndex;
-    }
+    build_layout(*job, query);
+    forloop (i, 0, groupCount)
+        job->entityCount += groups[i]->size;
 
-    DependencySet dependencies;
-    skr::flat_hash_set<std::pair<dual::archetype_t*, dual_type_index_t>> syncedEntry;
+    if (resources)
+        sync_resources(job, resources);
     auto sync_entry = [&](const dual_group_t* group, dual_type_index_t localType, bool readonly, bool atomic) {
-        if (localType == kInvalidTypeIndex)
-            return;
-        auto at = group->archetype;
-        auto pair = std::make_pair(at, localType);
-        if (syncedEntry.find(pair) != syncedEntry.end())
+        auto& entry = get_dependency_entries(group->archetype)[localType];
+        if (entry.epoch == job->epoch)
             return;
-        syncedEntry.insert(pair);
-        skr_acquire_mutex(&entryMutex.mMutex);
-        auto iter = dependencyEntries.find(at);
-        if (iter == dependencyEntries.end())
-        {
-            eastl::vector<job_dependency_entry_t> entries(at->type.length);
-            dependencyEntries.insert(std::make_pair(at, std::move(entries)));
-        }
-
-        auto entries = (*iter).second.data();
-        auto& entry = entries[localType];
-        update_entry(entry, job->counter, readonly, atomic, dependencies);
-        skr_release_mutex(&entryMutex.mMutex);
-    };
-
-    auto sync_type = [&](dual_type_index_t type, bool readonly, bool atomic) {
-        for (auto& pair : query->storage->groups)
-        {
-            auto group = pair.second;
-            auto idx = group->index(type);
-            sync_entry(group, idx, readonly, atomic);
-        }
+        entry.epoch = job->epoch;
+        update_entry(entry, job, readonly, atomic);
     };
+    for_each_access(*job, query, DUAL_LAMBDA(sync_entry));
 
-    if (resources)
-    {
-        skr_acquire_mutex(&resourceMutex.mMutex);
-        forloop (i, 0, resources->count)
-        {
-            auto& entry = allResources[e_id(resources->resources[i])];
-            auto readonly = resources->readonly[i];
-            auto atomic = resources->atomic[i];
-            update_entry(entry, job->counter, readonly, atomic, dependencies);
-        }
-        skr_release_mutex(&resourceMutex.mMutex);
-    }
-
-    forloop (i, 0, query->parameters.length)
-    {
-        if (type_index_t(params.types[i]).is_tag())
-            continue;
-        if (params.accesses[i].randomAccess == DOS_GLOBAL)
-        {
-            sync_type(params.types[i], params.accesses[i].readonly, params.accesses[i].atomic);
-        }
-        else
-        {
-            groupIndex = 0;
-            for (auto group : groups)
-            {
-                auto localType = job->localTypes[groupIndex * params.length + i];
-                if (localType == kInvalidTypeIndex)
-                {
-                    auto g = group->get_owner(params.types[i]);
-                    if (g)
-                    {
-                        sync_entry(g, g->index(params.types[i]), params.accesses[i].readonly, params.accesses[i].atomic);
-                    }
-                }
-                else
-                {
-                    sync_entry(group, localType, params.accesses[i].readonly, params.accesses[i].atomic);
-                }
-                ++groupIndex;
-            }
-        }
-    }
-
-    job->dependencies.resize(dependencies.size());
-    job->dependencyCount = (int)dependencies.size();
-    uint32_t dependencyIndex = 0;
-    for (auto dependency : dependencies)
-        job->dependencies[dependencyIndex++] = dependency;
+    run_ecs_job(job);
+    return job->counter;
+}
 
+void dual::scheduler_t::run_for_job(dual_for_job_t* job)
+{
+    struct task_payload_t {
+        dual_for_job_t* job;
+        uint32_t start;
+        uint32_t end;
+    };
     auto body = +[](ftl::TaskScheduler*, void* data) {
-        auto job = (dual_ecs_job_t*)data;
-        forloop (i, 0, job->dependencyCount)
-            job->scheduler->scheduler->WaitForCounter(job->dependencies[i].get());
-        if (job->init)
-            job->init(job->userdata, job->entityCount);
-        auto query = job->query;
-        fixed_stack_scope_t _(localStack);
-        dual_meta_filter_t validatedMeta;
-        {
-            auto& meta = query->meta;
-            auto data = (char*)localStack.allocate(data_size(meta));
-            validatedMeta = clone(meta, data);
-            query->storage->validate(validatedMeta.all_meta);
-            query->storage->validate(validatedMeta.any_meta);
-            query->storage->validate(validatedMeta.none_meta);
-        }
-        if (job->hasRandomWrite)
-        {
-            uint32_t startIndex = 0;
-            auto processView = [&](dual_chunk_view_t* view) {
-                job->callback(job->userdata, job->query->storage, view, job->localTypes, startIndex);
-                startIndex += view->count;
-            };
-            forloop (i, 0, job->groupCount)
-            {
-                auto group = job->groups[i];
-                query->storage->query(group, query->filter, validatedMeta, DUAL_LAMBDA(processView));
-            }
-        }
-        else
+        auto job = (dual_for_job_t*)data;
+        uint32_t batchCount = (job->count + job->batchSize - 1) / job->batchSize;
+        if (batchCount == 0)
+            return;
+        auto payloads = (task_payload_t*)get_job_pool().allocate((sizeof(task_payload_t) + sizeof(ftl::Task)) * batchCount);
+        auto tasks = (ftl::Task*)(payloads + batchCount);
+        auto taskBody = +[](ftl::TaskScheduler*, void* data) {
+            auto payload = (task_payload_t*)data;
+            auto job = payload->job;
+            forloop (i, payload->start, payload->end)
+                job->callback(job->userdata, i);
+        };
+        auto TearDown = +[](void* data) {
+            auto payload = (task_payload_t*)data;
+            release_for_job(payload->job);
+        };
+        forloop (i, 0, batchCount)
         {
-            struct task_t {
-                uint32_t groupIndex;
-                uint32_t startIndex;
-                dual_chunk_view_t view;
-            };
-            struct batch_t {
-                intptr_t startTask;
-                intptr_t endTask;
-            };
-            eastl::vector<batch_t> batchs;
-            eastl::vector<task_t> tasks;
-            batchs.reserve(job->entityCount / job->batchSize);
-            tasks.reserve(batchs.capacity());
-            {
-
-                uint32_t batchRemain = job->batchSize;
-                EIndex startIndex = 0;
-                batch_t currBatch;
-                currBatch.startTask = currBatch.endTask = 0;
-                forloop (i, 0, job->groupCount)
-                {
-                    auto scheduleView = [&](dual_chunk_view_t* view) {
-                        uint32_t allocated = 0;
-                        while (allocated != view->count)
-                        {
-                            uint32_t subViewCount = std::min(view->count - allocated, batchRemain);
-                            task_t newTask;
-                            newTask.groupIndex = i;
-                            newTask.startIndex = startIndex;
-                            newTask.view = dual_chunk_view_t{ view->chunk, view->start + allocated, subViewCount };
-                            allocated += subViewCount;
-                            startIndex += subViewCount;
-                            batchRemain -= subViewCount;
-                            tasks.push_back(newTask);
-                            if (batchRemain == 0) // batch filled
-                            {
-                                currBatch.endTask = tasks.size();
-                                batchs.push_back(currBatch);
-                                currBatch.startTask = currBatch.endTask; // new batch
-                                batchRemain = job->batchSize;
-                            }
-                        }
-                    };
-                    auto group = job->groups[i];
-                    query->storage->query(group, query->filter, validatedMeta, DUAL_LAMBDA(scheduleView));
-                };
-                if (currBatch.endTask != tasks.size())
-                {
-                    currBatch.endTask = tasks.size();
-                    batchs.push_back(currBatch);
-                }
-            }
-            struct task_payload_t {
-                batch_t batch;
-                dual_ecs_job_t* job;
-            };
-            task_payload_t* payloads = (task_payload_t*)::dual_malloc(sizeof(task_payload_t) * batchs.size());
-            uint32_t payloadIndex = 0;
-            for (auto& batch : batchs)
-            {
-                batch.startTask = (intptr_t)&tasks[batch.startTask];
-                batch.endTask = (intptr_t)&tasks[batch.endTask];
-                payloads[payloadIndex++] = { batch, job };
-            }
-            job->payloads = payloads;
-
-            auto taskBody = +[](ftl::TaskScheduler* taskScheduler, void* data) {
-                task_payload_t* payload = (task_payload_t*)data;
-                auto job = payload->job;
-                for (auto task = (task_t*)payload->batch.startTask; task != (task_t*)payload->batch.endTask; ++task)
-                    job->callback(job->userdata, job->query->storage, &task->view, &job->localTypes[job->query->parameters.length * task->groupIndex], task->startIndex);
-            };
-            auto _tasks = (ftl::Task*)dual_malloc(sizeof(ftl::Task) * batchs.size());
-
-            auto TearDown = +[](void* data) {
-                task_payload_t* payload = (task_payload_t*)data;
-                auto job = payload->job;
-                job->scheduler->allCounter->Decrement();
-                job->query->storage->counter->Decrement();
-                if (job->counter->Done())
-                {
-                    job->~dual_ecs_job_t();
-                    dual_free(job);
-                }
-            };
-            forloop (i, 0, batchs.size())
-                _tasks[i] = { taskBody, &payloads[i], TearDown };
-            job->scheduler->allCounter->Add(batchs.size());
-            job->query->storage->counter->Add(batchs.size());
-            job->scheduler->scheduler->AddTasks((unsigned int)batchs.size(), _tasks, ftl::TaskPriority::Normal, job->counter.get());
-            dual_free(_tasks);
+            payloads[i] = { job, i * job->batchSize, std::min((i + 1) * job->batchSize, job->count) };
+            tasks[i] = { taskBody, &payloads[i], TearDown };
         }
+        job->payloads = payloads;
+        job->refCount.fetch_add(batchCount, std::memory_order_relaxed);
+        job->taskCount.fetch_add(batchCount, std::memory_order_relaxed);
+        job->scheduler->allCounter->Add(batchCount);
+        job->scheduler->scheduler->AddTasks(batchCount, tasks, ftl::TaskPriority::Normal, job->counter.get());
     };
     auto TearDown = +[](void* data) {
-        dual_ecs_job_t* job = (dual_ecs_job_t*)data;
-        job->scheduler->allCounter->Decrement();
-        if (job->counter->Done())
-        {
-            job->~dual_ecs_job_t();
-            dual_free(job);
-        }
+        auto job = (dual_for_job_t*)data;
+        release_for_job(job);
     };
+    job->payloads = nullptr;
     allCounter->Add(1);
-    if (!query->storage->counter)
-        query->storage->counter = eastl::make_shared<ftl::TaskCounter>(scheduler);
-    query->storage->counter->Add(1);
-    scheduler->AddTask({ body, job, TearDown }, ftl::TaskPriority::High, job->counter.get());
+    job->task = { body, job, TearDown };
+    dispatch_job(job);
+}
+
+eastl::shared_ptr<ftl::TaskCounter> dual::scheduler_t::schedule_for_job(uint32_t count, dual_for_callback_t callback, void* u, dual_resource_operation_t* resources)
+{
+    dual_for_job_t* job = new (get_job_pool().allocate(sizeof(dual_for_job_t))) dual_for_job_t(*this);
+    job->type = dual_job_type::simple;
+    job->count = count;
+    // several batches per worker to balance uneven iterations
+    auto threadCount = std::max(scheduler->GetThreadCount(), 1u);
+    job->batchSize = std::max(count / (threadCount * 4), 1u);
+    job->callback = callback;
+    job->userdata = u;
+    if (resources)
+        sync_resources(job, resources);
+
+    run_for_job(job);
     return job->counter;
 }
 
-eastl::vector<eastl::shared_ptr<ftl::TaskCounter>> dual::scheduler_t::sync_resources(eastl::shared_ptr<ftl::TaskCounter> counter, dual_resource_operation_t* resources)
+void dual::scheduler_t::sync_resources(dual_job_t* job, dual_resource_operation_t* resources)
 {
-    DependencySet dependencies;
     skr_acquire_mutex(&resourceMutex.mMutex);
     forloop (i, 0, resources->count)
     {
         auto& entry = allResources[e_id(resources->resources[i])];
         auto readonly = resources->readonly[i];
         auto atomic = resources->atomic[i];
-        update_entry(entry, counter, readonly, atomic, dependencies);
+        update_entry(entry, job, readonly, atomic);
     }
     skr_release_mutex(&resourceMutex.mMutex);
-    eastl::vector<eastl::shared_ptr<ftl::TaskCounter>> result;
-
-    result.resize(dependencies.size());
-    uint32_t dependencyIndex = 0;
-    for (auto dependency : dependencies)
-        result[dependencyIndex++] = dependency;
-
-    return result;
 }
 
 dual_job_t::~dual_job_t()
@@ -464,13 +627,121 @@ dual_job_t::~dual_job_t()
 
 dual_job_t::dual_job_t(dual::scheduler_t& scheduler)
     : scheduler(&scheduler)
-    , counter(eastl::make_shared<ftl::TaskCounter>(scheduler.scheduler))
+    , epoch(++scheduler.epoch)
+    , refCount(1)
+    , counter(eastl::allocate_shared<ftl::TaskCounter>(dual::job_allocator_t(), scheduler.scheduler))
+    , pendingCount(1)
+    , taskCount(0)
+    , finished(false)
+{
+    counter->Add(1);
+}
+
+void dual_job_t::release() noexcept
 {
+    if (refCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        // job and it's data are allocated in one block
+        this->~dual_job_t();
+        dual::get_job_pool().free(this);
+    }
+}
+
+bool dual_job_t::add_successor(dual_job_t* job)
+{
+    skr_acquire_mutex(&successorMutex.mMutex);
+    bool added = !finished;
+    if (added)
+    {
+        job->retain();
+        successors.push_back(job);
+    }
+    skr_release_mutex(&successorMutex.mMutex);
+    return added;
+}
+
+void dual_job_t::dependency_done()
+{
+    if (pendingCount.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+    taskCount.store(1, std::memory_order_relaxed);
+    // ftl only calls teardown of tasks with counter, job holds the counter until task_done so it is not finished early
+    scheduler->scheduler->AddTask(task, ftl::TaskPriority::High, counter.get());
+}
+
+void dual_job_t::task_done()
+{
+    if (taskCount.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+    skr_acquire_mutex(&successorMutex.mMutex);
+    finished = true;
+    skr_release_mutex(&successorMutex.mMutex);
+    finish();
+    counter->Decrement();
+    // successors are no longer added once finished, caller still holds a reference of job
+    for (auto job : successors)
+    {
+        job->dependency_done();
+        job->release();
+    }
+    successors.clear();
+}
+
+dual_counter_t* dual_counter_t::create(eastl::shared_ptr<ftl::TaskCounter> counter)
+{
+    return new (dual::get_job_pool().allocate(sizeof(dual_counter_t))) dual_counter_t{ std::move(counter) };
+}
+
+void dual_counter_t::release()
+{
+    this->~dual_counter_t();
+    dual::get_job_pool().free(this);
 }
 
 dual_ecs_job_t::~dual_ecs_job_t()
 {
-    ::dual_free(payloads);
+    dual::get_job_pool().free(payloads);
+}
+
+void dual_ecs_job_t::finish()
+{
+    auto runTime = this->runTime.load(std::memory_order_relaxed);
+    auto& stats = query->stats;
+    skr_acquire_mutex(&scheduler->statsMutex.mMutex);
+    stats.entityCount = entityCount;
+    stats.taskCount = batchCount;
+    stats.batchSize = batchSize;
+    stats.waitTime = startTime - scheduleTime;
+    stats.runTime = runTime;
+    if (entityCount > 0)
+    {
+        // smooth out noise of single frame
+        double cost = (double)runTime / entityCount;
+        stats.costPerEntity = stats.jobCount == 0 ? cost : stats.costPerEntity * 0.75 + cost * 0.25;
+    }
+    stats.jobCount++;
+    skr_release_mutex(&scheduler->statsMutex.mMutex);
+}
+
+EIndex dual::scheduler_t::adaptive_batch_size(const dual_query_t* query, EIndex entityCount)
+{
+    auto threadCount = std::max(scheduler->GetThreadCount(), 1u);
+    skr_acquire_mutex(&statsMutex.mMutex);
+    double cost = query->stats.costPerEntity;
+    skr_release_mutex(&statsMutex.mMutex);
+    // no history, several batches per worker like schedule_for_job
+    if (cost <= 0)
+        return std::max(entityCount / (threadCount * 4), (EIndex)1);
+    double batchSize = (double)targetTaskTime / cost;
+    if (batchSize >= entityCount)
+        return std::max(entityCount, (EIndex)1);
+    // expensive job should be spread to every worker
+    return (EIndex)std::max(std::min<double>(batchSize, (entityCount + threadCount - 1) / threadCount), 1.0);
+}
+
+dual_for_job_t::~dual_for_job_t()
+{
+    dual::get_job_pool().free(payloads);
 }
 
 extern "C" {
@@ -484,16 +755,12 @@ void dualJ_remove_resource(dual_entity_t id)
     dual::scheduler_t::get().remove_resource(id);
 }
 
-struct dual_counter_t {
-    eastl::shared_ptr<ftl::TaskCounter> counter;
-};
-
 void dualJ_schedule_ecs(const dual_query_t* query, EIndex batchSize, dual_system_callback_t callback, void* u,
 dual_system_init_callback_t init, dual_resource_operation_t* resources, dual_counter_t** counter)
 {
     if (counter)
     {
-        *counter = SkrNew<dual_counter_t>(dual::scheduler_t::get().schedule_ecs_job(query, batchSize, callback, u, init, resources));
+        *counter = dual_counter_t::create(dual::scheduler_t::get().schedule_ecs_job(query, batchSize, callback, u, init, resources));
     }
     else
     {
@@ -501,6 +768,31 @@ dual_system_init_callback_t init, dual_resource_operation_t* resources, dual_cou
     }
 }
 
+void dualJ_schedule_for(uint32_t count, dual_for_callback_t callback, void* u, dual_resource_operation_t* resources, dual_counter_t** counter)
+{
+    if (counter)
+    {
+        *counter = dual_counter_t::create(dual::scheduler_t::get().schedule_for_job(count, callback, u, resources));
+    }
+    else
+    {
+        dual::scheduler_t::get().schedule_for_job(count, callback, u, resources);
+    }
+}
+
+void dualJ_get_stats(const dual_query_t* query, dual_job_stats_t* stats)
+{
+    auto& scheduler = dual::scheduler_t::get();
+    skr_acquire_mutex(&scheduler.statsMutex.mMutex);
+    *stats = query->stats;
+    skr_release_mutex(&scheduler.statsMutex.mMutex);
+}
+
+void dualJ_set_target_task_time(uint64_t nanoseconds)
+{
+    dual::scheduler_t::get().targetTaskTime = std::max<uint64_t>(nanoseconds, 1);
+}
+
 void dualJ_wait_counter(dual_counter_t* counter, int pin)
 {
     dual::scheduler_t::get().scheduler->WaitForCounter(counter->counter.get(), pin);
@@ -508,7 +800,8 @@ void dualJ_wait_counter(dual_counter_t* counter, int pin)
 
 void dualJ_release_counter(dual_counter_t* counter)
 {
-    SkrDelete(counter);
+    if (counter)
+        counter->release();
 }
 
 void dualJ_wait_all()
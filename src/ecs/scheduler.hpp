@@ -6,20 +6,50 @@
 #include "ftl/task_scheduler.h"
 #include "mask.hpp"
 #include "archetype.hpp"
+#include "pool.hpp"
 #include <bitset>
+#include <atomic>
 #include <phmap.h>
 #include "ecs/entities.hpp"
 #include "platform/thread.h"
 #include "utils/hashmap.hpp"
 #include "EASTL/shared_ptr.h"
 #include "EASTL/vector.h"
+#include "EASTL/fixed_vector.h"
 
+struct dual_job_t;
+struct dual_for_job_t;
 struct dual_ecs_job_t;
 namespace dual
 {
+// eastl allocator of job pool, used by containers and counters living in job path
+struct job_allocator_t {
+    job_allocator_t(const char* = nullptr) {}
+    void* allocate(size_t n, int = 0) { return get_job_pool().allocate(n); }
+    void* allocate(size_t n, size_t alignment, size_t, int = 0)
+    {
+        SKR_ASSERT(alignment <= binned_pool_t::kHeaderSize);
+        return get_job_pool().allocate(n);
+    }
+    void deallocate(void* p, size_t) { get_job_pool().free(p); }
+    const char* get_name() const { return "dual job"; }
+    void set_name(const char*) {}
+};
+inline bool operator==(const job_allocator_t&, const job_allocator_t&) { return true; }
+inline bool operator!=(const job_allocator_t&, const job_allocator_t&) { return false; }
+// lists longer than inline capacity overflow to job pool
+using job_list_t = eastl::fixed_vector<dual_job_t*, 4, true, job_allocator_t>;
+
+// jobs accessing a resource or a component of an archetype, each job in list holds a reference
 struct job_dependency_entry_t {
-    eastl::vector<eastl::shared_ptr<ftl::TaskCounter>> owned;
-    eastl::vector<eastl::shared_ptr<ftl::TaskCounter>> shared;
+    job_list_t owned;
+    job_list_t shared;
+    // last job updated this entry, avoid updating twice for same job
+    uint32_t epoch = 0;
+    job_dependency_entry_t() = default;
+    job_dependency_entry_t(job_dependency_entry_t&&) = default;
+    ~job_dependency_entry_t();
+    void clear();
 };
 
 struct scheduler_t {
@@ -27,9 +57,12 @@ struct scheduler_t {
     dual::entity_registry_t registry;
     eastl::shared_ptr<ftl::TaskCounter> allCounter;
     eastl::vector<dual::job_dependency_entry_t> allResources;
-    skr::flat_hash_map<dual::archetype_t*, eastl::vector<job_dependency_entry_t>> dependencyEntries;
-    SMutexObject entryMutex;
+    std::atomic<uint32_t> epoch;
     SMutexObject resourceMutex;
+    // guards stats of queries
+    SMutexObject statsMutex;
+    // nanoseconds, adaptive batches are sized to run this long
+    uint64_t targetTaskTime;
 
     scheduler_t();
     static scheduler_t& get();
@@ -42,9 +75,44 @@ struct scheduler_t {
     void sync_entry(dual::archetype_t* type, dual_type_index_t entry);
     void sync_all();
     void sync_storage(const dual_storage_t* storage);
+    // any scheduled job is still accessing the archetype
+    bool is_archetype_busy(dual::archetype_t* type);
+    void run_for_job(dual_for_job_t* job);
+    eastl::shared_ptr<ftl::TaskCounter> schedule_for_job(uint32_t count, dual_for_callback_t callback, void* u, dual_resource_operation_t* resources);
+    void dispatch_job(dual_job_t* job);
+    void run_ecs_job(dual_ecs_job_t* job);
     eastl::shared_ptr<ftl::TaskCounter> schedule_ecs_job(const dual_query_t* query, EIndex batchSize, dual_system_callback_t callback, void* u, dual_system_init_callback_t init, dual_resource_operation_t* resources);
-    eastl::vector<eastl::shared_ptr<ftl::TaskCounter>> sync_resources(eastl::shared_ptr<ftl::TaskCounter> counter, dual_resource_operation_t* resources);
+    void sync_resources(dual_job_t* job, dual_resource_operation_t* resources);
+    EIndex adaptive_batch_size(const dual_query_t* query, EIndex entityCount);
+};
+
+// steady clock in nanoseconds, used by job statistics and budgeted storage work
+uint64_t clock_ns();
+// entries of archetype are allocated on first use and only touched by main thread
+job_dependency_entry_t* get_dependency_entries(archetype_t* type);
+void release_dependency_entries(archetype_t* type);
+void update_entry(job_dependency_entry_t& entry, dual_job_t* job, bool readonly, bool atomic);
+// release and remove finished jobs from list
+void remove_done(job_list_t& list);
+
+// per group accessing info of a query, shared by ecs jobs and compiled system graph
+struct ecs_job_layout_t {
+    dual_group_t** groups;
+    uint32_t groupCount;
+    dual_type_index_t* localTypes;
+    std::bitset<32>* readonly;
+    std::bitset<32>* atomic;
+    std::bitset<32>* randomAccess;
+    // plain random write may touch any entity, job runs in one task
+    bool hasRandomWrite;
+    // random write inside group, every group is processed by one task
+    bool hasGroupWrite;
 };
+// fill local types and access masks, groups must be set
+void build_layout(ecs_job_layout_t& layout, const dual_query_t* query);
+typedef void (*dual_access_callback_t)(void* u, const dual_group_t* group, dual_type_index_t localType, bool readonly, bool atomic);
+// visit every component entry a query job reads or writes
+void for_each_access(const ecs_job_layout_t& layout, const dual_query_t* query, dual_access_callback_t callback, void* u);
 } // namespace dual
 
 enum class dual_job_type
@@ -56,29 +124,62 @@ enum class dual_job_type
 struct dual_job_t {
     dual::scheduler_t* scheduler;
     dual_job_type type;
+    uint32_t epoch;
+    // held by dependency entries, dependent jobs and running tasks
+    std::atomic<uint32_t> refCount;
+    // job is not finished until counter reaches zero, including the time waiting for dependencies
     eastl::shared_ptr<ftl::TaskCounter> counter;
-    eastl::vector<eastl::shared_ptr<ftl::TaskCounter>> dependencies;
-    int dependencyCount;
+    dual::job_list_t dependencies;
+    // enqueued when all dependencies are finished instead of waiting in task
+    ftl::Task task;
+    std::atomic<uint32_t> pendingCount;
+    std::atomic<uint32_t> taskCount;
+    SMutexObject successorMutex;
+    bool finished;
+    dual::job_list_t successors;
     dual_job_t(dual::scheduler_t& scheduler);
     virtual ~dual_job_t();
+    void retain() noexcept { refCount.fetch_add(1, std::memory_order_relaxed); }
+    void release() noexcept;
+    bool done() noexcept { return counter->Done(); }
+    bool add_successor(dual_job_t* job);
+    void dependency_done();
+    void task_done();
+    // called by last task before job is marked as finished
+    virtual void finish() {}
 };
 
-struct dual_ecs_job_t : dual_job_t {
+struct dual_for_job_t : dual_job_t {
+    using dual_job_t::dual_job_t;
+    uint32_t count;
+    uint32_t batchSize;
+    dual_for_callback_t callback;
+    void* userdata;
+    void* payloads;
+    ~dual_for_job_t();
+};
+
+struct dual_ecs_job_t : dual_job_t, dual::ecs_job_layout_t {
     using dual_job_t::dual_job_t;
-    dual_group_t** groups;
-    uint32_t groupCount;
-    dual_type_index_t* localTypes;
-    std::bitset<32>* readonly;
-    std::bitset<32>* atomic;
-    std::bitset<32>* randomAccess;
-    bool hasRandomWrite;
     EIndex entityCount;
-    dual_resource_operation_t resources;
     dual_query_t* query;
     dual_system_callback_t callback;
     dual_system_init_callback_t init;
     EIndex batchSize;
     void* userdata;
     void* payloads;
+    // nanoseconds, reported to query stats when finished
+    uint64_t scheduleTime;
+    uint64_t startTime;
+    std::atomic<uint64_t> runTime;
+    uint32_t batchCount;
     ~dual_ecs_job_t();
-};
\ No newline at end of file
+    void finish() override;
+};
+
+struct dual_counter_t {
+    eastl::shared_ptr<ftl::TaskCounter> counter;
+    // handles are allocated from job pool like the jobs they wait for
+    static dual_counter_t* create(eastl::shared_ptr<ftl::TaskCounter> counter);
+    void release();
+};
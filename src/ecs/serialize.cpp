@@ -17,6 +17,9 @@
 #include <atomic>
 #include "set.hpp"
 #include "scheduler.hpp"
+#include "ftl/task_scheduler.h"
+#include <algorithm>
+#include <vector>
 #ifndef forloop
     #define forloop(i, z, n) for (auto i = std::decay_t<decltype(n)>(z); i < (n); ++i)
 #endif
@@ -83,7 +86,7 @@ static void serialize_impl(const dual_chunk_view_t& view, dual_type_index_t type
                 if (serialize)
                     serialize(view.chunk, view.start + i, (char*)array->BeginX, (EIndex)length, s.v, s.t);
                 else
-                    s.archive(array->BeginX, size);
+                    s.archive(array->BeginX, length);
             }
         }
     }
@@ -107,8 +110,10 @@ void dual::serialize_view(const dual_chunk_view_t& view, dual::serializer_t s, b
     uint32_t* elemSizes = type->elemSizes;
     if (withEntities)
         s.archive(view.chunk->get_entities() + view.start, view.count);
+    uint32_t* fieldCounts = type->fieldCounts;
     for (int i = 0; i < type->type.length; ++i)
-        serialize_impl(view, type->type.data[i], offsets[i], sizes[i], elemSizes[i], s, type->callbacks[i].serialize);
+        forloop (f, 0, fieldCounts[i])
+            serialize_impl(view, type->type.data[i], offsets[i] + f * type->field_stride(i, view.chunk->pt), sizes[i] / fieldCounts[i], elemSizes[i], s, type->callbacks[i].serialize);
 }
 
 void dual_storage_t::serialize_type(const dual_entity_type_t& type, dual::serializer_t s, bool keepMeta)
@@ -117,7 +122,7 @@ void dual_storage_t::serialize_type(const dual_entity_type_t& type, dual::serial
     // group is define by entity_type, so we just serialize it's type
     // todo: assert(s.is_serialize());
     s.archive(type.type.length);
-    auto reg = type_registry_t::get();
+    auto& reg = type_registry_t::get();
     for (auto t : type.type)
         s.archive(reg.descriptions[type_index_t(t).index()].guid);
     if(keepMeta)
@@ -132,12 +137,12 @@ dual_entity_type_t dual_storage_t::deserialize_type(dual::fixed_stack_t& stack,
     using namespace dual;
     // deserialize type, and get/create group from it
     // todo: assert(!s.is_serialize());
-    dual_entity_type_t type;
+    dual_entity_type_t type = {};
     s.archive(type.type.length);
     auto guids = stack.allocate<guid_t>(type.type.length);
     s.archive(guids, type.type.length);
     type.type.data = stack.allocate<dual_type_index_t>(type.type.length);
-    auto reg = type_registry_t::get();
+    auto& reg = type_registry_t::get();
     forloop (i, 0, type.type.length) // todo: check type existence
         ((dual_type_index_t*)type.type.data)[i] = reg.guid2type[guids[i]];
     std::sort((dual_type_index_t*)type.type.data, (dual_type_index_t*)type.type.data + type.type.length);
@@ -239,6 +244,9 @@ void dual_storage_t::serialize(dual::serializer_t s)
         SKR_ASSERT(scheduler->is_main_thread(this));
         scheduler->sync_storage(this);
     }
+    // reserved ids are not saved, shared ids are saved as free ids
+    SKR_ASSERT(entities.pendingCount.load() == 0);
+    entities.reclaim_shared();
     s.archive((uint32_t)entities.entries.size());
     s.archive((uint32_t)entities.freeEntries.size());
     s.archive(entities.freeEntries.data(), entities.freeEntries.size());
@@ -265,6 +273,7 @@ void dual_storage_t::deserialize(dual::serializer_t s)
     uint32_t size;
     s.archive(size);
     entities.entries.resize(size);
+    entities.highWater = size;
     uint32_t freeSize;
     s.archive(freeSize);
     entities.freeEntries.resize(freeSize);
@@ -295,4 +304,582 @@ void dual_storage_t::deserialize(dual::serializer_t s)
             }
         }
     }
-}
\ No newline at end of file
+}
+namespace dual
+{
+// chunk image: [header] [index bytes] [index] [free ids] ([group])*, index is absent before version 3
+// index: ([type] [group offset] [group bytes] [entity count])*, offsets are from beginning of image
+// group: [type] [component sizes] [chunk count] ([chunk bytes] [chunk])*, chunk bytes is absent in version 1
+// chunk: [count] [entities] ([column])*, column is written verbatim except components with serialize callback
+// buffer column: [column] ([length] [elements])* for arrays outgrown inline capacity
+// array pointers are written as offsets from the array, zero marks outgrown arrays
+// before version 4 pointers are written verbatim after [column address]
+static constexpr uint32_t kImageMagic = 0x474D4944; // DIMG
+static constexpr uint32_t kImageVersion = 4;
+
+struct image_header_t {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entitySize;
+    uint32_t pointerSize;
+    uint32_t entryCount;
+    uint32_t freeCount;
+    uint32_t groupCount;
+};
+
+// serializer over image for types with serialize callback
+static const dual_serializer_v image_reader_serializer = {
+    +[](void* s, void* data, uint32_t bytes) { ((image_reader_t*)s)->read(data, bytes); },
+    +[](void* s, void* data, uint32_t bytes) { ((image_reader_t*)s)->peek(data, bytes); },
+    +[](void*) { return 0; }
+};
+
+// chunks are written to buffer first for their size, buffers of different chunks can be written in parallel
+static const dual_serializer_v image_writer_serializer = {
+    +[](void* s, void* data, uint32_t bytes) {
+        auto buffer = (std::vector<char>*)s;
+        buffer->insert(buffer->end(), (char*)data, (char*)data + bytes);
+    },
+    nullptr,
+    +[](void*) { return 1; }
+};
+
+static bool valid_image_header(const image_header_t& header)
+{
+    if (header.magic != kImageMagic || header.version == 0 || header.version > kImageVersion)
+        return false;
+    return header.entitySize == sizeof(dual_entity_t) && header.pointerSize == sizeof(void*);
+}
+
+// reads header and group index, index is left empty before version 3
+static bool read_image_index(image_reader_t& reader, image_header_t& header, image_reader_t& index)
+{
+    reader.read(header);
+    if (reader.failed || !valid_image_header(header))
+        return false;
+    index = { nullptr, 0, 0, false };
+    if (header.version < 3)
+        return true;
+    uint64_t bytes = 0;
+    reader.read(bytes);
+    auto data = reader.take(bytes);
+    index = { data, (size_t)bytes, 0, data == nullptr };
+    return !reader.failed;
+}
+
+// dead groups are only selected when filter asks for them as queries do
+static bool match_image_group(const dual_entity_type_t& type, const dual_filter_t* filter)
+{
+    auto contains = [](const dual_type_set_t& set, dual_type_index_t t) {
+        return std::binary_search(set.data, set.data + set.length, t);
+    };
+    if (contains(type.type, kDeadComponent) && !(filter && contains(filter->all, kDeadComponent)))
+        return false;
+    return !filter || match_group_type(type, *filter, contains(type.type, kMaskComponent));
+}
+
+static bool array_inline(const dual_array_component_t* array, uintptr_t address, uint32_t size)
+{
+    auto begin = (uintptr_t)array->BeginX;
+    return begin >= address && begin <= address + size;
+}
+
+// large worlds are written and loaded on workers by chunk ranges, once job system is initialized
+static ftl::TaskScheduler* image_scheduler(size_t entityCount)
+{
+    auto scheduler = scheduler_t::get().scheduler;
+    return entityCount >= kParallelSpawnThreshold ? scheduler : nullptr;
+}
+
+// split chunks of each group into batches of about kParallelSpawnBatch entities
+template <class T, class F>
+static void for_each_batch_parallel(ftl::TaskScheduler* scheduler, std::vector<T>& items, const F& f)
+{
+    struct batch_t {
+        const F* f;
+        T* begin;
+        T* end;
+    };
+    std::vector<batch_t> batches;
+    size_t i = 0;
+    while (i < items.size())
+    {
+        size_t j = i;
+        EIndex count = 0;
+        while (j < items.size() && (j == i || count < kParallelSpawnBatch))
+            count += items[j++].count();
+        batches.push_back({ &f, items.data() + i, items.data() + j });
+        i = j;
+    }
+    std::vector<ftl::Task> tasks(batches.size());
+    forloop (k, 0, batches.size())
+        tasks[k] = { +[](ftl::TaskScheduler*, void* u) {
+                        auto batch = (batch_t*)u;
+                        for (T* item = batch->begin; item != batch->end; ++item)
+                            (*batch->f)(*item);
+                    },
+            &batches[k] };
+    ftl::TaskCounter counter(scheduler);
+    scheduler->AddTasks((unsigned)tasks.size(), tasks.data(), ftl::TaskPriority::High, &counter);
+    scheduler->WaitForCounter(&counter, true);
+}
+} // namespace dual
+
+void dual::image_reader_t::peek(void* dst, size_t bytes)
+{
+    if (!failed && size - offset >= bytes)
+        std::memcpy(dst, data + offset, bytes);
+    else
+        failed = true;
+}
+
+const char* dual::image_reader_t::take(size_t bytes)
+{
+    if (failed || size - offset < bytes)
+    {
+        failed = true;
+        return nullptr;
+    }
+    const char* result = data + offset;
+    offset += bytes;
+    return result;
+}
+
+void dual::image_reader_t::read(void* dst, size_t bytes)
+{
+    if (auto src = take(bytes))
+        std::memcpy(dst, src, bytes);
+}
+
+void dual_storage_t::serialize_image_chunk(dual_chunk_t* c, dual::serializer_t s)
+{
+    using namespace dual;
+    auto type = c->type;
+    s.archive(c->count);
+    s.archive(c->get_entities(), c->count);
+    auto offsets = type->offsets[c->pt];
+    forloop (i, 0, type->type.length)
+    {
+        type_index_t t = type->type.data[i];
+        auto size = type->sizes[i];
+        if (type->callbacks[i].serialize)
+        {
+            serialize_impl({ c, 0, c->count }, t, offsets[i], size, type->elemSizes[i], s, type->callbacks[i].serialize);
+            continue;
+        }
+        char* column = c->data() + offsets[i];
+        if (!t.is_buffer())
+        {
+            auto fieldCount = type->fieldCounts[i];
+            // sub columns of soa component are stored one after another
+            forloop (f, 0, fieldCount)
+                s.archive(column + f * type->field_stride(i, c->pt), size / fieldCount * c->count);
+            continue;
+        }
+        // image does not depend on where chunk lives, so same storage gives same image wherever it is loaded
+        std::vector<char> rows(column, column + (size_t)size * c->count);
+        forloop (j, 0, c->count)
+        {
+            auto array = (dual_array_component_t*)(column + (size_t)j * size);
+            auto row = (dual_array_component_t*)(rows.data() + (size_t)j * size);
+            bool isInline = array_inline(array, (uintptr_t)array, size);
+            row->BeginX = (void*)(isInline ? (char*)array->BeginX - (char*)array : 0);
+            row->EndX = (void*)(isInline ? (char*)array->EndX - (char*)array : 0);
+            row->CapacityX = (void*)(isInline ? (char*)array->CapacityX - (char*)array : 0);
+        }
+        s.archive(rows.data(), (uint32_t)rows.size());
+        forloop (j, 0, c->count)
+        {
+            auto array = (dual_array_component_t*)(column + (size_t)j * size);
+            if (array_inline(array, (uintptr_t)array, size))
+                continue;
+            auto length = (uint32_t)((char*)array->EndX - (char*)array->BeginX);
+            s.archive(length);
+            s.archive(array->BeginX, length);
+        }
+    }
+}
+
+void dual_storage_t::serialize_image(dual::serializer_t s)
+{
+    using namespace dual;
+    if (scheduler)
+    {
+        SKR_ASSERT(scheduler->is_main_thread(this));
+        scheduler->sync_storage(this);
+    }
+    SKR_ASSERT(entities.pendingCount.load() == 0);
+    entities.reclaim_shared();
+    image_header_t header;
+    header.magic = kImageMagic;
+    header.version = kImageVersion;
+    header.entitySize = sizeof(dual_entity_t);
+    header.pointerSize = sizeof(void*);
+    header.entryCount = (uint32_t)entities.entries.size();
+    header.freeCount = (uint32_t)entities.freeEntries.size();
+    header.groupCount = (uint32_t)groups.size();
+    // chunks are written to buffers first, so offsets of groups are known before index
+    struct chunk_image_t {
+        dual_chunk_t* chunk;
+        std::vector<char> data;
+        EIndex count() const { return chunk->count; }
+    };
+    std::vector<chunk_image_t> chunks;
+    for (auto& pair : groups)
+        for (dual_chunk_t* c = pair.second->firstChunk; c; c = c->next)
+            if (c->count != 0)
+                chunks.push_back({ c, {} });
+    if (auto workers = image_scheduler(entities.entries.size() - header.freeCount))
+        for_each_batch_parallel(workers, chunks, [&](chunk_image_t& image) {
+            serialize_image_chunk(image.chunk, { &image.data, &image_writer_serializer });
+        });
+    else
+        for (auto& image : chunks)
+            serialize_image_chunk(image.chunk, { &image.data, &image_writer_serializer });
+    struct group_image_t {
+        dual_group_t* group;
+        std::vector<char> head; // type, sizes and chunk count
+        uint64_t size;
+        EIndex count;
+        size_t firstChunk, chunkCount;
+    };
+    std::vector<group_image_t> images;
+    size_t next = 0;
+    for (auto& pair : groups)
+    {
+        auto group = pair.second;
+        auto type = group->archetype;
+        group_image_t image{ group, {}, 0, 0, next, 0 };
+        serializer_t hs{ &image.head, &image_writer_serializer };
+        serialize_type(group->type, hs, true);
+        hs.archive(type->sizes, type->type.length);
+        for (dual_chunk_t* c = group->firstChunk; c; c = c->next)
+            image.chunkCount += c->count != 0;
+        uint32_t chunkCount = (uint32_t)image.chunkCount;
+        hs.archive(chunkCount);
+        image.size = image.head.size();
+        forloop (i, next, next + image.chunkCount)
+        {
+            image.size += sizeof(uint64_t) + chunks[i].data.size();
+            image.count += chunks[i].chunk->count;
+        }
+        next += image.chunkCount;
+        images.push_back(std::move(image));
+    }
+    auto write_index = [&](uint64_t offset) {
+        std::vector<char> index;
+        serializer_t is{ &index, &image_writer_serializer };
+        for (auto& image : images)
+        {
+            serialize_type(image.group->type, is, true);
+            is.archive(offset);
+            is.archive(image.size);
+            is.archive(image.count);
+            offset += image.size;
+        }
+        return index;
+    };
+    // size of index does not depend on offsets written in it
+    uint64_t indexSize = write_index(0).size();
+    uint64_t offset = sizeof(image_header_t) + sizeof(uint64_t) + indexSize + sizeof(EIndex) * header.freeCount;
+    auto index = write_index(offset);
+    s.archive(header);
+    s.archive(indexSize);
+    s.archive(index.data(), (uint32_t)index.size());
+    s.archive(entities.freeEntries.data(), header.freeCount);
+    for (auto& image : images)
+    {
+        s.archive(image.head.data(), (uint32_t)image.head.size());
+        forloop (i, image.firstChunk, image.firstChunk + image.chunkCount)
+        {
+            auto& data = chunks[i].data;
+            s.archive((uint64_t)data.size());
+            s.archive(data.data(), (uint32_t)data.size());
+            std::vector<char>().swap(data);
+        }
+    }
+}
+
+bool dual_storage_t::deserialize_image_chunk(const dual_chunk_view_t& view, dual::image_reader_t& reader, uint32_t version)
+{
+    using namespace dual;
+    serializer_t s{ &reader, &image_reader_serializer };
+    auto chunk = view.chunk;
+    auto archetype = chunk->type;
+    // rows are already allocated, they are left constructed and unbound so storage can be reset
+    auto reject = [&] {
+        std::fill((dual_entity_t*)chunk->get_entities() + view.start, (dual_entity_t*)chunk->get_entities() + view.start + view.count, kEntityNull);
+        construct_view(view);
+        return false;
+    };
+    EIndex count = 0;
+    reader.read(count);
+    auto ents = (const dual_entity_t*)reader.take(sizeof(dual_entity_t) * count);
+    if (!ents || count != view.count)
+        return reject();
+    forloop (k, 0, count)
+        if (e_id(ents[k]) >= entities.entries.size())
+            return reject();
+    std::memcpy((dual_entity_t*)chunk->get_entities() + view.start, ents, sizeof(dual_entity_t) * count);
+    auto offsets = archetype->offsets[chunk->pt];
+    forloop (i, 0, archetype->type.length)
+    {
+        type_index_t t = archetype->type.data[i];
+        auto csize = archetype->sizes[i];
+        if (archetype->callbacks[i].serialize)
+        {
+            serialize_impl(view, t, offsets[i], csize, archetype->elemSizes[i], s, archetype->callbacks[i].serialize);
+            continue;
+        }
+        auto fieldCount = archetype->fieldCounts[i];
+        auto fieldSize = csize / fieldCount;
+        char* column = chunk->data() + offsets[i] + (size_t)fieldSize * view.start;
+        uint64_t address = 0;
+        if (t.is_buffer() && version < 4)
+            reader.read(address);
+        forloop (f, 0, fieldCount)
+            reader.read(column + f * archetype->field_stride(i, chunk->pt), (size_t)fieldSize * count);
+        if (!t.is_buffer())
+            continue;
+        if (reader.failed)
+        {
+            // leave valid empty arrays behind so storage can be reset
+            forloop (k, 0, count)
+            {
+                auto array = (dual_array_component_t*)(column + (size_t)k * csize);
+                array->BeginX = array->EndX = (char*)(array + 1);
+                array->CapacityX = (char*)array + csize;
+            }
+            continue;
+        }
+        // relocate arrays, inline ones move with column and outgrown ones are copied to heap
+        forloop (k, 0, count)
+        {
+            auto array = (dual_array_component_t*)(column + (size_t)k * csize);
+            uintptr_t oldArray = version < 4 ? (uintptr_t)address + (size_t)k * csize : 0;
+            bool isInline = version < 4 ? array_inline(array, oldArray, csize) : array->BeginX != nullptr;
+            if (isInline)
+            {
+                auto begin = (uintptr_t)array->BeginX - oldArray;
+                auto end = (uintptr_t)array->EndX - oldArray;
+                if (end < begin || end > csize)
+                    begin = end = sizeof(dual_array_component_t);
+                array->BeginX = (char*)array + begin;
+                array->EndX = (char*)array + end;
+                array->CapacityX = (char*)array + csize;
+                continue;
+            }
+            uint32_t length = 0;
+            reader.read(length);
+            auto elements = reader.take(length);
+            if (!elements)
+            {
+                array->BeginX = array->EndX = (char*)(array + 1);
+                array->CapacityX = (char*)array + csize;
+                continue;
+            }
+            array->BeginX = llvm_vecsmall::SmallVectorBase::allocate(length);
+            array->CapacityX = array->EndX = (char*)array->BeginX + length;
+            std::memcpy(array->BeginX, elements, length);
+        }
+    }
+    forloop (k, 0, count)
+    {
+        entity_registry_t::entry_t entry;
+        entry.chunk = chunk;
+        entry.indexInChunk = k + view.start;
+        entry.version = e_version(ents[k]);
+        entities.entries[e_id(ents[k])] = entry;
+    }
+    return !reader.failed;
+}
+
+bool dual_storage_t::read_image_group(dual::image_reader_t& reader, uint32_t version, std::vector<dual::image_chunk_t>& chunks)
+{
+    using namespace dual;
+    serializer_t s{ &reader, &image_reader_serializer };
+    fixed_stack_scope_t _(localStack);
+    auto type = deserialize_type(localStack, s, true);
+    if (reader.failed)
+        return false;
+    auto group = get_group(type);
+    if (!group)
+        return false;
+    auto archetype = group->archetype;
+    // layout of components should not change since image is saved
+    auto sizes = (const uint32_t*)reader.take(sizeof(uint32_t) * archetype->type.length);
+    if (!sizes || std::memcmp(sizes, archetype->sizes, sizeof(uint32_t) * archetype->type.length) != 0)
+        return false;
+    if (scheduler)
+        scheduler->sync_archetype(archetype);
+    uint32_t chunkCount = 0;
+    reader.read(chunkCount);
+    forloop (j, 0, chunkCount)
+    {
+        image_reader_t chunkReader = reader;
+        if (version >= 2)
+        {
+            uint64_t bytes = 0;
+            reader.read(bytes);
+            auto chunkData = reader.take(bytes);
+            chunkReader = { chunkData, (size_t)bytes, 0, chunkData == nullptr };
+        }
+        EIndex count = 0;
+        chunkReader.peek(&count, sizeof(EIndex));
+        if (chunkReader.failed || count == 0 || count > archetype->chunkCapacity[PT_large])
+            return false;
+        auto view = allocate_view_strict(group, count);
+        if (version >= 2)
+        {
+            chunks.push_back({ view, chunkReader, version, false });
+            continue;
+        }
+        // version 1 is parsed in place
+        bool succeed = deserialize_image_chunk(view, chunkReader, version);
+        reader = chunkReader;
+        if (!succeed)
+            return false;
+    }
+    return !reader.failed;
+}
+
+bool dual_storage_t::load_image_chunks(std::vector<dual::image_chunk_t>& chunks)
+{
+    using namespace dual;
+    size_t entityCount = 0;
+    for (auto& image : chunks)
+        entityCount += image.view.count;
+    if (auto workers = image_scheduler(entityCount))
+        for_each_batch_parallel(workers, chunks, [&](image_chunk_t& image) {
+            image.loaded = deserialize_image_chunk(image.view, image.reader, image.version);
+        });
+    else
+        for (auto& image : chunks)
+            image.loaded = deserialize_image_chunk(image.view, image.reader, image.version);
+    bool succeed = true;
+    for (auto& image : chunks)
+        succeed &= image.loaded;
+    return succeed;
+}
+
+bool dual_storage_t::deserialize_image(const char* data, size_t size)
+{
+    using namespace dual;
+    if (scheduler)
+    {
+        SKR_ASSERT(scheduler->is_main_thread(this));
+        scheduler->sync_storage(this);
+    }
+    image_reader_t reader{ data, size, 0, false };
+    image_header_t header;
+    image_reader_t index;
+    if (!read_image_index(reader, header, index))
+        return false;
+    auto freeIds = (const EIndex*)reader.take(sizeof(EIndex) * header.freeCount);
+    if (reader.failed)
+        return false;
+    entities.entries.resize(header.entryCount);
+    entities.highWater = header.entryCount;
+    entities.freeEntries.resize(header.freeCount);
+    std::memcpy(entities.freeEntries.data(), freeIds, sizeof(EIndex) * header.freeCount);
+    // chunks are allocated on main thread, sized chunks are filled afterwards and can be filled in parallel
+    std::vector<image_chunk_t> chunks;
+    bool succeed = true;
+    serializer_t is{ &index, &image_reader_serializer };
+    forloop (g, 0, header.groupCount)
+    {
+        if (header.version < 3)
+        {
+            if (!(succeed = read_image_group(reader, header.version, chunks)))
+                break;
+            continue;
+        }
+        // groups are located by index, type in index is skipped
+        {
+            fixed_stack_scope_t _(localStack);
+            deserialize_type(localStack, is, true);
+        }
+        uint64_t offset = 0, bytes = 0;
+        EIndex count = 0;
+        index.read(offset);
+        index.read(bytes);
+        index.read(count);
+        if (index.failed || offset > size || size - offset < bytes)
+        {
+            succeed = false;
+            break;
+        }
+        image_reader_t section{ data + offset, (size_t)bytes, 0, false };
+        if (!(succeed = read_image_group(section, header.version, chunks)))
+            break;
+    }
+    succeed &= load_image_chunks(chunks);
+    return succeed && !reader.failed;
+}
+
+bool dual_storage_t::load_image_section(const char* indexData, size_t indexSize, const char* data, size_t size)
+{
+    using namespace dual;
+    if (scheduler)
+        SKR_ASSERT(scheduler->is_main_thread(this));
+    image_reader_t reader{ indexData, indexSize, 0, false };
+    image_header_t header;
+    image_reader_t index;
+    if (!read_image_index(reader, header, index) || header.version < 3)
+        return false;
+    // ids are kept as in image, so entities of other sections can be loaded later
+    if (entities.entries.size() < header.entryCount)
+    {
+        entities.entries.resize(header.entryCount);
+        entities.highWater = header.entryCount;
+    }
+    std::vector<image_chunk_t> chunks;
+    image_reader_t section{ data, size, 0, false };
+    bool succeed = read_image_group(section, header.version, chunks);
+    succeed &= load_image_chunks(chunks);
+    return succeed;
+}
+
+size_t dual::image_index_size(const char* data, size_t size)
+{
+    image_header_t header;
+    const size_t prefix = sizeof(image_header_t) + sizeof(uint64_t);
+    if (size < prefix)
+        return prefix;
+    std::memcpy(&header, data, sizeof(image_header_t));
+    if (!valid_image_header(header) || header.version < 3)
+        return 0;
+    uint64_t bytes = 0;
+    std::memcpy(&bytes, data + sizeof(image_header_t), sizeof(uint64_t));
+    return prefix + (size_t)bytes;
+}
+
+uint32_t dual::select_image_sections(const char* data, size_t size, const dual_filter_t* filter, const dual_meta_filter_t* meta, dual_image_section_t* sections, uint32_t capacity)
+{
+    image_reader_t reader{ data, size, 0, false };
+    image_header_t header;
+    image_reader_t index;
+    if (!read_image_index(reader, header, index) || header.version < 3)
+        return 0;
+    serializer_t s{ &index, &image_reader_serializer };
+    uint32_t count = 0;
+    forloop (g, 0, header.groupCount)
+    {
+        fixed_stack_scope_t _(localStack);
+        auto type = dual_storage_t::deserialize_type(localStack, s, true);
+        dual_image_section_t section;
+        index.read(section.offset);
+        index.read(section.size);
+        index.read(section.entityCount);
+        if (index.failed)
+            break;
+        if (!match_image_group(type, filter))
+            continue;
+        if (meta && !match_group_meta(type, *meta))
+            continue;
+        if (count < capacity)
+            sections[count] = section;
+        ++count;
+    }
+    return count;
+}
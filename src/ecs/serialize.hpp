@@ -32,4 +32,35 @@ namespace dual
             archive((void*)data, sizeof(T) * size);
         }
     };
+
+    // reads chunk image in place, a failed read leaves reader failed and fills nothing
+    struct image_reader_t
+    {
+        const char* data;
+        size_t size;
+        size_t offset;
+        bool failed;
+        const char* take(size_t bytes);
+        void read(void* dst, size_t bytes);
+        void peek(void* dst, size_t bytes);
+        template<class T>
+        void read(T& value)
+        {
+            read(&value, sizeof(T));
+        }
+    };
+
+    // chunk allocated while reading image, filled later from its record
+    struct image_chunk_t
+    {
+        dual_chunk_view_t view;
+        image_reader_t reader;
+        uint32_t version;
+        bool loaded;
+        EIndex count() const { return view.count; }
+    };
+
+    // size of image prefix holding group index, see dualS_image_index_size
+    size_t image_index_size(const char* data, size_t size);
+    uint32_t select_image_sections(const char* index, size_t size, const dual_filter_t* filter, const dual_meta_filter_t* meta, dual_image_section_t* sections, uint32_t capacity);
 }
\ No newline at end of file
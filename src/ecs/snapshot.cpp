@@ -0,0 +1,181 @@
+#include "ecs/dual.h"
+#include "ecs/constants.hpp"
+#include "archetype.hpp"
+#include "chunk.hpp"
+#include "chunk_view.hpp"
+#include "query.hpp"
+#include "scheduler.hpp"
+#include "set.hpp"
+#include "snapshot.hpp"
+#include "storage.hpp"
+#include <algorithm>
+#include <thread>
+
+dual_snapshot_t::~dual_snapshot_t()
+{
+    using namespace dual;
+    forloop (i, 0, chunkCount)
+    {
+        auto copy = chunks[i].copy.load(std::memory_order_relaxed);
+        if (!copy)
+            continue;
+        destruct_view({ copy, 0, copy->count });
+        dual_chunk_t::destroy(copy);
+    }
+}
+
+void dual_snapshot_t::query(const dual_filter_t& filter, const dual_meta_filter_t& meta, dual_view_callback_t callback, void* u)
+{
+    using namespace dual;
+    bool includeDead = false;
+    bool includeDisabled = false;
+    forloop (i, 0, filter.all.length)
+    {
+        if (filter.all.data[i] == kDeadComponent)
+            includeDead = true;
+        else if (filter.all.data[i] == kDisableComponent)
+            includeDisabled = true;
+    }
+    bool filterMeta = (meta.all_meta.length + meta.any_meta.length + meta.none_meta.length) != 0;
+    for (auto& g : groups)
+    {
+        if (includeDead < g.isDead)
+            continue;
+        if (includeDisabled < g.disabled)
+            continue;
+        if (!match_group_type(g.type, filter, g.withMask))
+            continue;
+        if (filterMeta && !match_group_meta(g.type, meta))
+            continue;
+        forloop (i, g.firstChunk, g.firstChunk + g.chunkCount)
+        {
+            auto& c = chunks[i];
+            auto chunk = c.copy.load(std::memory_order_acquire);
+            if (!chunk)
+            {
+                // pin shared chunk, storage copies it under the same lock before changing it
+                skr_acquire_mutex(&storage->snapshotMutex.mMutex);
+                chunk = c.copy.load(std::memory_order_relaxed);
+                if (!chunk)
+                {
+                    chunk = c.chunk;
+                    c.readers.fetch_add(1, std::memory_order_relaxed);
+                }
+                skr_release_mutex(&storage->snapshotMutex.mMutex);
+            }
+            dual_chunk_view_t view{ chunk, 0, c.count };
+            callback(u, &view);
+            if (chunk == c.chunk)
+                c.readers.fetch_sub(1, std::memory_order_release);
+        }
+    }
+}
+
+dual_snapshot_t* dual_storage_t::snapshot()
+{
+    using namespace dual;
+    if (scheduler)
+    {
+        SKR_ASSERT(scheduler->is_main_thread(this));
+        scheduler->sync_storage(this);
+    }
+    auto result = new dual_snapshot_t;
+    result->storage = this;
+    size_t typeSize = 0;
+    uint32_t chunkCount = 0;
+    for (auto& pair : groups)
+    {
+        typeSize += data_size(pair.second->type);
+        for (auto c = pair.second->firstChunk; c; c = c->next)
+            ++chunkCount;
+    }
+    result->typeData.reset(new char[typeSize]);
+    result->chunks.reset(new dual_snapshot_t::chunk_t[chunkCount]);
+    result->chunkCount = chunkCount;
+    result->index.reserve(chunkCount);
+    result->groups.reserve(groups.size());
+    char* buffer = result->typeData.get();
+    uint32_t i = 0;
+    for (auto& pair : groups)
+    {
+        auto group = pair.second;
+        if (!group->firstChunk)
+            continue;
+        dual_snapshot_t::group_t g;
+        g.type = clone(group->type, buffer);
+        g.isDead = group->isDead;
+        g.disabled = group->disabled;
+        g.withMask = group->archetype->withMask;
+        g.firstChunk = i;
+        for (auto c = group->firstChunk; c; c = c->next)
+        {
+            auto& entry = result->chunks[i];
+            entry.chunk = c;
+            entry.count = c->count;
+            result->index.insert({ c, i });
+            ++i;
+        }
+        g.chunkCount = i - g.firstChunk;
+        result->groups.push_back(g);
+    }
+    skr_acquire_mutex(&snapshotMutex.mMutex);
+    // chunks with older serial are shared with this snapshot
+    result->serial = ++snapshotSerial;
+    snapshots.push_back(result);
+    skr_release_mutex(&snapshotMutex.mMutex);
+    return result;
+}
+
+void dual_storage_t::release(dual_snapshot_t* snapshot)
+{
+    skr_acquire_mutex(&snapshotMutex.mMutex);
+    auto iter = std::find(snapshots.begin(), snapshots.end(), snapshot);
+    SKR_ASSERT(iter != snapshots.end());
+    snapshots.erase(iter);
+    skr_release_mutex(&snapshotMutex.mMutex);
+    delete snapshot;
+}
+
+void dual_storage_t::preserve_shared(dual_chunk_t* chunk)
+{
+    using namespace dual;
+    skr_acquire_mutex(&snapshotMutex.mMutex);
+    uint32_t serial = chunk->snapshotSerial.load(std::memory_order_relaxed);
+    for (auto snapshot : snapshots)
+    {
+        if (snapshot->serial <= serial)
+            continue;
+        auto iter = snapshot->index.find(chunk);
+        if (iter == snapshot->index.end())
+            continue;
+        auto& entry = snapshot->chunks[iter->second];
+        if (entry.copy.load(std::memory_order_relaxed))
+            continue;
+        auto copy = dual_chunk_t::create(chunk->pt);
+        clone_view(copy, chunk, entry.count);
+        entry.copy.store(copy, std::memory_order_release);
+        // readers pinned the chunk before the copy is published
+        while (entry.readers.load(std::memory_order_acquire) != 0)
+            std::this_thread::yield();
+    }
+    chunk->snapshotSerial.store(snapshotSerial, std::memory_order_release);
+    skr_release_mutex(&snapshotMutex.mMutex);
+}
+
+extern "C" {
+dual_snapshot_t* dualS_snapshot(dual_storage_t* storage)
+{
+    return storage->snapshot();
+}
+
+void dualS_release_snapshot(dual_snapshot_t* snapshot)
+{
+    snapshot->storage->release(snapshot);
+}
+
+void dualS_query_snapshot(dual_snapshot_t* snapshot, const dual_filter_t* filter, const dual_meta_filter_t* meta, dual_view_callback_t callback, void* u)
+{
+    dual_meta_filter_t emptyMeta = {};
+    snapshot->query(*filter, meta ? *meta : emptyMeta, callback, u);
+}
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include "ecs/dual.h"
+#include "entity.hpp"
+#include "utils/hashmap.hpp"
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// read only view of storage at some point, chunks are shared until storage is about to change them
+struct dual_snapshot_t {
+    struct group_t {
+        // cloned since meta of live group can be remapped by pack_entities
+        dual_entity_type_t type;
+        // copied from group, readers never touch live groups which may be changed or destructed meanwhile
+        bool isDead;
+        bool disabled;
+        bool withMask;
+        uint32_t firstChunk;
+        uint32_t chunkCount;
+    };
+    struct chunk_t {
+        dual_chunk_t* chunk;
+        // private copy made by storage before it changes the chunk, readers switch to it once it is set
+        std::atomic<dual_chunk_t*> copy{ nullptr };
+        // readers of shared chunk, storage waits for them before it changes the chunk
+        std::atomic<uint32_t> readers{ 0 };
+        EIndex count;
+    };
+    dual_storage_t* storage;
+    uint32_t serial;
+    std::vector<group_t> groups;
+    std::unique_ptr<char[]> typeData;
+    std::unique_ptr<chunk_t[]> chunks;
+    uint32_t chunkCount;
+    skr::flat_hash_map<dual_chunk_t*, uint32_t> index;
+
+    ~dual_snapshot_t();
+    void query(const dual_filter_t& filter, const dual_meta_filter_t& meta, dual_view_callback_t callback, void* u);
+};
@@ -0,0 +1,198 @@
+#include "ecs/dual.h"
+#include "ecs/constants.hpp"
+#include "ecs/array.hpp"
+#include "archetype.hpp"
+#include "chunk.hpp"
+#include "storage.hpp"
+#include "type_registry.hpp"
+#include "tracy/Tracy.hpp"
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace dual
+{
+static size_t chunk_block_size(pool_type_t pt)
+{
+    switch (pt)
+    {
+        case PT_small:
+            return kSmallBinSize;
+        case PT_default:
+            return kFastBinSize;
+        case PT_large:
+            return kLargeBinSize;
+    }
+    return 0;
+}
+
+// accumulate usage of group, components is null or has one slot for each component of archetype
+static void collect_memory_stats(const dual_group_t* group, dual_memory_stats_t& stats, uint64_t& slots, dual_component_memory_t* components)
+{
+    auto type = group->archetype;
+    for (auto c = group->firstChunk; c; c = c->next)
+    {
+        stats.chunkCount[c->pt]++;
+        stats.chunkBytes += chunk_block_size(c->pt);
+        slots += c->get_capacity();
+        forloop (i, 0, type->type.length)
+        {
+            type_index_t t = type->type.data[i];
+            if (t.is_tag())
+                continue;
+            if (t.is_managed())
+                stats.managedCount += c->count;
+            if (components)
+                components[i].chunkBytes += (uint64_t)type->sizes[i] * c->count;
+            if (!t.is_buffer())
+                continue;
+            char* data = c->data() + type->offsets[c->pt][i];
+            forloop (j, 0, c->count)
+            {
+                auto array = (dual_array_component_t*)(data + (size_t)j * type->sizes[i]);
+                char* begin = (char*)array->BeginX;
+                // elements stay in chunk until they outgrow inline capacity
+                if (begin >= (char*)array && begin < (char*)array + type->sizes[i])
+                    continue;
+                uint64_t heap = (char*)array->CapacityX - begin;
+                stats.heapBytes += heap;
+                if (components)
+                    components[i].heapBytes += heap;
+            }
+        }
+    }
+    stats.entityCount += group->size;
+    stats.usedBytes += (uint64_t)group->size * type->entitySize;
+    stats.groupCount++;
+}
+
+static void finish_memory_stats(dual_memory_stats_t& stats, uint64_t slots)
+{
+    stats.fillRatio = slots ? (float)((double)stats.entityCount / (double)slots) : 0.f;
+}
+
+struct archetype_memory_t {
+    archetype_t* type;
+    dual_memory_stats_t memory;
+    uint64_t slots;
+    std::vector<dual_component_memory_t> components;
+};
+
+static std::vector<archetype_memory_t> collect_archetype_stats(dual_storage_t* storage)
+{
+    std::vector<archetype_memory_t> result;
+    skr::flat_hash_map<archetype_t*, size_t> indices;
+    for (auto& pair : storage->groups)
+    {
+        auto group = pair.second;
+        auto iter = indices.find(group->archetype);
+        if (iter == indices.end())
+        {
+            iter = indices.insert({ group->archetype, result.size() }).first;
+            auto& entry = result.emplace_back();
+            entry.type = group->archetype;
+            entry.memory = {};
+            entry.slots = 0;
+            entry.components.resize(group->archetype->type.length);
+            forloop (i, 0, group->archetype->type.length)
+                entry.components[i] = { group->archetype->type.data[i], 0, 0 };
+        }
+        auto& entry = result[iter->second];
+        collect_memory_stats(group, entry.memory, entry.slots, entry.components.data());
+    }
+    for (auto& entry : result)
+        finish_memory_stats(entry.memory, entry.slots);
+    std::sort(result.begin(), result.end(), [](const archetype_memory_t& lhs, const archetype_memory_t& rhs) {
+        return lhs.memory.chunkBytes > rhs.memory.chunkBytes;
+    });
+    return result;
+}
+
+#ifdef TRACY_ENABLE
+// tracy keeps pointer of plot name, names are kept until exit
+static const char* plot_name(std::string name, tracy::PlotFormatType format)
+{
+    static std::unordered_set<std::string> names;
+    auto result = names.insert(std::move(name));
+    if (result.second)
+        TracyPlotConfig(result.first->c_str(), format);
+    return result.first->c_str();
+}
+
+static std::string archetype_name(const archetype_t* type)
+{
+    auto& registry = type_registry_t::get();
+    std::string name = "[";
+    forloop (i, 0, type->type.length)
+    {
+        if (i != 0)
+            name += ",";
+        name += registry.descriptions[type_index_t(type->type.data[i]).index()].name;
+    }
+    name += "]";
+    return name;
+}
+#endif
+} // namespace dual
+
+extern "C" {
+void dualG_get_memory_stats(const dual_group_t* group, dual_memory_stats_t* stats)
+{
+    using namespace dual;
+    *stats = {};
+    uint64_t slots = 0;
+    collect_memory_stats(group, *stats, slots, nullptr);
+    finish_memory_stats(*stats, slots);
+}
+
+void dualS_get_memory_stats(dual_storage_t* storage, dual_memory_stats_t* stats)
+{
+    using namespace dual;
+    *stats = {};
+    uint64_t slots = 0;
+    for (auto& pair : storage->groups)
+        collect_memory_stats(pair.second, *stats, slots, nullptr);
+    finish_memory_stats(*stats, slots);
+}
+
+void dualS_get_archetype_stats(dual_storage_t* storage, dual_archetype_stats_callback_t callback, void* u)
+{
+    using namespace dual;
+    for (auto& entry : collect_archetype_stats(storage))
+    {
+        dual_archetype_stats_t stats;
+        stats.type = &entry.type->type;
+        stats.memory = entry.memory;
+        stats.components = entry.components.data();
+        callback(u, &stats);
+    }
+}
+
+void dualS_plot_memory_stats(dual_storage_t* storage, const char* name, uint32_t archetypeCount)
+{
+#ifdef TRACY_ENABLE
+    using namespace dual;
+    using tracy::PlotFormatType;
+    std::string prefix = name;
+    dual_memory_stats_t stats;
+    dualS_get_memory_stats(storage, &stats);
+    TracyPlot(plot_name(prefix + "/entities", PlotFormatType::Number), (int64_t)stats.entityCount);
+    TracyPlot(plot_name(prefix + "/chunk bytes", PlotFormatType::Memory), (int64_t)stats.chunkBytes);
+    TracyPlot(plot_name(prefix + "/heap bytes", PlotFormatType::Memory), (int64_t)stats.heapBytes);
+    TracyPlot(plot_name(prefix + "/fill", PlotFormatType::Percentage), stats.fillRatio * 100.f);
+    auto archetypes = collect_archetype_stats(storage);
+    if (archetypes.size() > archetypeCount)
+        archetypes.resize(archetypeCount);
+    for (auto& entry : archetypes)
+    {
+        auto typeName = prefix + "/" + archetype_name(entry.type);
+        TracyPlot(plot_name(typeName + " bytes", PlotFormatType::Memory), (int64_t)entry.memory.chunkBytes);
+        TracyPlot(plot_name(typeName + " fill", PlotFormatType::Percentage), entry.memory.fillRatio * 100.f);
+    }
+#else
+    (void)storage;
+    (void)name;
+    (void)archetypeCount;
+#endif
+}
+}
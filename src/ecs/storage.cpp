@@ -19,31 +19,100 @@ dual_storage_t::dual_storage_t()
     : arena(dual::get_default_pool())
     , queryBuildArena(dual::get_default_pool())
     , groupPool(dual::kGroupBlockSize, dual::kGroupBlockCount)
+    , timestamp(0)
+    , deltaTimestamp(0)
+    , deltaSynced(false)
+    , deltaFreeCursor(0)
+    , structureVersion(0)
     , scheduler(nullptr)
+    , snapshotSerial(0)
 {
 }
 
 dual_storage_t::~dual_storage_t()
 {
+    // snapshots share chunks and groups of storage
+    SKR_ASSERT(snapshots.empty());
     for (auto iter : groups)
+    {
         iter.second->clear();
+        iter.second->release_edges();
+    }
+    for (auto iter : archetypes)
+        dual::release_dependency_entries(iter.second);
 }
 
 void dual_storage_t::reset()
 {
+    SKR_ASSERT(snapshots.empty());
     for (auto iter : groups)
+    {
         iter.second->clear();
+        iter.second->release_edges();
+    }
+    for (auto iter : archetypes)
+        dual::release_dependency_entries(iter.second);
     groups.clear();
     archetypes.clear();
     queries.clear();
     queryCaches.clear();
     entities.reset();
+    deltaSynced = false;
+    ++structureVersion;
     arena.reset();
     queryBuildArena.reset();
     groupPool.reset();
 }
 
-void dual_storage_t::allocate(dual_group_t* group, EIndex count, dual_view_callback_t callback, void* u)
+namespace dual
+{
+static bool spawn_in_parallel(const scheduler_t* scheduler, size_t count)
+{
+    return scheduler && scheduler->scheduler && count >= kParallelSpawnThreshold;
+}
+
+// chunks are reserved on main thread, fill is called on workers with a part of a view and the index of its first entity
+template <class F>
+static void fill_views_parallel(scheduler_t* scheduler, const std::vector<dual_chunk_view_t>& views, const F& fill)
+{
+    struct batch_t {
+        const F* fill;
+        dual_chunk_view_t view;
+        EIndex offset;
+    };
+    std::vector<batch_t> batches;
+    EIndex offset = 0;
+    for (auto& view : views)
+    {
+        for (EIndex i = 0; i < view.count; i += (EIndex)kParallelSpawnBatch)
+            batches.push_back({ &fill, { view.chunk, view.start + i, std::min((EIndex)kParallelSpawnBatch, view.count - i) }, offset + i });
+        offset += view.count;
+    }
+    std::vector<ftl::Task> tasks(batches.size());
+    forloop (i, 0, batches.size())
+        tasks[i] = { +[](ftl::TaskScheduler*, void* data) {
+                        auto batch = (batch_t*)data;
+                        (*batch->fill)(batch->view, batch->offset);
+                    },
+            &batches[i] };
+    ftl::TaskCounter counter(scheduler->scheduler);
+    scheduler->scheduler->AddTasks((unsigned)tasks.size(), tasks.data(), ftl::TaskPriority::High, &counter);
+    scheduler->scheduler->WaitForCounter(&counter, true);
+}
+} // namespace dual
+
+std::vector<dual_chunk_view_t> dual_storage_t::reserve_views(dual_group_t* group, EIndex count)
+{
+    std::vector<dual_chunk_view_t> views;
+    while (count != 0)
+    {
+        views.push_back(allocate_view(group, count));
+        count -= views.back().count;
+    }
+    return views;
+}
+
+void dual_storage_t::allocate(dual_group_t* group, EIndex count, dual_view_callback_t callback, void* u, const dual_entity_t* reserved)
 {
     using namespace dual;
     if (scheduler)
@@ -51,11 +120,38 @@ void dual_storage_t::allocate(dual_group_t* group, EIndex count, dual_view_callb
         SKR_ASSERT(scheduler->is_main_thread(this));
         scheduler->sync_archetype(group->archetype);
     }
+    if (reserved)
+        entities.bind_reserved(count);
+    if (spawn_in_parallel(scheduler, count))
+    {
+        auto views = reserve_views(group, count);
+        std::vector<dual_entity_t> ents;
+        if (!reserved)
+        {
+            ents.resize(count);
+            entities.new_entities(ents.data(), count);
+            reserved = ents.data();
+        }
+        fill_views_parallel(scheduler, views, [&](const dual_chunk_view_t& v, EIndex offset) {
+            construct_view(v);
+            entities.fill_entities(v, reserved + offset);
+        });
+        if (callback)
+            for (auto& v : views)
+                callback(u, &v);
+        return;
+    }
     while (count != 0)
     {
         dual_chunk_view_t v = allocate_view(group, count);
         construct_view(v);
-        entities.fill_entities(v);
+        if (reserved)
+        {
+            entities.fill_entities(v, reserved);
+            reserved += v.count;
+        }
+        else
+            entities.fill_entities(v);
         count -= v.count;
         if (callback)
             callback(u, &v);
@@ -80,7 +176,12 @@ dual_chunk_view_t dual_storage_t::allocate_view_strict(dual_group_t* group, EInd
     while (freeChunk != nullptr && freeChunk->count + count > freeChunk->get_capacity())
         freeChunk = freeChunk->next;
     if (freeChunk == nullptr)
-        freeChunk = group->new_chunk(count);
+    {
+        // view should fit in one chunk, counts between default and large threshold would get a default chunk
+        auto defaultCapacity = group->archetype->chunkCapacity[dual::PT_default];
+        freeChunk = group->new_chunk(count > defaultCapacity ? std::max(count, defaultCapacity * 8u + 1) : count);
+    }
+    SKR_ASSERT(freeChunk->count + count <= freeChunk->get_capacity());
     EIndex start = freeChunk->count;
     group->resize_chunk(freeChunk, start + count);
     structural_change(group, freeChunk);
@@ -102,7 +203,9 @@ void dual_storage_t::destroy(const dual_chunk_view_t& view)
         cast(view, dead, nullptr, nullptr);
     else
     {
+        preserve(view.chunk);
         entities.free_entities(view);
+        destruct_view(view);
         free(view);
     }
 }
@@ -111,8 +214,8 @@ void dual_storage_t::free(const dual_chunk_view_t& view)
 {
     using namespace dual;
     auto group = view.chunk->group;
+    preserve(view.chunk);
     structural_change(group, view.chunk);
-    group->size -= view.count;
     uint32_t toMove = std::min(view.count, view.chunk->count - view.start - view.count);
     if (toMove > 0)
     {
@@ -120,11 +223,15 @@ void dual_storage_t::free(const dual_chunk_view_t& view)
         move_view(moveView, view.chunk->count - toMove);
         entities.move_entities(moveView, view.chunk->count - toMove);
     }
+    // chunk is released when it becomes empty
+    group->resize_chunk(view.chunk, view.chunk->count - view.count);
 }
 
 void dual_storage_t::structural_change(dual_group_t* group, dual_chunk_t* chunk)
 {
-    // todo: timestamp
+    // layout of chunk changed, treat all components as written
+    auto timestamps = chunk->timestamps();
+    std::fill(timestamps, timestamps + chunk->type->type.length, timestamp);
 }
 
 void dual_storage_t::linked_to_prefab(const dual_entity_t* src, uint32_t size, bool keepExternal)
@@ -153,7 +260,11 @@ void dual_storage_t::linked_to_prefab(const dual_entity_t* src, uint32_t size, b
     m.source = src;
     m.keepExternal = keepExternal;
     forloop (i, 0, size)
-        iterator_ref_view(entity_view(src[i]), m);
+    {
+        auto view = entity_view(src[i]);
+        preserve(view.chunk);
+        iterator_ref_view(view, m);
+    }
 }
 
 void dual_storage_t::prefab_to_linked(const dual_entity_t* src, uint32_t size)
@@ -175,7 +286,11 @@ void dual_storage_t::prefab_to_linked(const dual_entity_t* src, uint32_t size)
     m.count = size;
     m.source = src;
     forloop (i, 0, size)
-        iterator_ref_view(entity_view(src[i]), m);
+    {
+        auto view = entity_view(src[i]);
+        preserve(view.chunk);
+        iterator_ref_view(view, m);
+    }
 }
 
 void dual_storage_t::instantiate_prefab(const dual_entity_t* src, uint32_t size, uint32_t count, dual_view_callback_t callback, void* u)
@@ -198,6 +313,41 @@ void dual_storage_t::instantiate_prefab(const dual_entity_t* src, uint32_t size,
         }
     } m;
     m.size = size;
+    if (spawn_in_parallel(scheduler, (size_t)count * size))
+    {
+        // reserve chunks of all prefab entities first so that they are duplicated in one pass
+        struct prefab_t {
+            dual_chunk_view_t src;
+            std::vector<dual_chunk_view_t> views;
+            std::vector<dual_entity_t> ents;
+        };
+        std::vector<prefab_t> prefabs(size);
+        forloop (i, 0, size)
+        {
+            auto& prefab = prefabs[i];
+            prefab.src = entity_view(src[i]);
+            prefab.views = reserve_views(prefab.src.chunk->group->cloned, count);
+            prefab.ents.resize(count);
+            forloop (j, 0, count)
+                prefab.ents[j] = ents[j * size + i];
+        }
+        std::vector<dual_chunk_view_t> views;
+        for (auto& prefab : prefabs)
+            views.insert(views.end(), prefab.views.begin(), prefab.views.end());
+        fill_views_parallel(scheduler, views, [&](const dual_chunk_view_t& v, EIndex offset) {
+            auto& prefab = prefabs[offset / count];
+            EIndex localOffset = offset % count;
+            duplicate_view(v, prefab.src.chunk, prefab.src.start);
+            entities.fill_entities(v, prefab.ents.data() + localOffset);
+            mapper_t localMapper = m;
+            localMapper.base = localMapper.curr = ents.data() + (size_t)localOffset * size;
+            iterator_ref_view(v, localMapper);
+        });
+        if (callback)
+            for (auto& v : views)
+                callback(u, &v);
+        return;
+    }
     std::vector<dual_entity_t> localEnts;
     localEnts.resize(count);
     forloop (i, 0, size)
@@ -231,6 +381,20 @@ void dual_storage_t::instantiate(const dual_entity_t src, uint32_t count, dual_v
         SKR_ASSERT(scheduler->is_main_thread(this));
         scheduler->sync_archetype(group->archetype);
     }
+    if (spawn_in_parallel(scheduler, count))
+    {
+        auto views = reserve_views(group, count);
+        std::vector<dual_entity_t> ents(count);
+        entities.new_entities(ents.data(), count);
+        fill_views_parallel(scheduler, views, [&](const dual_chunk_view_t& v, EIndex offset) {
+            duplicate_view(v, view.chunk, view.start);
+            entities.fill_entities(v, ents.data() + offset);
+        });
+        if (callback)
+            for (auto& v : views)
+                callback(u, &v);
+        return;
+    }
     while (count != 0)
     {
         dual_chunk_view_t v = allocate_view(group, count);
@@ -283,7 +447,8 @@ bool dual_storage_t::components_enabled(const dual_entity_t src, const dual_type
 bool dual_storage_t::exist(dual_entity_t e) const noexcept
 {
     using namespace dual;
-    return entities.entries.size() > e_id(e) && entities.entries[e_id(e)].version == e_version(e);
+    // reserved entities exist after they are bound to chunk
+    return entities.entries.size() > e_id(e) && entities.entries[e_id(e)].version == e_version(e) && entities.entries[e_id(e)].chunk != nullptr;
 }
 
 void dual_storage_t::validate_meta()
@@ -364,12 +529,18 @@ void dual_storage_t::defragment()
         // step 2 : grab and sort existing chunk for reuse
         std::vector<dual_chunk_t*> chunks;
         for (dual_chunk_t* c = g->firstChunk; c; c = c->next)
+        {
+            preserve(c);
             chunks.push_back(c);
+        }
 
-        g->firstChunk = g->lastChunk = nullptr;
+        g->firstChunk = g->lastChunk = g->firstFree = nullptr;
         g->chunkCount = 0;
+        g->size = 0;
         std::sort(chunks.begin(), chunks.end(), [](dual_chunk_t* lhs, dual_chunk_t* rhs) {
-            return lhs->pt > rhs->pt || lhs->count > rhs->count;
+            if (lhs->pt != rhs->pt)
+                return lhs->pt > rhs->pt;
+            return lhs->count > rhs->count;
         });
 
         // step 3 : reaverage data into new layout
@@ -406,7 +577,11 @@ void dual_storage_t::defragment()
                     ++o;
                 }
                 else // or create new chunk
-                    newChunks.push_back(dual_chunk_t::create(type));
+                {
+                    auto chunk = dual_chunk_t::create(type);
+                    chunk->type = arch;
+                    newChunks.push_back(chunk);
+                }
                 fillChunk(newChunks.back());
             }
         };
@@ -415,10 +590,176 @@ void dual_storage_t::defragment()
         fillType(smallCount, PT_small);
 
         // step 4 : rebuild group chunk data
-        g->chunkCount = (uint16_t)newChunks.size();
         for (auto chunk : newChunks)
+        {
+            chunk->next = chunk->prev = nullptr;
             g->add_chunk(chunk);
+        }
+    }
+}
+
+namespace dual
+{
+struct defrag_budget_t {
+    // zero means unlimited
+    uint64_t deadline;
+    uint64_t byteBudget;
+    std::atomic<uint64_t> movedBytes;
+    std::atomic<uint32_t> freedChunks;
+    std::atomic<uint32_t> compactedGroups;
+    bool exhausted() const
+    {
+        if (byteBudget != 0 && movedBytes.load(std::memory_order_relaxed) >= byteBudget)
+            return true;
+        return deadline != 0 && clock_ns() >= deadline;
+    }
+};
+
+// move entities from the emptiest free chunks into the fullest ones, full chunks are never touched
+// every step leaves the group consistent, so it can stop at any time when budget runs out
+static void compact_group(dual_storage_t* storage, dual_group_t* group, defrag_budget_t& budget)
+{
+    llvm_vecsmall::SmallVector<dual_chunk_t*, 16> chunks;
+    for (auto c = group->firstFree; c; c = c->next)
+        chunks.push_back(c);
+    // nothing to move between, group is already compact
+    if (chunks.size() < 2)
+    {
+        budget.compactedGroups.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    std::sort(chunks.begin(), chunks.end(), [](dual_chunk_t* lhs, dual_chunk_t* rhs) {
+        if (lhs->pt != rhs->pt)
+            return lhs->pt > rhs->pt;
+        return lhs->count > rhs->count;
+    });
+    const uint32_t entitySize = group->archetype->entitySize;
+    size_t o = 0;
+    size_t j = chunks.size() - 1;
+    while (o < j)
+    {
+        if (budget.exhausted())
+            return;
+        auto target = chunks[o];
+        auto source = chunks[j];
+        storage->preserve(source);
+        EIndex moveCount = std::min(target->get_capacity() - target->count, source->count);
+        dual_chunk_view_t dst = { target, target->count, moveCount };
+        move_view(dst, source, source->count - moveCount);
+        storage->entities.move_entities(dst, source, source->count - moveCount);
+        storage->structural_change(group, target);
+        bool drained = source->count == moveCount;
+        group->resize_chunk(target, target->count + moveCount);
+        group->resize_chunk(source, source->count - moveCount);
+        budget.movedBytes.fetch_add((uint64_t)moveCount * entitySize, std::memory_order_relaxed);
+        if (drained)
+        {
+            budget.freedChunks.fetch_add(1, std::memory_order_relaxed);
+            --j;
+        }
+        if (target->count == target->get_capacity())
+            ++o;
     }
+    budget.compactedGroups.fetch_add(1, std::memory_order_relaxed);
+}
+} // namespace dual
+
+void dual_storage_t::defragment_incremental(const dual_defrag_options_t& options, dual_defrag_stats_t* stats)
+{
+    using namespace dual;
+    uint64_t start = clock_ns();
+    if (scheduler)
+        SKR_ASSERT(scheduler->is_main_thread(this));
+    // free chunks are linked after firstFree, waste is the empty slots of them
+    auto get_waste = [](dual_group_t* g, uint32_t& freeCount) {
+        uint64_t waste = 0;
+        freeCount = 0;
+        for (auto c = g->firstFree; c; c = c->next)
+        {
+            ++freeCount;
+            waste += c->get_capacity() - c->count;
+        }
+        return waste;
+    };
+    struct candidate_t {
+        dual_group_t* group;
+        uint64_t waste;
+    };
+    std::vector<candidate_t> candidates;
+    for (auto& pair : groups)
+    {
+        auto g = pair.second;
+        uint32_t freeCount;
+        uint64_t waste = get_waste(g, freeCount);
+        if (freeCount < 2)
+            continue;
+        // groups accessed by scheduled jobs are left for later calls instead of waiting
+        if (scheduler && scheduler->is_archetype_busy(g->archetype))
+            continue;
+        candidates.push_back({ g, waste * g->archetype->entitySize });
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const candidate_t& lhs, const candidate_t& rhs) {
+        return lhs.waste > rhs.waste;
+    });
+
+    defrag_budget_t budget;
+    budget.deadline = options.timeBudget ? start + options.timeBudget : 0;
+    budget.byteBudget = options.byteBudget;
+    budget.movedBytes = 0;
+    budget.freedChunks = 0;
+    budget.compactedGroups = 0;
+    if (options.parallel && scheduler && candidates.size() > 1)
+    {
+        // groups share no chunk and no entity, compact them on workers while main thread waits
+        struct payload_t {
+            dual_storage_t* storage;
+            dual_group_t* group;
+            defrag_budget_t* budget;
+        };
+        std::vector<payload_t> payloads(candidates.size());
+        std::vector<ftl::Task> tasks(candidates.size());
+        forloop (i, 0, candidates.size())
+        {
+            payloads[i] = { this, candidates[i].group, &budget };
+            tasks[i] = { +[](ftl::TaskScheduler*, void* data) {
+                            auto payload = (payload_t*)data;
+                            if (!payload->budget->exhausted())
+                                compact_group(payload->storage, payload->group, *payload->budget);
+                        },
+                &payloads[i] };
+        }
+        ftl::TaskCounter counter(scheduler->scheduler);
+        scheduler->scheduler->AddTasks((unsigned)tasks.size(), tasks.data(), ftl::TaskPriority::Normal, &counter);
+        scheduler->scheduler->WaitForCounter(&counter, true);
+    }
+    else
+    {
+        for (auto& candidate : candidates)
+        {
+            if (budget.exhausted())
+                break;
+            compact_group(this, candidate.group, budget);
+        }
+    }
+
+    if (!stats)
+        return;
+    uint64_t size = 0;
+    uint64_t waste = 0;
+    stats->pendingGroups = 0;
+    for (auto& pair : groups)
+    {
+        uint32_t freeCount;
+        waste += get_waste(pair.second, freeCount);
+        size += pair.second->size;
+        if (freeCount >= 2)
+            ++stats->pendingGroups;
+    }
+    stats->compactedGroups = budget.compactedGroups;
+    stats->freedChunks = budget.freedChunks;
+    stats->movedBytes = budget.movedBytes;
+    stats->occupancy = size + waste ? (float)((double)size / (double)(size + waste)) : 1.f;
+    stats->time = clock_ns() - start;
 }
 
 void dual_storage_t::pack_entities()
@@ -429,14 +770,21 @@ void dual_storage_t::pack_entities()
         SKR_ASSERT(scheduler->is_main_thread(this));
         scheduler->sync_storage(this);
     }
+    // reserved ids can not be moved
+    SKR_ASSERT(entities.pendingCount.load() == 0);
+    entities.reclaim_shared();
+    // ids of dead entities, kEntityNull does not fit in EIndex with 64 bit entities
+    static constexpr EIndex kDeadId = std::numeric_limits<EIndex>::max();
     std::vector<EIndex> map;
     auto& entries = entities.entries;
-    map.resize(entries.size());
+    map.resize(entries.size(), kDeadId);
     entities.freeEntries.clear();
+    // logged ids are renumbered away
+    entities.drop_free_log();
     EIndex j = 0;
     forloop (i, 0, entries.size())
     {
-        if (entries[i].indexInChunk != 0)
+        if (entries[i].chunk != nullptr)
         {
             map[i] = j;
             if (i != j)
@@ -444,14 +792,19 @@ void dual_storage_t::pack_entities()
             j++;
         }
     }
+    entries.resize(j);
+    entities.highWater = j;
     struct mapper {
         std::vector<EIndex>* data;
         void move() {}
         void reset() {}
         void map(dual_entity_t& e)
         {
-            if (e_id(e) < data->size())
-                e = e_id(e, (*data)[e_id(e)]);
+            if (e_id(e) >= data->size())
+                return;
+            // references to dead entities are cleared
+            EIndex id = (*data)[e_id(e)];
+            e = id == kDeadId ? kEntityNull : e_id(e, id);
         }
     } m;
     m.data = &map;
@@ -462,7 +815,13 @@ void dual_storage_t::pack_entities()
     for (auto g : gs)
     {
         for (dual_chunk_t* c = g->firstChunk; c; c = c->next)
+        {
+            preserve(c);
+            auto ents = (dual_entity_t*)c->get_entities();
+            forloop (k, 0, c->count)
+                m.map(ents[k]);
             iterator_ref_view({ c, 0, c->count }, m);
+        }
         auto meta = g->type.meta;
         forloop (i, 0, meta.length)
             m.map(((dual_entity_t*)meta.data)[i]);
@@ -474,6 +833,7 @@ void dual_storage_t::pack_entities()
 void dual_storage_t::cast_impl(const dual_chunk_view_t& view, dual_group_t* group, dual_cast_callback_t callback, void* u)
 {
     using namespace dual;
+    preserve(view.chunk);
     uint32_t k = 0;
     while (k < view.count)
     {
@@ -508,9 +868,10 @@ void dual_storage_t::cast(const dual_chunk_view_t& view, dual_group_t* group, du
     {
         srcGroup->remove_chunk(view.chunk);
         group->add_chunk(view.chunk);
+        structural_change(group, view.chunk);
         return;
     }
-    if (srcGroup->archetype != group->archetype)
+    if (scheduler && srcGroup->archetype != group->archetype)
         scheduler->sync_archetype(group->archetype);
     cast_impl(view, group, callback, u);
 }
@@ -518,6 +879,9 @@ void dual_storage_t::cast(const dual_chunk_view_t& view, dual_group_t* group, du
 dual_group_t* dual_storage_t::cast(dual_group_t* srcGroup, const dual_delta_type_t& diff)
 {
     using namespace dual;
+    dual_group_t* target;
+    if (srcGroup->find_edge(diff, target))
+        return target;
     fixed_stack_scope_t _(localStack);
     dual_entity_type_t type = srcGroup->type;
     dual_entity_type_t final;
@@ -543,7 +907,9 @@ dual_group_t* dual_storage_t::cast(dual_group_t* srcGroup, const dual_delta_type
         auto finalMeta = localStack.allocate<dual_entity_t>(type.meta.length + diff.added.meta.length);
         final.meta = set_utils<dual_entity_t>::substract(final.meta, diff.removed.meta, finalMeta);
     }
-    return get_group(final);
+    target = get_group(final);
+    srcGroup->add_edge(diff, target);
+    return target;
 }
 
 void dual_storage_t::batch(const dual_entity_t* ents, EIndex count, dual_view_callback_t callback, void* u)
@@ -565,120 +931,213 @@ void dual_storage_t::batch(const dual_entity_t* ents, EIndex count, dual_view_ca
     callback(u, &view);
 }
 
+namespace dual
+{
+// references are remapped by table lookup without branches, compilers vectorize remap with gathers where available
+// expected holds alive entities of source by id and null entity at count, so dead, stale or null references become null
+struct entity_remap_t {
+    const dual_entity_t* expected;
+    const dual_entity_t* mapped;
+    dual_entity_t count;
+
+    DUAL_FORCEINLINE dual_entity_t operator()(dual_entity_t e) const
+    {
+        dual_entity_t id = std::min(e_id(e), count);
+        return expected[id] == e ? mapped[id] : kEntityNull;
+    }
+    void remap(dual_entity_t* ents, EIndex n) const
+    {
+        forloop (i, 0, n)
+            ents[i] = (*this)(ents[i]);
+    }
+    // shared by remap tasks, so mapper interface is const
+    void map(dual_entity_t& e) const { e = (*this)(e); }
+    void move() const {}
+    void reset() const {}
+};
+
+// components which are a single entity are remapped column by column
+static bool plain_entity_type(type_index_t type)
+{
+    if (type.is_buffer())
+        return false;
+    auto& reg = type_registry_t::get();
+    auto& desc = reg.descriptions[type.index()];
+    return !desc.callback.map && desc.size == sizeof(dual_entity_t) && desc.entityFieldsCount == 1 && reg.entityFields[desc.entityFields] == 0;
+}
+
+static bool same_layout(const archetype_t* a, const archetype_t* b)
+{
+    if (a == b)
+        return true;
+    if (a->entitySize != b->entitySize || a->type.length != b->type.length)
+        return false;
+    forloop (i, 0, 3)
+        if (a->chunkCapacity[i] != b->chunkCapacity[i] || std::memcmp(a->offsets[i], b->offsets[i], sizeof(uint32_t) * a->type.length) != 0)
+            return false;
+    return true;
+}
+} // namespace dual
+
 void dual_storage_t::merge(dual_storage_t& src)
 {
     using namespace dual;
     if (scheduler)
-    {
         SKR_ASSERT(scheduler->is_main_thread(this));
-        scheduler->sync_storage(&src);
-    }
+    if (src.scheduler)
+        src.scheduler->sync_storage(&src);
+    // chunks and groups of source are taken over
+    SKR_ASSERT(src.snapshots.empty());
     auto& sents = src.entities;
-    std::vector<dual_entity_t> map;
-    map.resize(sents.entries.size());
+    SKR_ASSERT(sents.pendingCount.load() == 0);
+    const EIndex entryCount = (EIndex)sents.entries.size();
+    std::vector<dual_entity_t> expected, mapped;
+    expected.resize(entryCount + 1, kEntityNull);
+    mapped.resize(entryCount + 1, kEntityNull);
     EIndex moveCount = 0;
     for (auto& e : sents.entries)
         if (e.chunk != nullptr)
             moveCount++;
+    // ids are allocated at once, entries are filled with chunks while remapping
     std::vector<dual_entity_t> newEnts;
     newEnts.resize(moveCount);
     entities.new_entities(newEnts.data(), moveCount);
-    int j = 0;
-    for (int i = 0; i < sents.entries.size(); ++i)
-        if (sents.entries[i].chunk != nullptr)
-            map[i] = newEnts[j++];
-
-    sents.reset();
-    struct mapper {
-        uint32_t count;
-        dual_entity_t* data;
-        void move() {}
-        void reset() {}
-        void map(dual_entity_t& e)
+    EIndex j = 0;
+    forloop (i, 0, entryCount)
+    {
+        auto& entry = sents.entries[i];
+        if (entry.chunk == nullptr)
+            continue;
+        expected[i] = e_version((dual_entity_t)i, entry.version);
+        mapped[i] = newEnts[j++];
+    }
+    entity_remap_t remap{ expected.data(), mapped.data(), (dual_entity_t)entryCount };
+    // target groups are resolved once per source group, chunks keep their memory and are relinked later
+    struct group_merge_t {
+        dual_group_t* src;
+        dual_group_t* dst;
+    };
+    std::vector<group_merge_t> merges;
+    std::vector<dual_chunk_t*> chunks;
+    for (auto& i : src.groups)
+    {
+        auto g = i.second;
+        fixed_stack_scope_t _(localStack);
+        dual_entity_type_t type = g->type;
+        // meta entities not merged are dropped, mapped ids are not ordered as before
+        auto metas = localStack.allocate<dual_entity_t>(type.meta.length);
+        SIndex metaCount = 0;
+        forloop (k, 0, type.meta.length)
         {
-            if (e_id(e) > count) DUAL_UNLIKELY
-                {
-                    e = kEntityNull;
-                    return;
-                }
-            e = data[e_id(e)];
+            dual_entity_t meta = remap(type.meta.data[k]);
+            if (meta != kEntityNull)
+                metas[metaCount++] = meta;
         }
-    } m;
-    m.count = (uint32_t)map.size();
-    m.data = map.data();
-    std::vector<dual_chunk_t*> chunks;
+        std::sort(metas, metas + metaCount);
+        type.meta = { metas, metaCount };
+        dual_group_t* dstG = get_group(type);
+        SKR_ASSERT(dstG);
+        // layout only depends on type set, so chunk memory of source can be used as is
+        SKR_ASSERT(same_layout(g->archetype, dstG->archetype));
+        merges.push_back({ g, dstG });
+        for (dual_chunk_t* c = g->firstChunk; c; c = c->next)
+            chunks.push_back(c);
+    }
     struct payload_t {
-        mapper* m;
+        dual_storage_t* storage;
+        const entity_remap_t* remap;
         dual_chunk_t** chunks;
         uint32_t start, end;
     };
     std::vector<payload_t> payloads;
-    payload_t payload;
-    payload.m = &m;
-    payload.chunks = chunks.data();
-    payload.start = payload.end = 0;
-    uint32_t sizePerBatch = 1024 * 16;
+    const uint32_t sizePerBatch = 1024 * 16;
     uint32_t sizeRemain = sizePerBatch;
-    for (auto& i : src.groups)
+    payload_t payload{ this, &remap, chunks.data(), 0, 0 };
+    forloop (i, 0, chunks.size())
     {
-        dual_group_t* g = i.second;
-        dual_chunk_t* c = g->firstChunk;
-        while (c)
+        auto c = chunks[i];
+        auto sizeToPatch = c->count * (c->type->sizeToPatch + (uint32_t)sizeof(dual_entity_t));
+        payload.end = (uint32_t)i + 1;
+        if (sizeRemain <= sizeToPatch)
         {
-            dual_chunk_t* next = c->next;
-            (void)next;
-            chunks.push_back(c);
-            auto sizeToPatch = c->count * c->type->sizeToPatch;
-            if (sizeRemain < sizeToPatch)
-            {
-                payload.end = (uint32_t)chunks.size();
-                payloads.push_back(payload);
-                payload.start = payload.end;
-                sizeRemain = sizeToPatch;
-            }
-            else
-                sizeRemain -= sizeToPatch;
+            payloads.push_back(payload);
+            payload.start = payload.end;
+            sizeRemain = sizePerBatch;
         }
+        else
+            sizeRemain -= sizeToPatch;
     }
-    if (payload.end != payloads.size())
-    {
-        payload.end = (uint32_t)chunks.size();
+    if (payload.start != payload.end)
         payloads.push_back(payload);
-    }
-    ftl::Task* tasks = new ftl::Task[payloads.size()];
+    // remapping is the only work per entity, ids of chunks are distinct so entries are written without lock
     auto taskBody = [](ftl::TaskScheduler*, void* data) {
         auto payload = (payload_t*)data;
+        auto& entries = payload->storage->entities.entries;
+        auto& remap = *payload->remap;
         forloop (i, payload->start, payload->end)
         {
             auto c = payload->chunks[i];
             auto ents = (dual_entity_t*)c->get_entities();
-            forloop (j, 0, c->count)
-                payload->m->map(ents[j]);
-            iterator_ref_view({ c, 0, c->count }, *payload->m);
+            remap.remap(ents, c->count);
+            forloop (k, 0, c->count)
+            {
+                auto& entry = entries[e_id(ents[k])];
+                entry.chunk = c;
+                entry.indexInChunk = k;
+            }
+            auto type = c->type;
+            if (type->sizeToPatch == 0)
+                continue;
+            auto offsets = type->offsets[c->pt];
+            forloop (t, 0, type->type.length)
+            {
+                type_index_t index = type->type.data[t];
+                if (plain_entity_type(index))
+                    remap.remap((dual_entity_t*)(c->data() + offsets[t]), c->count);
+                else
+                    iter_ref_impl({ c, 0, c->count }, index, offsets[t], type->sizes[t], type->elemSizes[t], *payload->remap);
+            }
         }
     };
-    forloop (i, 0, payloads.size())
-        tasks[i] = { taskBody, &payloads[i] };
-    ftl::TaskCounter counter(scheduler->scheduler);
-    scheduler->scheduler->AddTasks((uint32_t)payloads.size(), tasks, ftl::TaskPriority::High, &counter);
-    scheduler->scheduler->WaitForCounter(&counter);
-    for (auto& i : src.groups)
+    auto workers = scheduler ? scheduler->scheduler : scheduler_t::get().scheduler;
+    if (workers && payloads.size() > 1)
     {
-        dual_group_t* g = i.second;
-        auto type = g->type;
-        forloop (j, 0, type.meta.length)
-            m.map((dual_entity_t&)type.meta.data[j]);
-        dual_group_t* dstG = get_group(type);
-        dual_chunk_t* c = g->firstChunk;
-        while (c)
+        std::vector<ftl::Task> tasks(payloads.size());
+        forloop (i, 0, payloads.size())
+            tasks[i] = { taskBody, &payloads[i] };
+        ftl::TaskCounter counter(workers);
+        workers->AddTasks((uint32_t)payloads.size(), tasks.data(), ftl::TaskPriority::High, &counter);
+        workers->WaitForCounter(&counter, true);
+    }
+    else
+        for (auto& p : payloads)
+            taskBody(nullptr, &p);
+    // relink whole chunks, then coalesce partial chunks of touched groups
+    defrag_budget_t budget;
+    budget.deadline = 0;
+    budget.byteBudget = 0;
+    budget.movedBytes = 0;
+    budget.freedChunks = 0;
+    budget.compactedGroups = 0;
+    for (auto& merge : merges)
+    {
+        auto dstG = merge.dst;
+        auto g = merge.src;
+        if (scheduler)
+            scheduler->sync_archetype(dstG->archetype);
+        bool partial = false;
+        while (dual_chunk_t* c = g->firstChunk)
         {
-            dual_chunk_t* next = c->next;
+            g->remove_chunk(c);
             dstG->add_chunk(c);
-            c = next;
+            structural_change(dstG, c);
+            partial |= c->count < c->get_capacity();
         }
         src.destruct_group(g);
+        if (partial && dstG->firstFree && dstG->firstFree != dstG->lastChunk)
+            compact_group(this, dstG, budget);
     }
-    src.groups.clear();
+    sents.reset();
     src.queries.clear();
 }
 
@@ -767,6 +1226,35 @@ void dualS_deserialize(dual_storage_t* storage, const dual_serializer_v* v, void
     storage->deserialize({ t, v });
 }
 
+void dualS_serialize_image(dual_storage_t* storage, const dual_serializer_v* v, void* t)
+{
+    storage->serialize_image({ t, v });
+}
+
+int dualS_deserialize_image(dual_storage_t* storage, const void* data, size_t size)
+{
+    return storage->deserialize_image((const char*)data, size);
+}
+
+size_t dualS_image_index_size(const void* data, size_t size)
+{
+    return dual::image_index_size((const char*)data, size);
+}
+
+uint32_t dualS_select_image_sections(const void* index, size_t size, const dual_filter_t* filter, const dual_meta_filter_t* meta, dual_image_section_t* sections, uint32_t capacity)
+{
+    if (filter)
+        assert(dual::ordered(*filter));
+    if (meta)
+        assert(dual::ordered(*meta));
+    return dual::select_image_sections((const char*)index, size, filter, meta, sections, capacity);
+}
+
+int dualS_load_image_section(dual_storage_t* storage, const void* index, size_t indexSize, const void* data, size_t size)
+{
+    return storage->load_image_section((const char*)index, indexSize, (const char*)data, size);
+}
+
 int dualS_exist(dual_storage_t* storage, dual_entity_t ent)
 {
     return storage->exist(ent);
@@ -808,11 +1296,41 @@ void dualS_defragement(dual_storage_t* storage)
     storage->defragment();
 }
 
+void dualS_defragment_step(dual_storage_t* storage, const dual_defrag_options_t* options, dual_defrag_stats_t* stats)
+{
+    dual_defrag_options_t unlimited = {};
+    storage->defragment_incremental(options ? *options : unlimited, stats);
+}
+
 void dualS_pack_entities(dual_storage_t* storage)
 {
     storage->pack_entities();
 }
 
+void dualS_reserve_entities(dual_storage_t* storage, dual_entity_t* ents, EIndex count)
+{
+    using namespace dual;
+    // worker threads have their own slot, other threads share recycled ids through queue
+    uint32_t slot = kMaxReserveSlots;
+    if (auto scheduler = scheduler_t::get().scheduler)
+    {
+        auto index = scheduler->GetCurrentThreadIndex();
+        if (index < kMaxReserveSlots)
+            slot = index;
+    }
+    storage->entities.reserve_entities(ents, count, slot);
+}
+
+void dualS_share_free_entities(dual_storage_t* storage, EIndex count)
+{
+    storage->entities.share_free_entities(count);
+}
+
+void dualS_set_version(dual_storage_t* storage, uint64_t number)
+{
+    storage->timestamp = (uint32_t)number;
+}
+
 void dualS_enable_components(const dual_chunk_view_t* view, const dual_type_set_t* types)
 {
     using namespace dual;
@@ -22,46 +22,12 @@
 #include "utils/hashmap.hpp"
 #include "ftl/fiber.h"
 #include "EASTL/shared_ptr.h"
+#include "platform/thread.h"
 
 namespace dual
 {
 extern thread_local fixed_stack_t localStack;
 
-// template<class T>
-// struct blob_ref_T
-// {
-//     intptr_t offset;
-//     size_t count;
-//     T& resolve(void* store) { return *(T*)((char*)store + offset); }
-// };
-// struct storage_delta_t
-// {
-//     using array_delta = std::vector<blob_ref_T<char>>;
-//     struct vector_delta
-//     {
-//         size_t length;
-//         array_delta content;
-//     };
-//     using component_delta = std::unique_ptr<array_delta[]>;
-//     using buffer_delta = std::unique_ptr<std::vector<vector_delta>[]>;
-//     struct slice_delta
-//     {
-//         dual_entity_type_t type;
-//         blob_ref_T<guid_t> ents;
-//         component_delta diffs;
-//         buffer_delta bufferDiffs;
-//     };
-//     struct slice_data
-//     {
-//         dual_entity_type_t type;
-//         intptr_t offset;
-//     };
-//     std::vector<slice_delta> changed;
-//     std::vector<slice_data> created;
-//     std::vector<dual_entity_t> destroyed;
-//     std::vector<char> store;
-// };
-
 template <class T>
 struct hasher {
     size_t operator()(const T& value) const
@@ -96,6 +62,8 @@ struct query_cache_equal {
 };
 
 struct scheduler_t;
+struct image_reader_t;
+struct image_chunk_t;
 } // namespace dual
 
 struct dual_storage_t {
@@ -116,9 +84,19 @@ struct dual_storage_t {
     dual::entity_registry_t entities;
     uint32_t timestamp;
     std::unique_ptr<uint32_t[]> typeTimestamps;
+    uint32_t deltaTimestamp;
+    bool deltaSynced;
+    // position in free log of delta source when last delta is applied
+    uint64_t deltaFreeCursor;
+    // bumped when groups are added or removed, compiled system graphs are rebuilt on change
+    uint32_t structureVersion;
     mutable dual::scheduler_t* scheduler;
     mutable ftl::Fiber* mainFiber = nullptr;
     mutable eastl::shared_ptr<ftl::TaskCounter> counter;
+    // bumped by every snapshot, only changed on main thread while storage is synced
+    uint32_t snapshotSerial;
+    SMutexObject snapshotMutex;
+    std::vector<dual_snapshot_t*> snapshots;
 
     dual_storage_t();
     ~dual_storage_t();
@@ -130,7 +108,8 @@ struct dual_storage_t {
     archetype_t* try_get_archetype(const dual_type_set_t& type) const;
     void destruct_group(dual_group_t* group);
 
-    void allocate(dual_group_t* group, EIndex count, dual_view_callback_t callback, void* u);
+    // reserved ids from entities.reserve_entities are bound instead of new ids if given
+    void allocate(dual_group_t* group, EIndex count, dual_view_callback_t callback, void* u, const dual_entity_t* reserved = nullptr);
 
     void get_linked_recursive(const dual_chunk_view_t& view, dual::cache_t<dual_entity_t>& result);
     void linked_to_prefab(const dual_entity_t* src, uint32_t size, bool keepExternal = true);
@@ -165,22 +144,45 @@ struct dual_storage_t {
 
     void serialize_single(dual_entity_t e, serializer_t s);
     dual_entity_t deserialize_single(serializer_t s);
-    void serialize_type(const dual_entity_type_t& g, serializer_t s, bool keepMeta);
-    dual_entity_type_t deserialize_type(dual::fixed_stack_t& stack, serializer_t s, bool keepMeta);
+    static void serialize_type(const dual_entity_type_t& g, serializer_t s, bool keepMeta);
+    static dual_entity_type_t deserialize_type(dual::fixed_stack_t& stack, serializer_t s, bool keepMeta);
     void serialize_prefab(dual_entity_t e, serializer_t s);
     void serialize_prefab(dual_entity_t* es, EIndex n, serializer_t s);
     dual_entity_t deserialize_prefab(serializer_t s);
     void serialize(serializer_t s);
     void deserialize(serializer_t s);
+    void serialize_image(serializer_t s);
+    bool deserialize_image(const char* data, size_t size);
+    // only touch the chunk and entries of its entities, chunks can be written or loaded in parallel
+    void serialize_image_chunk(dual_chunk_t* chunk, serializer_t s);
+    bool deserialize_image_chunk(const dual_chunk_view_t& view, dual::image_reader_t& reader, uint32_t version);
+    // allocate chunks of a group record, they are filled by load_image_chunks
+    bool read_image_group(dual::image_reader_t& reader, uint32_t version, std::vector<dual::image_chunk_t>& chunks);
+    bool load_image_chunks(std::vector<dual::image_chunk_t>& chunks);
+    bool load_image_section(const char* index, size_t indexSize, const char* data, size_t size);
 
     void merge(dual_storage_t& src);
+    dual_storage_delta_t* diff(dual_storage_t& target);
+    void apply(const dual_storage_delta_t& delta);
     void reset();
     void validate_meta();
     void validate(dual_entity_set_t& meta);
     void defragment();
+    void defragment_incremental(const dual_defrag_options_t& options, dual_defrag_stats_t* stats);
     void pack_entities();
 
     dual_chunk_view_t allocate_view(dual_group_t* group, EIndex count);
+    std::vector<dual_chunk_view_t> reserve_views(dual_group_t* group, EIndex count);
     dual_chunk_view_t allocate_view_strict(dual_group_t* group, EIndex count);
     void structural_change(dual_group_t* group, dual_chunk_t* chunk);
+
+    // copy chunk for snapshots still sharing it, must be called before rows of chunk are written, moved or destroyed
+    void preserve(dual_chunk_t* chunk)
+    {
+        if (chunk->snapshotSerial.load(std::memory_order_acquire) != snapshotSerial) DUAL_UNLIKELY
+            preserve_shared(chunk);
+    }
+    void preserve_shared(dual_chunk_t* chunk);
+    dual_snapshot_t* snapshot();
+    void release(dual_snapshot_t* snapshot);
 };
\ No newline at end of file
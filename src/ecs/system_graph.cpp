@@ -0,0 +1,333 @@
+#include "system_graph.hpp"
+#include "archetype.hpp"
+#include "ecs/callback.hpp"
+#include "ecs/SmallVector.h"
+#include "query.hpp"
+#include "stack.hpp"
+#include "storage.hpp"
+#include "utils/hashmap.hpp"
+#include <algorithm>
+#include <cstring>
+#ifndef forloop
+    #define forloop(i, z, n) for (auto i = std::decay_t<decltype(n)>(z); i < (n); ++i)
+#endif
+
+dual_system_graph_t::dual_system_graph_t(dual_storage_t* storage, dual::scheduler_t& scheduler)
+    : storage(storage)
+    , scheduler(&scheduler)
+    , compiledVersion(0)
+    , compiled(false)
+    , lastDispatch(nullptr)
+{
+}
+
+dual_system_graph_t::~dual_system_graph_t()
+{
+    wait();
+}
+
+void dual_system_graph_t::wait()
+{
+    if (!lastDispatch)
+        return;
+    scheduler->scheduler->WaitForCounter(lastDispatch->counter.get(), true);
+    lastDispatch->release();
+    lastDispatch = nullptr;
+}
+
+uint32_t dual_system_graph_t::add_system(const dual_system_description_t& desc)
+{
+    SKR_ASSERT(desc.query->storage == storage);
+    SKR_ASSERT(desc.query->parameters.length < 32);
+    system_t system;
+    system.query = desc.query;
+    system.batchSize = desc.batchSize;
+    system.callback = desc.callback;
+    system.userdata = desc.userdata;
+    system.init = desc.init;
+    if (desc.resources)
+    {
+        auto& res = *desc.resources;
+        system.resources.assign(res.resources, res.resources + res.count);
+        system.readonly.assign(res.readonly, res.readonly + res.count);
+        system.atomic.assign(res.atomic, res.atomic + res.count);
+    }
+    systems.push_back(std::move(system));
+    compiled = false;
+    return (uint32_t)systems.size() - 1;
+}
+
+void dual_system_graph_t::compile()
+{
+    using namespace dual;
+    // dispatched jobs are still reading old layout
+    wait();
+    entries.clear();
+    leaves.clear();
+    // simulate dependency entries with the rule of update_entry, jobs dispatched before graph are marked as external
+    constexpr uint32_t kExternal = UINT32_MAX;
+    struct state_t {
+        llvm_vecsmall::SmallVector<uint32_t, 8> owned;
+        llvm_vecsmall::SmallVector<uint32_t, 8> shared;
+        uint32_t lastSystem = kExternal;
+    };
+    std::vector<state_t> states;
+    skr::flat_hash_map<std::pair<const void*, uint32_t>, uint32_t> entryIndices;
+    std::vector<bool> hasSuccessor(systems.size(), false);
+    forloop (s, 0, systems.size())
+    {
+        auto& system = systems[s];
+        auto query = system.query;
+        llvm_vecsmall::SmallVector<dual_group_t*, 64> groups;
+        auto add_group = [&](dual_group_t* group) {
+            groups.push_back(group);
+        };
+        storage->query_groups(query->filter, query->meta, DUAL_LAMBDA(add_group));
+        auto groupCount = (uint32_t)groups.size();
+        auto paramCount = (uint32_t)query->parameters.length;
+        // ordered by alignment, no padding is needed
+        size_t size = groupCount * (3 * sizeof(std::bitset<32>) + sizeof(dual_group_t*) + paramCount * sizeof(dual_type_index_t));
+        system.layoutData.reset(new char[std::max<size_t>(size, 1)]);
+        char* buffer = system.layoutData.get();
+        auto& layout = system.layout;
+        layout.groupCount = groupCount;
+        layout.readonly = (std::bitset<32>*)buffer;
+        buffer += groupCount * sizeof(std::bitset<32>);
+        layout.atomic = (std::bitset<32>*)buffer;
+        buffer += groupCount * sizeof(std::bitset<32>);
+        layout.randomAccess = (std::bitset<32>*)buffer;
+        buffer += groupCount * sizeof(std::bitset<32>);
+        layout.groups = (dual_group_t**)buffer;
+        buffer += groupCount * sizeof(dual_group_t*);
+        layout.localTypes = (dual_type_index_t*)buffer;
+        std::memcpy(layout.groups, groups.data(), groupCount * sizeof(dual_group_t*));
+        build_layout(layout, query);
+
+        auto& predecessors = system.predecessors;
+        predecessors.clear();
+        auto depend = [&](entry_t& entry, uint32_t dep, bool owned) {
+            if (dep == kExternal)
+            {
+                auto& waits = owned ? entry.waitOwned : entry.waitShared;
+                if (waits.empty() || waits.back() != s)
+                    waits.push_back(s);
+                return;
+            }
+            if (dep == s || std::find(predecessors.begin(), predecessors.end(), dep) != predecessors.end())
+                return;
+            predecessors.push_back(dep);
+            hasSuccessor[dep] = true;
+        };
+        auto access = [&](const void* type, uint32_t index, bool readonly, bool atomic) {
+            auto key = std::make_pair(type, index);
+            auto iter = entryIndices.find(key);
+            uint32_t entryIndex;
+            if (iter == entryIndices.end())
+            {
+                entryIndex = (uint32_t)entries.size();
+                entryIndices.emplace(key, entryIndex);
+                entries.emplace_back();
+                entries.back().type = (archetype_t*)type;
+                entries.back().index = index;
+                states.emplace_back();
+                states.back().owned.push_back(kExternal);
+                states.back().shared.push_back(kExternal);
+            }
+            else
+                entryIndex = iter->second;
+            auto& entry = entries[entryIndex];
+            auto& state = states[entryIndex];
+            // first access of a system wins
+            if (state.lastSystem == s)
+                return;
+            state.lastSystem = s;
+            if (readonly)
+            {
+                for (auto dep : state.owned)
+                    depend(entry, dep, true);
+                state.shared.push_back(s);
+            }
+            else
+            {
+                for (auto dep : state.shared)
+                    depend(entry, dep, false);
+                if (!atomic)
+                {
+                    for (auto dep : state.owned)
+                        depend(entry, dep, true);
+                    state.owned.clear();
+                    state.shared.clear();
+                }
+                state.owned.push_back(s);
+            }
+        };
+        forloop (i, 0, system.resources.size())
+            access(nullptr, e_id(system.resources[i]), system.readonly[i], system.atomic[i]);
+        auto sync_entry = [&](const dual_group_t* group, dual_type_index_t localType, bool readonly, bool atomic) {
+            access(group->archetype, localType, readonly, atomic);
+        };
+        for_each_access(layout, query, DUAL_LAMBDA(sync_entry));
+    }
+    forloop (i, 0, entries.size())
+    {
+        auto& entry = entries[i];
+        auto& state = states[i];
+        auto save = [&](const llvm_vecsmall::SmallVector<uint32_t, 8>& jobs, bool& keep, std::vector<uint32_t>& result) {
+            keep = false;
+            for (auto job : jobs)
+            {
+                if (job == kExternal)
+                    keep = true;
+                else
+                    result.push_back(job);
+            }
+        };
+        save(state.owned, entry.keepOwned, entry.owned);
+        save(state.shared, entry.keepShared, entry.shared);
+    }
+    forloop (s, 0, systems.size())
+        if (!hasSuccessor[s])
+            leaves.push_back(s);
+    compiledVersion = storage->structureVersion;
+    compiled = true;
+}
+
+eastl::shared_ptr<ftl::TaskCounter> dual_system_graph_t::dispatch()
+{
+    using namespace dual;
+    if (storage->scheduler == nullptr)
+    {
+        storage->scheduler = scheduler;
+        scheduler->set_main_thread(storage);
+    }
+    SKR_ASSERT(scheduler->is_main_thread(storage));
+    if (!compiled || compiledVersion != storage->structureVersion)
+        compile();
+    fixed_stack_scope_t _(localStack);
+    auto jobs = localStack.allocate<dual_ecs_job_t*>(systems.size());
+    forloop (s, 0, systems.size())
+    {
+        auto& system = systems[s];
+        auto job = new (get_job_pool().allocate(sizeof(dual_ecs_job_t))) dual_ecs_job_t(*scheduler);
+        job->type = dual_job_type::ecs;
+        static_cast<ecs_job_layout_t&>(*job) = system.layout;
+        job->entityCount = 0;
+        forloop (i, 0, system.layout.groupCount)
+            job->entityCount += system.layout.groups[i]->size;
+        job->query = (dual_query_t*)system.query;
+        job->callback = system.callback;
+        job->userdata = system.userdata;
+        job->batchSize = system.batchSize;
+        job->init = system.init;
+        job->payloads = nullptr;
+        for (auto p : system.predecessors)
+        {
+            jobs[p]->retain();
+            job->dependencies.push_back(jobs[p]);
+        }
+        jobs[s] = job;
+    }
+
+    // only the boundary is synced, dependencies inside graph are precomputed
+    auto depend = [&](dual_job_t* job, const job_list_t& list) {
+        auto& dependencies = job->dependencies;
+        for (auto dep : list)
+        {
+            if (dep->done() || std::find(dependencies.begin(), dependencies.end(), dep) != dependencies.end())
+                continue;
+            dep->retain();
+            dependencies.push_back(dep);
+        }
+    };
+    auto install = [&](job_list_t& list, bool keep, const std::vector<uint32_t>& owners) {
+        if (keep)
+            remove_done(list);
+        else
+        {
+            for (auto dep : list)
+                dep->release();
+            list.clear();
+        }
+        for (auto s : owners)
+        {
+            jobs[s]->retain();
+            list.push_back(jobs[s]);
+        }
+    };
+    auto sync_entry = [&](const entry_t& entry, job_dependency_entry_t& target) {
+        for (auto s : entry.waitOwned)
+            depend(jobs[s], target.owned);
+        for (auto s : entry.waitShared)
+            depend(jobs[s], target.shared);
+        install(target.owned, entry.keepOwned, entry.owned);
+        install(target.shared, entry.keepShared, entry.shared);
+    };
+    for (auto& entry : entries)
+    {
+        if (entry.type)
+        {
+            sync_entry(entry, get_dependency_entries(entry.type)[entry.index]);
+        }
+        else
+        {
+            skr_acquire_mutex(&scheduler->resourceMutex.mMutex);
+            sync_entry(entry, scheduler->allResources[entry.index]);
+            skr_release_mutex(&scheduler->resourceMutex.mMutex);
+        }
+    }
+
+    // an empty job waiting for all systems, its counter represents the whole graph
+    auto graphJob = new (get_job_pool().allocate(sizeof(dual_for_job_t))) dual_for_job_t(*scheduler);
+    graphJob->type = dual_job_type::simple;
+    graphJob->count = 0;
+    graphJob->batchSize = 1;
+    graphJob->callback = nullptr;
+    graphJob->userdata = nullptr;
+    for (auto s : leaves)
+    {
+        jobs[s]->retain();
+        graphJob->dependencies.push_back(jobs[s]);
+    }
+    forloop (s, 0, systems.size())
+        scheduler->run_ecs_job(jobs[s]);
+    graphJob->retain();
+    scheduler->run_for_job(graphJob);
+    if (lastDispatch)
+        lastDispatch->release();
+    lastDispatch = graphJob;
+    return graphJob->counter;
+}
+
+extern "C" {
+dual_system_graph_t* dualJ_create_graph(dual_storage_t* storage)
+{
+    return new dual_system_graph_t(storage, dual::scheduler_t::get());
+}
+
+uint32_t dualJ_add_system(dual_system_graph_t* graph, const dual_system_description_t* system)
+{
+    return graph->add_system(*system);
+}
+
+void dualJ_dispatch_graph(dual_system_graph_t* graph, dual_counter_t** counter)
+{
+    if (counter)
+    {
+        *counter = dual_counter_t::create(graph->dispatch());
+    }
+    else
+    {
+        graph->dispatch();
+    }
+}
+
+void dualJ_invalidate_graph(dual_system_graph_t* graph)
+{
+    graph->compiled = false;
+}
+
+void dualJ_release_graph(dual_system_graph_t* graph)
+{
+    delete graph;
+}
+}
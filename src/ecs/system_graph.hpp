@@ -0,0 +1,53 @@
+#pragma once
+#include "ecs/dual.h"
+#include "scheduler.hpp"
+#include <memory>
+#include <vector>
+
+// systems compiled into a static dag, dispatched as a whole every frame
+struct dual_system_graph_t {
+    struct system_t {
+        const dual_query_t* query;
+        EIndex batchSize;
+        dual_system_callback_t callback;
+        void* userdata;
+        dual_system_init_callback_t init;
+        std::vector<dual_entity_t> resources;
+        std::vector<int> readonly;
+        std::vector<int> atomic;
+        // compiled data, layout is pointing into layoutData
+        dual::ecs_job_layout_t layout;
+        std::unique_ptr<char[]> layoutData;
+        // systems of graph this system waits for
+        std::vector<uint32_t> predecessors;
+    };
+    // a dependency entry touched by graph, it is the boundary between graph and other jobs
+    struct entry_t {
+        dual::archetype_t* type; // nullptr for resource
+        uint32_t index;          // local type or resource id
+        // systems waiting for jobs which are already in the entry when dispatching
+        std::vector<uint32_t> waitOwned;
+        std::vector<uint32_t> waitShared;
+        // entry state after dispatching, previous jobs are kept only if no system overwrites them
+        bool keepOwned;
+        bool keepShared;
+        std::vector<uint32_t> owned;
+        std::vector<uint32_t> shared;
+    };
+    dual_storage_t* storage;
+    dual::scheduler_t* scheduler;
+    std::vector<system_t> systems;
+    std::vector<entry_t> entries;
+    // systems without successor, waited by the graph job
+    std::vector<uint32_t> leaves;
+    uint32_t compiledVersion;
+    bool compiled;
+    dual_job_t* lastDispatch;
+
+    dual_system_graph_t(dual_storage_t* storage, dual::scheduler_t& scheduler);
+    ~dual_system_graph_t();
+    uint32_t add_system(const dual_system_description_t& desc);
+    void compile();
+    eastl::shared_ptr<ftl::TaskCounter> dispatch();
+    void wait();
+};
@@ -22,7 +22,7 @@ type_registry_t::type_registry_t(pool_t& pool)
     : nameArena(pool)
 {
     {
-        type_description_t desc;
+        type_description_t desc = {};
         desc.guid = skr::guid::make_guid("{B68B1CAB-98FF-4298-A22E-68B404034B1B}");
         desc.name = "disable";
         desc.size = 0;
@@ -33,7 +33,7 @@ type_registry_t::type_registry_t(pool_t& pool)
         descriptions.push_back(desc);
     }
     {
-        type_description_t desc;
+        type_description_t desc = {};
         desc.guid = skr::guid::make_guid("{C0471B12-5462-48BB-B8C4-9983036ECC6C}");
         desc.name = "dead";
         desc.size = 0;
@@ -44,7 +44,7 @@ type_registry_t::type_registry_t(pool_t& pool)
         descriptions.push_back(desc);
     }
     {
-        type_description_t desc;
+        type_description_t desc = {};
         desc.guid = skr::guid::make_guid("{54BD68D5-FD66-4DBE-85CF-70F535C27389}");
         desc.name = "link";
         desc.size = sizeof(dual_entity_t) * kLinkComponentSize;
@@ -58,7 +58,7 @@ type_registry_t::type_registry_t(pool_t& pool)
     }
     {
         assert(descriptions.size() == kMaskComponent);
-        type_description_t desc;
+        type_description_t desc = {};
         desc.guid = skr::guid::make_guid("{B68B1CAB-98FF-4298-A22E-68B404034B1B}");
         desc.name = "mask";
         desc.size = sizeof(dual_mask_component_t);
@@ -70,7 +70,7 @@ type_registry_t::type_registry_t(pool_t& pool)
     }
     {
         assert(descriptions.size() == kGuidComponent);
-        type_description_t desc;
+        type_description_t desc = {};
         desc.guid = skr::guid::make_guid("{565FBE87-6309-4DF7-9B3F-C61B67B38BB3}");
         desc.name = "guid";
         desc.size = 0;
@@ -86,6 +86,14 @@ type_index_t type_registry_t::register_type(const type_description_t& inDesc)
 {
     if (auto index = get_type(inDesc.guid); index != kInvalidTypeIndex)
         return index;
+    if (inDesc.flags & DTF_SOA)
+    {
+        // fields are scattered to sub columns, so whole component can not be handled by callbacks
+        auto& cb = inDesc.callback;
+        bool callback = cb.constructor || cb.copy || cb.destructor || cb.move || cb.serialize || cb.map;
+        if (callback || inDesc.entityFieldsCount != 0 || inDesc.elementSize == 0 || inDesc.size % inDesc.elementSize != 0)
+            return kInvalidTypeIndex;
+    }
     type_description_t desc = inDesc;
     if (!desc.name)
     {
@@ -117,7 +125,7 @@ type_index_t type_registry_t::register_type(const type_description_t& inDesc)
         desc.callback.move != nullptr ||
         desc.callback.destructor != nullptr)
         managed = true;
-    if (desc.elementSize != 0)
+    if (desc.elementSize != 0 && (desc.flags & DTF_SOA) == 0)
         buffer = true;
     pin = (desc.flags & DTF_PIN) != 0;
     type_index_t index{ (TIndex)descriptions.size(), pin, buffer, managed, tag };
@@ -182,6 +190,11 @@ dual_type_index_t dualT_get_type_by_name(const char* name)
     return dual::type_registry_t::get().get_type(name);
 }
 
+dual_type_index_t dualT_get_mask_type()
+{
+    return dual::kMaskComponent;
+}
+
 const dual_type_description_t* dualT_get_desc(dual_type_index_t idx)
 {
     return &dual::type_registry_t::get().descriptions[dual::type_index_t(idx).index()];
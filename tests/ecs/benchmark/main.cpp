@@ -0,0 +1,581 @@
+#include "benchmark/benchmark.h"
+#include "ecs/dual.h"
+#include "ecs/callback.hpp"
+#include "ftl/task_scheduler.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <utility>
+#include <vector>
+
+using position = float[3];
+dual_type_index_t type_position;
+using velocity = float[3];
+dual_type_index_t type_velocity;
+// tags used to split entities into many archetypes
+constexpr uint32_t kMarkerCount = 8;
+dual_type_index_t type_markers[kMarkerCount];
+
+dual_type_index_t register_component(const char* name, uint32_t id, uint16_t size, uint16_t alignment)
+{
+    dual_type_description_t desc;
+    desc.name = name;
+    desc.size = size;
+    desc.entityFieldsCount = 0;
+    desc.entityFields = 0;
+    desc.guid = {};
+    desc.guid.Data1 = 0x5A4B0000 + id;
+    desc.callback = {};
+    desc.flags = 0;
+    desc.elementSize = 0;
+    desc.alignment = alignment;
+    return dualT_register_type(&desc);
+}
+
+void register_components()
+{
+    static char names[kMarkerCount][16];
+    type_position = register_component("position", 0, sizeof(position), alignof(float));
+    type_velocity = register_component("velocity", 1, sizeof(velocity), alignof(float));
+    for (uint32_t i = 0; i < kMarkerCount; ++i)
+    {
+        std::snprintf(names[i], sizeof(names[i]), "marker%c", 'a' + i);
+        type_markers[i] = register_component(names[i], 2 + i, sizeof(uint32_t), alignof(uint32_t));
+    }
+}
+
+// one entity for every combination of markers, each combination is a separated archetype
+dual_storage_t* create_storage(uint32_t archetypeCount)
+{
+    auto storage = dualS_create();
+    std::vector<dual_type_index_t> types;
+    for (uint32_t mask = 0; mask < archetypeCount; ++mask)
+    {
+        types.clear();
+        types.push_back(type_position);
+        types.push_back(type_velocity);
+        for (uint32_t i = 0; i < kMarkerCount; ++i)
+            if (mask & (1 << i))
+                types.push_back(type_markers[i]);
+        std::sort(types.begin(), types.end());
+        dual_entity_type_t entityType;
+        entityType.type = { types.data(), (SIndex)types.size() };
+        entityType.meta = { nullptr, 0 };
+        dualS_allocate_type(storage, &entityType, 1, nullptr, nullptr);
+    }
+    return storage;
+}
+
+void empty_system(void* u, dual_storage_t* storage, dual_chunk_view_t* view, dual_type_index_t* localTypes, EIndex entityIndex)
+{
+}
+
+// main thread cost of dualJ_schedule_ecs, half of the systems write position and the other half read it
+static void BM_ScheduleEcs(benchmark::State& state)
+{
+    const uint32_t archetypeCount = (uint32_t)state.range(0);
+    const uint32_t systemCount = (uint32_t)state.range(1);
+    auto storage = create_storage(archetypeCount);
+    auto writer = dualQ_from_literal(storage, "[inout]position, [in]velocity");
+    auto reader = dualQ_from_literal(storage, "[in]position, [inout]velocity");
+    for (auto _ : state)
+    {
+        for (uint32_t i = 0; i < systemCount; ++i)
+            dualJ_schedule_ecs(i % 2 ? reader : writer, 256, &empty_system, nullptr, nullptr, nullptr, nullptr);
+        state.PauseTiming();
+        dualJ_wait_all();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * systemCount);
+    dualS_release(storage);
+}
+BENCHMARK(BM_ScheduleEcs)->Args({ 1, 300 })->Args({ 16, 300 })->Args({ 256, 300 })->Unit(benchmark::kMicrosecond);
+
+// same systems as BM_ScheduleEcs, compiled once into a system graph
+static void BM_DispatchGraph(benchmark::State& state)
+{
+    const uint32_t archetypeCount = (uint32_t)state.range(0);
+    const uint32_t systemCount = (uint32_t)state.range(1);
+    auto storage = create_storage(archetypeCount);
+    auto writer = dualQ_from_literal(storage, "[inout]position, [in]velocity");
+    auto reader = dualQ_from_literal(storage, "[in]position, [inout]velocity");
+    auto graph = dualJ_create_graph(storage);
+    for (uint32_t i = 0; i < systemCount; ++i)
+    {
+        dual_system_description_t system = {};
+        system.query = i % 2 ? reader : writer;
+        system.batchSize = 256;
+        system.callback = &empty_system;
+        dualJ_add_system(graph, &system);
+    }
+    for (auto _ : state)
+    {
+        dualJ_dispatch_graph(graph, nullptr);
+        state.PauseTiming();
+        dualJ_wait_all();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * systemCount);
+    dualJ_release_graph(graph);
+    dualS_release(storage);
+}
+BENCHMARK(BM_DispatchGraph)->Args({ 1, 300 })->Args({ 16, 300 })->Args({ 256, 300 })->Unit(benchmark::kMicrosecond);
+
+// chains of jobs writing the same resource, each job can only start after the previous one
+static void BM_JobChain(benchmark::State& state)
+{
+    const uint32_t chainCount = (uint32_t)state.range(0);
+    const uint32_t chainLength = (uint32_t)state.range(1);
+    std::vector<dual_entity_t> resources(chainCount);
+    for (auto& resource : resources)
+        resource = dualJ_add_resource();
+    int readonly = 0, atomic = 0;
+    auto callback = +[](void* u, uint32_t i) {};
+    for (auto _ : state)
+    {
+        for (uint32_t i = 0; i < chainLength; ++i)
+            for (auto& resource : resources)
+            {
+                dual_resource_operation_t resourceOp{ &resource, &readonly, &atomic, 1 };
+                dualJ_schedule_for(64, callback, nullptr, &resourceOp, nullptr);
+            }
+        dualJ_wait_all();
+    }
+    state.SetItemsProcessed(state.iterations() * chainCount * chainLength);
+    for (auto& resource : resources)
+        dualJ_remove_resource(resource);
+}
+BENCHMARK(BM_JobChain)->Args({ 1, 256 })->Args({ 64, 64 })->Unit(benchmark::kMicrosecond);
+
+// workers allocate and free chunks at the same time, every task fills and releases its own storage
+static void BM_ChunkChurn(benchmark::State& state)
+{
+    const uint32_t taskCount = (uint32_t)state.range(0);
+    const uint32_t entityCount = (uint32_t)state.range(1);
+    auto callback = +[](void* u, uint32_t i) {
+        dual_entity_type_t entityType;
+        entityType.type = { &type_position, 1 };
+        entityType.meta = { nullptr, 0 };
+        auto storage = dualS_create();
+        dualS_allocate_type(storage, &entityType, *(uint32_t*)u, nullptr, nullptr);
+        dualS_release(storage);
+    };
+    uint32_t count = entityCount;
+    for (auto _ : state)
+    {
+        dualJ_schedule_for(taskCount, callback, &count, nullptr, nullptr);
+        dualJ_wait_all();
+    }
+    dual_pool_stats_t stats;
+    dual_get_pool_stats(nullptr, &stats, nullptr);
+    state.counters["hit_rate"] = (double)stats.hits / std::max<double>((double)(stats.hits + stats.misses), 1);
+    state.SetItemsProcessed(state.iterations() * taskCount);
+}
+BENCHMARK(BM_ChunkChurn)->Args({ 64, 20000 })->Unit(benchmark::kMicrosecond);
+
+// add a component to entities and remove it again, every cast resolves the target group of a delta
+static void BM_ToggleComponent(benchmark::State& state)
+{
+    const uint32_t entityCount = (uint32_t)state.range(0);
+    auto storage = create_storage(1);
+    dual_entity_type_t entityType;
+    entityType.type = { &type_position, 1 };
+    entityType.meta = { nullptr, 0 };
+    dualS_allocate_type(storage, &entityType, entityCount, nullptr, nullptr);
+    std::vector<dual_chunk_view_t> views;
+    auto collect = [&](dual_chunk_view_t* view) { views.push_back(*view); };
+    dual_delta_type_t add = {}, remove = {};
+    add.added.type = { &type_velocity, 1 };
+    remove.removed.type = { &type_velocity, 1 };
+    for (auto _ : state)
+    {
+        for (auto delta : { &add, &remove })
+        {
+            views.clear();
+            dualS_all(storage, false, false, DUAL_LAMBDA(collect));
+            for (auto& view : views)
+                for (EIndex i = 0; i < view.count; ++i)
+                {
+                    // single entity casts, taken from back so views stay valid
+                    dual_chunk_view_t single = { view.chunk, view.start + view.count - i - 1, 1 };
+                    dualS_cast_view_delta(storage, &single, delta, nullptr, nullptr);
+                }
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * entityCount * 2);
+    dualS_release(storage);
+}
+BENCHMARK(BM_ToggleComponent)->Arg(10000)->Unit(benchmark::kMicrosecond);
+
+// switch given percent of entities out of an update and back each frame, either by disabling velocity in mask or by moving them to a tagged archetype
+static void BM_ToggleVsTag(benchmark::State& state)
+{
+    const uint32_t entityCount = (uint32_t)state.range(0);
+    const uint32_t togglePercent = (uint32_t)state.range(1);
+    const bool tag = state.range(2) != 0;
+    dual_type_index_t updated[] = { type_position, type_velocity };
+    std::sort(updated, updated + 2);
+    // tagged entities need no mask column
+    dual_type_index_t types[] = { type_position, type_velocity, dualT_get_mask_type() };
+    std::sort(types, types + (tag ? 2 : 3));
+    dual_entity_type_t entityType;
+    entityType.type = { types, tag ? (SIndex)2 : (SIndex)3 };
+    entityType.meta = { nullptr, 0 };
+    auto world = dualS_create();
+    std::vector<dual_entity_t> ents;
+    auto collect = [&](dual_chunk_view_t* view) {
+        auto es = dualV_get_entities(view);
+        ents.insert(ents.end(), es, es + view->count);
+    };
+    dualS_allocate_type(world, &entityType, entityCount, DUAL_LAMBDA(collect));
+    // spread toggled entities over the crowd so every chunk is split
+    std::vector<dual_entity_t> toggled;
+    for (uint32_t i = 0; i < entityCount; ++i)
+        if (i * togglePercent / 100 != (i + 1) * togglePercent / 100)
+            toggled.push_back(ents[i]);
+    dual_type_set_t velocitySet = { &type_velocity, 1 };
+    dual_delta_type_t add = {}, remove = {};
+    add.added.type = { &type_markers[0], 1 };
+    remove.removed.type = { &type_markers[0], 1 };
+    dual_filter_t filter;
+    std::memset(&filter, 0, sizeof(filter));
+    filter.all = { updated, 2 };
+    if (tag)
+        filter.none = { &type_markers[0], 1 };
+    dual_meta_filter_t meta;
+    std::memset(&meta, 0, sizeof(meta));
+    auto update = [&](dual_chunk_view_t* view) {
+        auto positions = (position*)dualV_get_owned_rw(view, type_position);
+        auto velocities = (const velocity*)dualV_get_owned_ro(view, type_velocity);
+        for (uint32_t i = 0; i < view->count; ++i)
+            for (uint32_t j = 0; j < 3; ++j)
+                positions[i][j] += velocities[i][j];
+    };
+    auto toggle = [&](bool off) {
+        for (auto e : toggled)
+        {
+            dual_chunk_view_t view;
+            dualS_access(world, e, &view);
+            if (tag)
+                dualS_cast_view_delta(world, &view, off ? &add : &remove, nullptr, nullptr);
+            else if (off)
+                dualS_disable_components(&view, &velocitySet);
+            else
+                dualS_enable_components(&view, &velocitySet);
+        }
+    };
+    for (auto _ : state)
+    {
+        toggle(true);
+        dualS_query(world, &filter, &meta, DUAL_LAMBDA(update));
+        toggle(false);
+    }
+    state.SetItemsProcessed(state.iterations() * entityCount);
+    dualS_release(world);
+}
+BENCHMARK(BM_ToggleVsTag)->ArgsProduct({ { 100000 }, { 1, 10, 50 }, { 0, 1 } })->Unit(benchmark::kMicrosecond);
+
+// spawn a large crowd at once, storage is bound to scheduler so chunks are filled on workers
+static void BM_SpawnCrowd(benchmark::State& state)
+{
+    const uint32_t entityCount = (uint32_t)state.range(0);
+    dual_type_index_t types[] = { type_position, type_velocity };
+    dual_entity_type_t entityType;
+    entityType.type = { types, 2 };
+    entityType.meta = { nullptr, 0 };
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        auto storage = create_storage(1);
+        auto query = dualQ_from_literal(storage, "[in]position");
+        dualJ_schedule_ecs(query, 256, &empty_system, nullptr, nullptr, nullptr, nullptr);
+        dualJ_wait_all();
+        state.ResumeTiming();
+        dualS_allocate_type(storage, &entityType, entityCount, nullptr, nullptr);
+        state.PauseTiming();
+        dualS_release(storage);
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * entityCount);
+}
+BENCHMARK(BM_SpawnCrowd)->Arg(500000)->Unit(benchmark::kMillisecond);
+
+// resolve entities to chunk views through the entity registry, in allocation order or shuffled
+static void BM_EntityLookup(benchmark::State& state)
+{
+    const uint32_t entityCount = (uint32_t)state.range(0);
+    const bool shuffle = state.range(1) != 0;
+    auto storage = dualS_create();
+    dual_entity_type_t entityType;
+    entityType.type = { &type_position, 1 };
+    entityType.meta = { nullptr, 0 };
+    std::vector<dual_entity_t> ents;
+    ents.reserve(entityCount);
+    auto collect = [&](dual_chunk_view_t* view) {
+        auto es = dualV_get_entities(view);
+        ents.insert(ents.end(), es, es + view->count);
+    };
+    dualS_allocate_type(storage, &entityType, entityCount, DUAL_LAMBDA(collect));
+    if (shuffle)
+        std::shuffle(ents.begin(), ents.end(), std::mt19937(42));
+    for (auto _ : state)
+    {
+        for (auto e : ents)
+        {
+            dual_chunk_view_t view;
+            dualS_access(storage, e, &view);
+            benchmark::DoNotOptimize(view);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * entityCount);
+    state.counters["entity_bytes"] = sizeof(dual_entity_t);
+    dualS_release(storage);
+}
+BENCHMARK(BM_EntityLookup)->Args({ 100000, 0 })->Args({ 100000, 1 })->Args({ 4000000, 0 })->Args({ 4000000, 1 })->Unit(benchmark::kMicrosecond);
+
+struct memory_archive_t {
+    std::vector<char> data;
+    size_t offset = 0;
+    static void write(void* u, void* src, uint32_t bytes)
+    {
+        auto archive = (memory_archive_t*)u;
+        archive->data.insert(archive->data.end(), (char*)src, (char*)src + bytes);
+    }
+    static void read(void* u, void* dst, uint32_t bytes)
+    {
+        auto archive = (memory_archive_t*)u;
+        std::memcpy(dst, archive->data.data() + archive->offset, bytes);
+        archive->offset += bytes;
+    }
+    static void peek(void* u, void* dst, uint32_t bytes)
+    {
+        auto archive = (memory_archive_t*)u;
+        std::memcpy(dst, archive->data.data() + archive->offset, bytes);
+    }
+};
+
+// load a saved world from memory, streamed through serializer or as chunk image
+static void BM_LoadWorld(benchmark::State& state)
+{
+    const uint32_t entityCount = (uint32_t)state.range(0);
+    const bool image = state.range(1) != 0;
+    auto storage = create_storage(64);
+    // arrays are converted one by one when streamed
+    static dual_type_index_t type_path = [] {
+        dual_type_description_t desc;
+        desc.name = "path";
+        desc.size = 72;
+        desc.entityFieldsCount = 0;
+        desc.entityFields = 0;
+        desc.guid = {};
+        desc.guid.Data1 = 0x5A4BFFFF;
+        desc.callback = {};
+        desc.flags = 0;
+        desc.elementSize = sizeof(position);
+        desc.alignment = alignof(void*);
+        return dualT_register_type(&desc);
+    }();
+    dual_type_index_t types[] = { type_position, type_velocity, type_path };
+    std::sort(types, types + 3);
+    dual_entity_type_t entityType;
+    entityType.type = { types, 3 };
+    entityType.meta = { nullptr, 0 };
+    dualS_allocate_type(storage, &entityType, entityCount, nullptr, nullptr);
+    memory_archive_t archive;
+    dual_serializer_v writer = { &memory_archive_t::write, nullptr, +[](void*) { return 1; } };
+    dual_serializer_v reader = { &memory_archive_t::read, &memory_archive_t::peek, +[](void*) { return 0; } };
+    if (image)
+        dualS_serialize_image(storage, &writer, &archive);
+    else
+        dualS_serialize(storage, &writer, &archive);
+    dualS_release(storage);
+    for (auto _ : state)
+    {
+        auto loaded = dualS_create();
+        if (image)
+            dualS_deserialize_image(loaded, archive.data.data(), archive.data.size());
+        else
+        {
+            archive.offset = 0;
+            dualS_deserialize(loaded, &reader, &archive);
+        }
+        state.PauseTiming();
+        dualS_release(loaded);
+        state.ResumeTiming();
+    }
+    state.SetBytesProcessed(state.iterations() * archive.data.size());
+}
+BENCHMARK(BM_LoadWorld)->Args({ 1000000, 0 })->Args({ 1000000, 1 })->Unit(benchmark::kMillisecond);
+
+// merge a region built in a side storage into a world, chunks are adopted and entity references remapped
+static void BM_MergeRegion(benchmark::State& state)
+{
+    const uint32_t entityCount = (uint32_t)state.range(0);
+    static dual_type_index_t type_target = [] {
+        static intptr_t fields[1] = { 0 };
+        dual_type_description_t desc;
+        desc.name = "target";
+        desc.size = sizeof(dual_entity_t);
+        desc.entityFieldsCount = 1;
+        desc.entityFields = (intptr_t)fields;
+        desc.guid = {};
+        desc.guid.Data1 = 0x5A4BFFFE;
+        desc.callback = {};
+        desc.flags = 0;
+        desc.elementSize = 0;
+        desc.alignment = alignof(dual_entity_t);
+        return dualT_register_type(&desc);
+    }();
+    dual_type_index_t types[] = { type_position, type_velocity, type_target };
+    std::sort(types, types + 3);
+    dual_entity_type_t entityType;
+    entityType.type = { types, 3 };
+    entityType.meta = { nullptr, 0 };
+    auto world = create_storage(1);
+    dualS_allocate_type(world, &entityType, entityCount, nullptr, nullptr);
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        auto region = dualS_create();
+        dual_entity_t last = NULL_ENTITY;
+        auto link = [&](dual_chunk_view_t* view) {
+            auto targets = (dual_entity_t*)dualV_get_owned_rw(view, type_target);
+            auto ents = dualV_get_entities(view);
+            for (uint32_t i = 0; i < view->count; ++i)
+                targets[i] = std::exchange(last, ents[i]);
+        };
+        dualS_allocate_type(region, &entityType, entityCount, DUAL_LAMBDA(link));
+        state.ResumeTiming();
+        dualS_merge(world, region);
+        state.PauseTiming();
+        dualS_release(region);
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * entityCount);
+    dualS_release(world);
+}
+BENCHMARK(BM_MergeRegion)->Arg(100000)->Unit(benchmark::kMicrosecond);
+
+// capture, write given percent of chunks on main thread, then extract snapshot as render thread would
+static void BM_SnapshotFrame(benchmark::State& state)
+{
+    const uint32_t entityCount = (uint32_t)state.range(0);
+    const uint32_t writePercent = (uint32_t)state.range(1);
+    dual_type_index_t types[] = { type_position, type_velocity };
+    std::sort(types, types + 2);
+    dual_entity_type_t entityType;
+    entityType.type = { types, 2 };
+    entityType.meta = { nullptr, 0 };
+    auto world = dualS_create();
+    // spawned in small batches so that entities are spread over regular chunks instead of a few large ones
+    for (uint32_t i = 0; i < entityCount; i += 1000)
+        dualS_allocate_type(world, &entityType, std::min(1000u, entityCount - i), nullptr, nullptr);
+    dual_filter_t filter;
+    std::memset(&filter, 0, sizeof(filter));
+    filter.all = { types, 2 };
+    dual_meta_filter_t meta;
+    std::memset(&meta, 0, sizeof(meta));
+    for (auto _ : state)
+    {
+        auto snapshot = dualS_snapshot(world);
+        uint32_t chunkIndex = 0;
+        auto write = [&](dual_chunk_view_t* view) {
+            if (chunkIndex++ % 100 >= writePercent)
+                return;
+            auto positions = (position*)dualV_get_owned_rw(view, type_position);
+            for (uint32_t i = 0; i < view->count; ++i)
+                positions[i][0] += 1.f;
+        };
+        dualS_query(world, &filter, &meta, DUAL_LAMBDA(write));
+        float sum = 0.f;
+        auto extract = [&](dual_chunk_view_t* view) {
+            auto positions = (const position*)dualV_get_owned_ro(view, type_position);
+            for (uint32_t i = 0; i < view->count; ++i)
+                sum += positions[i][0];
+        };
+        dualS_query_snapshot(snapshot, &filter, nullptr, DUAL_LAMBDA(extract));
+        benchmark::DoNotOptimize(sum);
+        dualS_release_snapshot(snapshot);
+    }
+    state.SetItemsProcessed(state.iterations() * entityCount);
+    dualS_release(world);
+}
+BENCHMARK(BM_SnapshotFrame)->Args({ 100000, 0 })->Args({ 100000, 10 })->Args({ 100000, 100 })->Unit(benchmark::kMicrosecond);
+
+// integrate position by velocity with components stored as arrays of structs or as per field sub columns
+static void BM_IntegrateLayout(benchmark::State& state)
+{
+    const uint32_t entityCount = (uint32_t)state.range(0);
+    const bool soa = state.range(1) != 0;
+    static dual_type_index_t soaTypes[2] = {};
+    if (soaTypes[0] == 0)
+    {
+        const char* names[] = { "position_soa", "velocity_soa" };
+        for (uint32_t i = 0; i < 2; ++i)
+        {
+            dual_type_description_t desc;
+            desc.name = names[i];
+            desc.size = sizeof(position);
+            desc.entityFieldsCount = 0;
+            desc.entityFields = 0;
+            desc.guid = {};
+            desc.guid.Data1 = 0x5A4BFFFC + i;
+            desc.callback = {};
+            desc.flags = DTF_SOA;
+            desc.elementSize = sizeof(float);
+            desc.alignment = alignof(float);
+            soaTypes[i] = dualT_register_type(&desc);
+        }
+    }
+    dual_type_index_t types[] = { soa ? soaTypes[0] : type_position, soa ? soaTypes[1] : type_velocity };
+    dual_type_index_t p = types[0], v = types[1];
+    std::sort(types, types + 2);
+    dual_entity_type_t entityType;
+    entityType.type = { types, 2 };
+    entityType.meta = { nullptr, 0 };
+    auto world = dualS_create();
+    dualS_allocate_type(world, &entityType, entityCount, nullptr, nullptr);
+    dual_filter_t filter;
+    std::memset(&filter, 0, sizeof(filter));
+    filter.all = { types, 2 };
+    dual_meta_filter_t meta;
+    std::memset(&meta, 0, sizeof(meta));
+    const float dt = 0.016f;
+    auto integrate = [&](dual_chunk_view_t* view) {
+        if (soa)
+        {
+            for (uint32_t f = 0; f < 3; ++f)
+            {
+                float* __restrict ps = (float*)dualV_get_field_rw(view, p, f);
+                const float* __restrict vs = (const float*)dualV_get_field_ro(view, v, f);
+                for (uint32_t i = 0; i < view->count; ++i)
+                    ps[i] += vs[i] * dt;
+            }
+            return;
+        }
+        auto ps = (position*)dualV_get_owned_rw(view, p);
+        auto vs = (const velocity*)dualV_get_owned_ro(view, v);
+        for (uint32_t i = 0; i < view->count; ++i)
+            for (uint32_t f = 0; f < 3; ++f)
+                ps[i][f] += vs[i][f] * dt;
+    };
+    for (auto _ : state)
+        dualS_query(world, &filter, &meta, DUAL_LAMBDA(integrate));
+    state.SetItemsProcessed(state.iterations() * entityCount);
+    dualS_release(world);
+}
+BENCHMARK(BM_IntegrateLayout)->Args({ 100000, 0 })->Args({ 100000, 1 })->Unit(benchmark::kMicrosecond);
+
+int main(int argc, char** argv)
+{
+    ::benchmark::Initialize(&argc, argv);
+    register_components();
+    ftl::TaskScheduler scheduler;
+    ftl::TaskSchedulerInitOptions options;
+    scheduler.Init(options);
+    dualJ_initialize((dual_scheduler_t*)&scheduler);
+    ::benchmark::RunSpecifiedBenchmarks();
+    dual_shutdown();
+    return 0;
+}
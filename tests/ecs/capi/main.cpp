@@ -1,8 +1,16 @@
 #include "gtest/gtest.h"
+#include <algorithm>
+#include <atomic>
 #include <memory>
+#include <thread>
+#include <vector>
 #include "ecs/dual.h"
 #include "guid.hpp" //for guid
 #include "ecs/callback.hpp"
+#include "ecs/array.hpp"
+#include "ecs/typed_query.hpp"
+#include "ecs/constants.hpp"
+#include "ftl/task_scheduler.h"
 
 using test = int;
 dual_type_index_t type_test;
@@ -18,6 +26,10 @@ dual_type_index_t type_managed_arr;
 using pinned = int*;
 dual_type_index_t type_pinned;
 dual_type_index_t type_pinned_arr;
+struct soa {
+    float x, y, z;
+};
+dual_type_index_t type_soa;
 
 class APITest : public ::testing::Test
 {
@@ -49,6 +61,17 @@ public:
     dual_entity_t e1;
 };
 
+// jobs run on the scheduler initialized in main, storage is synced before release
+class JobTest : public APITest
+{
+public:
+    void TearDown() override
+    {
+        dualJ_wait_storage(storage);
+        APITest::TearDown();
+    }
+};
+
 template <class T>
 void zero(T& t)
 {
@@ -223,6 +246,1578 @@ TEST_F(APITest, query)
     EXPECT_EQ(*dualV_get_entities(&view), e1);
 }
 
+TEST_F(APITest, query_modifiers)
+{
+    EXPECT_NE(dualQ_from_literal(storage, "[out]test"), nullptr);
+    EXPECT_NE(dualQ_from_literal(storage, "[inout][rand]test, [in]?test2"), nullptr);
+    EXPECT_NE(dualQ_from_literal(storage, "[atomic][rand]test, [in][group]test2"), nullptr);
+    EXPECT_NE(dualQ_from_literal(storage, "[in]test''"), nullptr);
+    EXPECT_EQ(dualQ_from_literal(storage, "[out]test'"), nullptr);
+    EXPECT_EQ(dualQ_from_literal(storage, "[in][any]test"), nullptr);
+}
+
+TEST_F(APITest, diff)
+{
+    auto replica = dualS_create();
+    auto delta = dualS_diff(replica, storage);
+    dualS_apply_delta(replica, delta);
+    dualD_release(delta);
+    EXPECT_TRUE(dualS_exist(replica, e1));
+    dual_chunk_view_t view;
+    dualS_access(replica, e1, &view);
+    EXPECT_EQ(*(const test*)dualV_get_owned_ro(&view, type_test), 123);
+
+    dualS_set_version(storage, 1);
+    dualS_access(storage, e1, &view);
+    *(test*)dualV_get_owned_rw(&view, type_test) = 456;
+    delta = dualS_diff(replica, storage);
+    EIndex changed = 0;
+    auto callback = [&](const dual_group_delta_t* group) {
+        EXPECT_EQ(group->createdCount, 0);
+        changed += group->changedCount;
+    };
+    dualD_get_groups(delta, DUAL_LAMBDA(callback));
+    EXPECT_EQ(changed, 1);
+    dualS_apply_delta(replica, delta);
+    dualD_release(delta);
+    dualS_access(replica, e1, &view);
+    EXPECT_EQ(*(const test*)dualV_get_owned_ro(&view, type_test), 456);
+
+    dualS_set_version(storage, 2);
+    dualS_access(storage, e1, &view);
+    dualS_destroy(storage, &view);
+    delta = dualS_diff(replica, storage);
+    dualS_apply_delta(replica, delta);
+    dualD_release(delta);
+    EXPECT_FALSE(dualS_exist(replica, e1));
+    dualS_release(replica);
+}
+
+TEST_F(APITest, diff_incremental)
+{
+    dual_entity_type_t entityType;
+    entityType.type = { &type_test, 1 };
+    entityType.meta = { nullptr, 0 };
+    std::vector<dual_entity_t> ents;
+    // version is about to wrap, writes after wrap should still be seen
+    dualS_set_version(storage, 0xFFFFFFF0u);
+    auto callback = [&](dual_chunk_view_t* view) {
+        auto data = (test*)dualV_get_owned_rw(view, type_test);
+        auto es = dualV_get_entities(view);
+        for (uint32_t i = 0; i < view->count; ++i)
+        {
+            data[i] = (test)ents.size();
+            ents.push_back(es[i]);
+        }
+    };
+    dualS_allocate_type(storage, &entityType, 100, DUAL_LAMBDA(callback));
+    dual_storage_t* replicas[2] = { dualS_create(), dualS_create() };
+    for (auto replica : replicas)
+    {
+        auto delta = dualS_diff(replica, storage);
+        dualS_apply_delta(replica, delta);
+        dualD_release(delta);
+    }
+    auto destroy = [&](size_t start, size_t end) {
+        for (size_t i = start; i < end; ++i)
+        {
+            dual_chunk_view_t view;
+            dualS_access(storage, ents[i], &view);
+            dualS_destroy(storage, &view);
+        }
+    };
+    auto sync = [&](dual_storage_t* replica, EIndex expectDestroyed) {
+        auto delta = dualS_diff(replica, storage);
+        EIndex destroyed = 0;
+        auto countDestroyed = [&](dual_entity_t e) { destroyed++; };
+        dualD_get_destroyed(delta, DUAL_LAMBDA(countDestroyed));
+        EXPECT_EQ(destroyed, expectDestroyed);
+        dualS_apply_delta(replica, delta);
+        dualD_release(delta);
+    };
+
+    dualS_set_version(storage, 5);
+    destroy(0, 10);
+    dual_chunk_view_t view;
+    dualS_access(storage, e1, &view);
+    *(test*)dualV_get_owned_rw(&view, type_test) = 7;
+    sync(replicas[0], 10);
+    dualS_access(replicas[0], e1, &view);
+    EXPECT_EQ(*(const test*)dualV_get_owned_ro(&view, type_test), 7);
+
+    // replicas[0] trims the free log, the lagging one falls back to full scan
+    dualS_set_version(storage, 6);
+    destroy(10, 20);
+    sync(replicas[0], 10);
+    sync(replicas[1], 20);
+    for (auto replica : replicas)
+    {
+        for (size_t i = 0; i < ents.size(); ++i)
+            EXPECT_EQ(dualS_exist(replica, ents[i]), i >= 20);
+        dualS_access(replica, e1, &view);
+        EXPECT_EQ(*(const test*)dualV_get_owned_ro(&view, type_test), 7);
+        dualS_release(replica);
+    }
+}
+
+TEST_F(APITest, pool_stats)
+{
+    dual_pool_stats_t before, after;
+    dual_get_pool_stats(nullptr, &before, nullptr);
+    dual_entity_type_t entityType;
+    entityType.type = { &type_test, 1 };
+    entityType.meta = { nullptr, 0 };
+    for (int i = 0; i < 2; ++i)
+    {
+        auto temp = dualS_create();
+        dualS_allocate_type(temp, &entityType, 100000, nullptr, nullptr);
+        dualS_release(temp);
+    }
+    dual_get_pool_stats(nullptr, &after, nullptr);
+    // chunks freed by first storage are reused by second one
+    EXPECT_GT(after.hits, before.hits);
+}
+
+TEST_F(APITest, defragment_step)
+{
+    dual_entity_type_t entityType;
+    entityType.type = { &type_test, 1 };
+    entityType.meta = { nullptr, 0 };
+    auto callback = [&](dual_chunk_view_t* inView) {
+        auto t = (test*)dualV_get_owned_rw(inView, type_test);
+        auto ents = dualV_get_entities(inView);
+        for (uint32_t i = 0; i < inView->count; ++i)
+            t[i] = (test)ents[i];
+    };
+    // small batches are placed in default chunks
+    for (int i = 0; i < 100; ++i)
+        dualS_allocate_type(storage, &entityType, 1000, DUAL_LAMBDA(callback));
+    // leave every chunk half empty
+    std::vector<dual_chunk_view_t> views;
+    auto collectChunks = [&](dual_chunk_view_t* inView) { views.push_back(*inView); };
+    dualS_all(storage, false, false, DUAL_LAMBDA(collectChunks));
+    for (auto& view : views)
+    {
+        dual_chunk_view_t half = { view.chunk, 0, view.count / 2 };
+        dualS_destroy(storage, &half);
+    }
+    std::vector<dual_entity_t> alive;
+    auto collect = [&](dual_chunk_view_t* inView) {
+        auto ents = dualV_get_entities(inView);
+        alive.insert(alive.end(), ents, ents + inView->count);
+    };
+    dualS_all(storage, false, false, DUAL_LAMBDA(collect));
+
+    dual_defrag_options_t options = {};
+    dual_defrag_stats_t stats;
+    options.byteBudget = 1;
+    dualS_defragment_step(storage, &options, &stats);
+    EXPECT_GT(stats.pendingGroups, 0u);
+    float occupancy = stats.occupancy;
+    dualS_defragment_step(storage, nullptr, &stats);
+    EXPECT_GT(stats.freedChunks, 0u);
+    EXPECT_EQ(stats.pendingGroups, 0u);
+    EXPECT_GT(stats.occupancy, occupancy);
+    for (auto e : alive)
+    {
+        dual_chunk_view_t view;
+        dualS_access(storage, e, &view);
+        ASSERT_EQ(*(const test*)dualV_get_owned_ro(&view, type_test), (test)e);
+    }
+}
+
+TEST_F(APITest, memory_stats)
+{
+    dual_entity_type_t entityType;
+    entityType.type = { &type_test, 1 };
+    entityType.meta = { nullptr, 0 };
+    dualS_allocate_type(storage, &entityType, 1000, nullptr, nullptr);
+    dual_memory_stats_t stats;
+    dualS_get_memory_stats(storage, &stats);
+    EXPECT_EQ(stats.entityCount, 1001u);
+    EXPECT_GT(stats.chunkBytes, stats.usedBytes);
+    EXPECT_GT(stats.fillRatio, 0.f);
+    EXPECT_LE(stats.fillRatio, 1.f);
+
+    uint32_t archetypeCount = 0;
+    auto callback = [&](const dual_archetype_stats_t* archetype) {
+        ++archetypeCount;
+        EXPECT_EQ(archetype->memory.entityCount, 1001u);
+        EXPECT_EQ(archetype->components[0].type, type_test);
+        EXPECT_EQ(archetype->components[0].chunkBytes, 1001u * sizeof(test));
+    };
+    dualS_get_archetype_stats(storage, DUAL_LAMBDA(callback));
+    EXPECT_EQ(archetypeCount, 1u);
+}
+
+TEST_F(APITest, pool_trim)
+{
+    dual_pool_stats_t before, after;
+    dual_entity_type_t entityType;
+    entityType.type = { &type_test, 1 };
+    entityType.meta = { nullptr, 0 };
+    auto temp = dualS_create();
+    dualS_allocate_type(temp, &entityType, 100000, nullptr, nullptr);
+    dualS_release(temp);
+    dual_get_pool_stats(nullptr, &before, nullptr);
+    EXPECT_GT(dual_trim_pools(), 0u);
+    dual_get_pool_stats(nullptr, &after, nullptr);
+    EXPECT_LT(after.reservedBytes, before.reservedBytes);
+    EXPECT_EQ(after.globalCount, 0u);
+
+    // chunks freed above budget are returned instead of cached
+    dual_pool_config_t config = {};
+    config.normalBudget = after.reservedBytes;
+    dual_set_pool_config(&config);
+    temp = dualS_create();
+    dualS_allocate_type(temp, &entityType, 100000, nullptr, nullptr);
+    dualS_release(temp);
+    dual_get_pool_stats(nullptr, &after, nullptr);
+    EXPECT_LE(after.reservedBytes, after.budget);
+    EXPECT_GT(after.releasedBytes, before.releasedBytes);
+    config.normalBudget = 0;
+    dual_set_pool_config(&config);
+}
+
+TEST_F(APITest, command_buffer)
+{
+    dual_entity_type_t entityType;
+    entityType.type = { &type_test, 1 };
+    entityType.meta = { nullptr, 0 };
+    std::vector<dual_entity_t> ents;
+    auto callback = [&](dual_chunk_view_t* inView) {
+        auto t = (test*)dualV_get_owned_rw(inView, type_test);
+        auto es = dualV_get_entities(inView);
+        for (uint32_t i = 0; i < inView->count; ++i)
+            t[i] = (test)es[i];
+        ents.insert(ents.end(), es, es + inView->count);
+    };
+    dualS_allocate_type(storage, &entityType, 2000, DUAL_LAMBDA(callback));
+
+    auto buffer = dualB_create(storage);
+    dual_delta_type_t add;
+    zero(add);
+    add.added = { { &type_test2, 1 } };
+    // first thread retags even entities, second one destroys every fourth entity and spawns new ones
+    std::thread caster([&] {
+        for (size_t i = 0; i < ents.size(); i += 2)
+        {
+            test value = (test)ents[i] * 2;
+            dualB_cast(buffer, ents[i], &add);
+            dualB_set(buffer, ents[i], type_test2, &value);
+        }
+    });
+    std::thread destroyer([&] {
+        for (size_t i = 0; i < ents.size(); i += 4)
+            dualB_destroy(buffer, ents[i]);
+        dualB_spawn(buffer, &entityType, 50, nullptr, nullptr);
+        dualB_spawn(buffer, &entityType, 50, nullptr, nullptr);
+    });
+    caster.join();
+    destroyer.join();
+    dualB_playback(buffer);
+    dualB_release(buffer);
+
+    for (size_t i = 0; i < ents.size(); ++i)
+    {
+        if (i % 4 == 0)
+        {
+            EXPECT_FALSE(dualS_exist(storage, ents[i]));
+            continue;
+        }
+        dual_chunk_view_t view;
+        dualS_access(storage, ents[i], &view);
+        ASSERT_EQ(*(const test*)dualV_get_owned_ro(&view, type_test), (test)ents[i]);
+        auto t2 = (const test*)dualV_get_owned_ro(&view, type_test2);
+        if (i % 2 == 0)
+        {
+            ASSERT_NE(t2, nullptr);
+            ASSERT_EQ(*t2, (test)ents[i] * 2);
+        }
+        else
+            EXPECT_EQ(t2, nullptr);
+    }
+    dual_memory_stats_t stats;
+    dualS_get_memory_stats(storage, &stats);
+    EXPECT_EQ(stats.entityCount, 1u + 1500u + 100u);
+}
+
+TEST_F(APITest, reserve_entities)
+{
+    dual_entity_type_t entityType;
+    entityType.type = { &type_test, 1 };
+    entityType.meta = { nullptr, 0 };
+    std::vector<dual_entity_t> ents;
+    auto callback = [&](dual_chunk_view_t* inView) {
+        auto es = dualV_get_entities(inView);
+        ents.insert(ents.end(), es, es + inView->count);
+    };
+    dualS_allocate_type(storage, &entityType, 1000, DUAL_LAMBDA(callback));
+    for (size_t i = 0; i < 500; ++i)
+    {
+        dual_chunk_view_t view;
+        dualS_access(storage, ents[i], &view);
+        dualS_destroy(storage, &view);
+    }
+    dualS_share_free_entities(storage, 300);
+
+    // reserving threads take shared ids first, then new ids
+    auto buffer = dualB_create(storage);
+    std::vector<dual_entity_t> reserved[2];
+    auto reserve = [&](std::vector<dual_entity_t>& result) {
+        for (int i = 0; i < 10; ++i)
+        {
+            dual_entity_t es[40];
+            dualS_reserve_entities(storage, es, 40);
+            result.insert(result.end(), es, es + 40);
+            dualB_spawn_reserved(buffer, &entityType, es, 40, nullptr, nullptr);
+        }
+    };
+    std::thread first([&] { reserve(reserved[0]); });
+    std::thread second([&] { reserve(reserved[1]); });
+    first.join();
+    second.join();
+    std::vector<dual_entity_t> all = reserved[0];
+    all.insert(all.end(), reserved[1].begin(), reserved[1].end());
+    for (auto e : all)
+        EXPECT_FALSE(dualS_exist(storage, e));
+    dualB_playback(buffer);
+    dualB_release(buffer);
+
+    for (auto e : all)
+        EXPECT_TRUE(dualS_exist(storage, e));
+    std::sort(all.begin(), all.end());
+    EXPECT_EQ(std::unique(all.begin(), all.end()), all.end());
+    for (size_t i = 0; i < 500; ++i)
+        EXPECT_FALSE(dualS_exist(storage, ents[i]));
+    dual_memory_stats_t stats;
+    dualS_get_memory_stats(storage, &stats);
+    EXPECT_EQ(stats.entityCount, 1u + 500u + 800u);
+}
+
+TEST_F(APITest, reserved_spawn_commands)
+{
+    dual_entity_type_t entityType;
+    entityType.type = { &type_test, 1 };
+    entityType.meta = { nullptr, 0 };
+    dual_delta_type_t add;
+    zero(add);
+    add.added = { { &type_test2, 1 } };
+    // reserved entities are initialized and retagged in the buffer spawning them
+    dual_entity_t ents[100];
+    dualS_reserve_entities(storage, ents, 100);
+    auto buffer = dualB_create(storage);
+    dualB_spawn_reserved(buffer, &entityType, ents, 100, nullptr, nullptr);
+    for (int i = 0; i < 100; ++i)
+    {
+        test value = i;
+        dualB_set(buffer, ents[i], type_test, &value);
+        if (i % 2 != 0)
+            continue;
+        value = i * 2;
+        dualB_cast(buffer, ents[i], &add);
+        dualB_set(buffer, ents[i], type_test2, &value);
+    }
+    dualB_destroy(buffer, ents[99]);
+    dualB_playback(buffer);
+    dualB_release(buffer);
+
+    EXPECT_FALSE(dualS_exist(storage, ents[99]));
+    for (int i = 0; i < 99; ++i)
+    {
+        ASSERT_TRUE(dualS_exist(storage, ents[i]));
+        dual_chunk_view_t view;
+        dualS_access(storage, ents[i], &view);
+        EXPECT_EQ(*(const test*)dualV_get_owned_ro(&view, type_test), i);
+        auto t2 = (const test*)dualV_get_owned_ro(&view, type_test2);
+        if (i % 2 == 0)
+        {
+            ASSERT_NE(t2, nullptr);
+            EXPECT_EQ(*t2, i * 2);
+        }
+        else
+            EXPECT_EQ(t2, nullptr);
+    }
+    dual_memory_stats_t stats;
+    dualS_get_memory_stats(storage, &stats);
+    EXPECT_EQ(stats.entityCount, 1u + 99u);
+}
+
+TEST_F(APITest, drop_reserved_entities)
+{
+    dual_entity_type_t entityType;
+    entityType.type = { &type_test, 1 };
+    entityType.meta = { nullptr, 0 };
+    dual_entity_t es[40];
+    dualS_reserve_entities(storage, es, 40);
+    auto buffer = dualB_create(storage);
+    dualB_spawn_reserved(buffer, &entityType, es, 20, nullptr, nullptr);
+    dualB_clear(buffer);
+    dualB_spawn_reserved(buffer, &entityType, es + 20, 20, nullptr, nullptr);
+    dualB_release(buffer);
+    for (auto e : es)
+        EXPECT_FALSE(dualS_exist(storage, e));
+
+    // dropped ids are recycled with new version
+    dualS_allocate_type(storage, &entityType, 40, nullptr, nullptr);
+    for (auto e : es)
+        EXPECT_FALSE(dualS_exist(storage, e));
+    dual_memory_stats_t stats;
+    dualS_get_memory_stats(storage, &stats);
+    EXPECT_EQ(stats.entityCount, 41u);
+    // no id is pending any more, so storage can be packed
+    dualS_pack_entities(storage);
+    EXPECT_TRUE(dualS_exist(storage, e1));
+}
+
+TEST_F(APITest, chunk_image)
+{
+    using test_array = dual::array_component_T<test, 4>;
+    static_assert(sizeof(test_array) == sizeof(test) * 10, "layout of test_arr");
+    dual_type_index_t types[] = { type_test, type_test_arr, type_managed };
+    std::sort(types, types + 3);
+    dual_entity_type_t entityType;
+    entityType.type = { types, 3 };
+    entityType.meta = { nullptr, 0 };
+    std::vector<dual_entity_t> ents;
+    // arrays longer than 4 are moved to heap
+    auto callback = [&](dual_chunk_view_t* inView) {
+        auto t = (test*)dualV_get_owned_rw(inView, type_test);
+        auto arrays = (test_array*)dualV_get_owned_rw(inView, type_test_arr);
+        auto es = dualV_get_entities(inView);
+        for (uint32_t i = 0; i < inView->count; ++i)
+        {
+            t[i] = (test)es[i];
+            for (test j = 0; j < (test)(es[i] % 8); ++j)
+                arrays[i].push_back(j);
+        }
+        ents.insert(ents.end(), es, es + inView->count);
+    };
+    dualS_allocate_type(storage, &entityType, 3000, DUAL_LAMBDA(callback));
+
+    std::vector<char> image;
+    dual_serializer_v writer;
+    writer.stream = +[](void* u, void* data, uint32_t bytes) {
+        auto buffer = (std::vector<char>*)u;
+        buffer->insert(buffer->end(), (char*)data, (char*)data + bytes);
+    };
+    writer.peek = nullptr;
+    writer.is_serialize = +[](void*) { return 1; };
+    dualS_serialize_image(storage, &writer, &image);
+
+    auto loaded = dualS_create();
+    ASSERT_TRUE(dualS_deserialize_image(loaded, image.data(), image.size()));
+    EXPECT_TRUE(dualS_exist(loaded, e1));
+    for (auto e : ents)
+    {
+        ASSERT_TRUE(dualS_exist(loaded, e));
+        dual_chunk_view_t view;
+        dualS_access(loaded, e, &view);
+        EXPECT_EQ(*(const test*)dualV_get_owned_ro(&view, type_test), (test)e);
+        EXPECT_NE(dualV_get_owned_ro(&view, type_managed), nullptr);
+        auto& array = *(const test_array*)dualV_get_owned_ro(&view, type_test_arr);
+        ASSERT_EQ(array.size(), e % 8);
+        for (size_t j = 0; j < array.size(); ++j)
+            EXPECT_EQ(array[j], (test)j);
+    }
+    dualS_release(loaded);
+
+    // truncated image is rejected and storage can still be released
+    auto truncated = dualS_create();
+    EXPECT_FALSE(dualS_deserialize_image(truncated, image.data(), image.size() / 2));
+    dualS_release(truncated);
+    // chunk with entity out of range is rejected after its rows are allocated, rows should still be released safely
+    auto corrupted = image;
+    auto target = ents[1500];
+    auto pos = std::search(corrupted.begin(), corrupted.end(), (char*)&target, (char*)(&target + 1));
+    ASSERT_NE(pos, corrupted.end());
+    dual_entity_t outOfRange = 0x00FFFFF0;
+    std::memcpy(&*pos, &outOfRange, sizeof(dual_entity_t));
+    auto rejected = dualS_create();
+    EXPECT_FALSE(dualS_deserialize_image(rejected, corrupted.data(), corrupted.size()));
+    dualS_release(rejected);
+}
+
+TEST_F(APITest, image_sections)
+{
+    // two regions share their meta entity, entities refer to the previous one of their region
+    dual_entity_t regions[2];
+    {
+        dual_entity_type_t regionType;
+        regionType.type = { &type_test, 1 };
+        regionType.meta = { nullptr, 0 };
+        int k = 0;
+        auto callback = [&](dual_chunk_view_t* inView) {
+            auto t = (test*)dualV_get_owned_rw(inView, type_test);
+            for (uint32_t i = 0; i < inView->count; ++i, ++k)
+            {
+                t[i] = -1 - k;
+                regions[k] = dualV_get_entities(inView)[i];
+            }
+        };
+        dualS_allocate_type(storage, &regionType, 2, DUAL_LAMBDA(callback));
+    }
+    dual_type_index_t types[] = { type_test, type_ref };
+    std::sort(types, types + 2);
+    dual_entity_t first[2];
+    for (int r = 0; r < 2; ++r)
+    {
+        dual_entity_type_t entityType;
+        entityType.type = { types, 2 };
+        entityType.meta = { &regions[r], 1 };
+        dual_entity_t last = (dual_entity_t)NULL_ENTITY;
+        test value = 0;
+        auto callback = [&](dual_chunk_view_t* inView) {
+            auto t = (test*)dualV_get_owned_rw(inView, type_test);
+            auto refs = (ref*)dualV_get_owned_rw(inView, type_ref);
+            auto es = dualV_get_entities(inView);
+            for (uint32_t i = 0; i < inView->count; ++i)
+            {
+                if (value == 0)
+                    first[r] = es[i];
+                t[i] = value++;
+                refs[i] = last;
+                last = es[i];
+            }
+        };
+        dualS_allocate_type(storage, &entityType, 100 * (r + 1), DUAL_LAMBDA(callback));
+    }
+    // first entity of region 0 refers to region 1 which is not loaded
+    {
+        dual_chunk_view_t view;
+        dualS_access(storage, first[0], &view);
+        *(ref*)dualV_get_owned_rw(&view, type_ref) = first[1];
+    }
+
+    std::vector<char> image;
+    dual_serializer_v writer;
+    writer.stream = +[](void* u, void* data, uint32_t bytes) {
+        auto buffer = (std::vector<char>*)u;
+        buffer->insert(buffer->end(), (char*)data, (char*)data + bytes);
+    };
+    writer.peek = nullptr;
+    writer.is_serialize = +[](void*) { return 1; };
+    dualS_serialize_image(storage, &writer, &image);
+
+    // index is read by growing prefix
+    size_t indexSize = dualS_image_index_size(image.data(), 0);
+    ASSERT_NE(indexSize, 0u);
+    indexSize = dualS_image_index_size(image.data(), indexSize);
+    ASSERT_NE(indexSize, 0u);
+    ASSERT_EQ(dualS_image_index_size(image.data(), indexSize), indexSize);
+
+    dual_filter_t filter;
+    zero(filter);
+    filter.all = { &type_test, 1 };
+    filter.none = { &type_ref, 1 };
+    dual_meta_filter_t meta;
+    zero(meta);
+    meta.all_meta = { &regions[0], 1 };
+    dual_image_section_t sections[4];
+    ASSERT_EQ(dualS_select_image_sections(image.data(), indexSize, nullptr, &meta, sections, 4), 1u);
+    EXPECT_EQ(sections[0].entityCount, 100u);
+    ASSERT_EQ(dualS_select_image_sections(image.data(), indexSize, &filter, nullptr, sections + 1, 3), 1u);
+    EXPECT_EQ(sections[1].entityCount, 3u);
+
+    auto staging = dualS_create();
+    for (int i = 0; i < 2; ++i)
+        ASSERT_TRUE(dualS_load_image_section(staging, image.data(), indexSize, image.data() + sections[i].offset, sections[i].size));
+    EXPECT_TRUE(dualS_exist(staging, first[0]));
+    EXPECT_FALSE(dualS_exist(staging, first[1]));
+
+    auto world = dualS_create();
+    dualS_merge(world, staging);
+    dualS_release(staging);
+    dual_memory_stats_t stats;
+    dualS_get_memory_stats(world, &stats);
+    EXPECT_EQ(stats.entityCount, 103u);
+
+    // region meta entity is found by its value, entities of region are queried through it
+    dual_meta_filter_t noMeta;
+    zero(noMeta);
+    dual_entity_t region = (dual_entity_t)NULL_ENTITY;
+    auto findRegion = [&](dual_chunk_view_t* inView) {
+        auto t = (const test*)dualV_get_owned_ro(inView, type_test);
+        for (uint32_t i = 0; i < inView->count; ++i)
+            if (t[i] == -1)
+                region = dualV_get_entities(inView)[i];
+    };
+    dualS_query(world, &filter, &noMeta, DUAL_LAMBDA(findRegion));
+    ASSERT_NE(region, (dual_entity_t)NULL_ENTITY);
+    dual_filter_t refFilter;
+    zero(refFilter);
+    refFilter.all = { types, 2 };
+    meta.all_meta = { &region, 1 };
+    uint32_t count = 0;
+    auto check = [&](dual_chunk_view_t* inView) {
+        auto t = (const test*)dualV_get_owned_ro(inView, type_test);
+        auto refs = (const ref*)dualV_get_owned_ro(inView, type_ref);
+        for (uint32_t i = 0; i < inView->count; ++i, ++count)
+        {
+            if (t[i] == 0)
+            {
+                EXPECT_EQ(refs[i], (dual_entity_t)NULL_ENTITY);
+                continue;
+            }
+            ASSERT_TRUE(dualS_exist(world, refs[i]));
+            dual_chunk_view_t view;
+            dualS_access(world, refs[i], &view);
+            EXPECT_EQ(*(const test*)dualV_get_owned_ro(&view, type_test), t[i] - 1);
+        }
+    };
+    dualS_query(world, &refFilter, &meta, DUAL_LAMBDA(check));
+    EXPECT_EQ(count, 100u);
+
+    // region is unloaded by its meta entity
+    dualS_destroy_all(world, &meta);
+    dualS_get_memory_stats(world, &stats);
+    EXPECT_EQ(stats.entityCount, 3u);
+    dualS_release(world);
+}
+
+TEST_F(APITest, merge_chunks)
+{
+    using test_array = dual::array_component_T<test, 4>;
+    dual_type_index_t types[] = { type_test, type_test_arr };
+    std::sort(types, types + 2);
+    dual_entity_type_t entityType;
+    entityType.type = { types, 2 };
+    entityType.meta = { nullptr, 0 };
+    test next = 0;
+    // arrays stay inline so they have to be fixed when entities are moved between chunks
+    auto callback = [&](dual_chunk_view_t* inView) {
+        auto t = (test*)dualV_get_owned_rw(inView, type_test);
+        auto arrays = (test_array*)dualV_get_owned_rw(inView, type_test_arr);
+        for (uint32_t i = 0; i < inView->count; ++i, ++next)
+        {
+            t[i] = next;
+            for (test j = 0; j < next % 4; ++j)
+                arrays[i].push_back(next + j);
+        }
+    };
+    dualS_allocate_type(storage, &entityType, 6, DUAL_LAMBDA(callback));
+    auto source = dualS_create();
+    dualS_allocate_type(source, &entityType, 6, DUAL_LAMBDA(callback));
+    dualS_merge(storage, source);
+    dualS_release(source);
+
+    // partial chunks of source are coalesced into chunks of storage
+    dual_memory_stats_t stats;
+    dualS_get_memory_stats(storage, &stats);
+    EXPECT_EQ(stats.entityCount, 13u);
+    EXPECT_EQ(stats.chunkCount[0] + stats.chunkCount[1] + stats.chunkCount[2], 2u);
+    std::vector<bool> found(12, false);
+    auto check = [&](dual_chunk_view_t* inView) {
+        auto t = (const test*)dualV_get_owned_ro(inView, type_test);
+        auto arrays = (const test_array*)dualV_get_owned_ro(inView, type_test_arr);
+        auto es = dualV_get_entities(inView);
+        for (uint32_t i = 0; i < inView->count; ++i)
+        {
+            ASSERT_TRUE(t[i] >= 0 && t[i] < 12);
+            found[t[i]] = true;
+            dual_chunk_view_t view;
+            dualS_access(storage, es[i], &view);
+            EXPECT_EQ(*(const test*)dualV_get_owned_ro(&view, type_test), t[i]);
+            ASSERT_EQ(arrays[i].size(), (size_t)(t[i] % 4));
+            for (size_t j = 0; j < arrays[i].size(); ++j)
+                EXPECT_EQ(arrays[i][j], t[i] + (test)j);
+        }
+    };
+    dual_filter_t filter;
+    zero(filter);
+    filter.all = { types, 2 };
+    dual_meta_filter_t meta;
+    zero(meta);
+    dualS_query(storage, &filter, &meta, DUAL_LAMBDA(check));
+    EXPECT_EQ(std::count(found.begin(), found.end(), true), 12);
+}
+
+TEST_F(APITest, snapshot)
+{
+    using test_array = dual::array_component_T<test, 4>;
+    dual_type_index_t types[] = { type_test, type_test_arr };
+    std::sort(types, types + 2);
+    dual_entity_type_t entityType;
+    entityType.type = { types, 2 };
+    entityType.meta = { nullptr, 0 };
+    test next = 0;
+    std::vector<dual_entity_t> ents;
+    auto callback = [&](dual_chunk_view_t* inView) {
+        auto t = (test*)dualV_get_owned_rw(inView, type_test);
+        auto arrays = (test_array*)dualV_get_owned_rw(inView, type_test_arr);
+        auto es = dualV_get_entities(inView);
+        for (uint32_t i = 0; i < inView->count; ++i, ++next)
+        {
+            t[i] = next;
+            // some arrays outgrow inline capacity
+            for (test j = 0; j < next % 8; ++j)
+                arrays[i].push_back(next + j);
+            ents.push_back(es[i]);
+        }
+    };
+    dualS_allocate_type(storage, &entityType, 10, DUAL_LAMBDA(callback));
+    auto snapshot = dualS_snapshot(storage);
+
+    // write, destroy and spawn after capture
+    dual_chunk_view_t view;
+    dualS_access(storage, e1, &view);
+    *(test*)dualV_get_owned_rw(&view, type_test) = 456;
+    dualS_access(storage, ents[2], &view);
+    dualS_destroy(storage, &view);
+    dualS_allocate_type(storage, &entityType, 5, DUAL_LAMBDA(callback));
+
+    test total = 0;
+    uint32_t count = 0;
+    auto check = [&](dual_chunk_view_t* inView) {
+        auto t = (const test*)dualV_get_owned_ro(inView, type_test);
+        auto arrays = (const test_array*)dualV_get_owned_ro(inView, type_test_arr);
+        for (uint32_t i = 0; i < inView->count; ++i)
+        {
+            total += t[i];
+            ++count;
+            if (!arrays)
+                continue;
+            ASSERT_EQ(arrays[i].size(), (size_t)(t[i] % 8));
+            for (size_t j = 0; j < arrays[i].size(); ++j)
+                EXPECT_EQ(arrays[i][j], t[i] + (test)j);
+        }
+    };
+    dual_filter_t filter;
+    zero(filter);
+    filter.all = { &type_test, 1 };
+    dualS_query_snapshot(snapshot, &filter, nullptr, DUAL_LAMBDA(check));
+    EXPECT_EQ(count, 11u);
+    EXPECT_EQ(total, 123 + 45);
+
+    dual_meta_filter_t meta;
+    zero(meta);
+    total = 0;
+    count = 0;
+    dualS_query(storage, &filter, &meta, DUAL_LAMBDA(check));
+    EXPECT_EQ(count, 15u);
+    EXPECT_EQ(total, 456 + 45 - 2 + 10 + 11 + 12 + 13 + 14);
+    dualS_release_snapshot(snapshot);
+}
+
+template <>
+dual_type_index_t dual_id_of<test>::get()
+{
+    return type_test;
+}
+
+template <>
+dual_type_index_t dual_id_of<ref>::get()
+{
+    return type_ref;
+}
+
+TEST_F(APITest, typed_query)
+{
+    dual_type_index_t types[] = { type_test, type_ref };
+    std::sort(types, types + 2);
+    dual_entity_type_t entityType;
+    entityType.type = { types, 2 };
+    entityType.meta = { nullptr, 0 };
+    auto init = [&](dual_chunk_view_t* inView) {
+        auto t = (test*)dualV_get_owned_rw(inView, type_test);
+        auto r = (ref*)dualV_get_owned_rw(inView, type_ref);
+        for (uint32_t i = 0; i < inView->count; ++i)
+        {
+            t[i] = 1;
+            r[i] = (ref)NULL_ENTITY;
+        }
+    };
+    dualS_allocate_type(storage, &entityType, 10, DUAL_LAMBDA(init));
+
+    using query_t = dual::query_T<dual::inout<test>, dual::opt<ref>>;
+    static_assert(std::is_same_v<query_t::column_t<dual::inout<test>>, dual::column_T<test>>);
+    static_assert(std::is_same_v<query_t::column_t<dual::opt<ref>>, dual::column_T<const ref>>);
+    query_t query(storage);
+    uint32_t count = 0, withRef = 0;
+    auto update = [&](dual_chunk_view_t* view, dual::column_T<test> t, dual::column_T<const ref> r) {
+        for (auto& value : t)
+            value += 1;
+        count += view->count;
+        if (r)
+            withRef += r.count;
+    };
+    query.each(update);
+    EXPECT_EQ(count, 11u);
+    EXPECT_EQ(withRef, 10u);
+
+    // e1 from setup is 123, the others are 1
+    test total = 0;
+    dual::query_T<test> reader(storage);
+    auto sum = [&](dual_chunk_view_t* view, dual::column_T<const test> t) {
+        for (EIndex i = 0; i < t.count; ++i)
+            total += t[i];
+    };
+    reader.each(sum);
+    EXPECT_EQ(total, 124 + 20);
+}
+
+TEST_F(APITest, soa_component)
+{
+    dual_type_index_t types[] = { type_test, type_soa };
+    std::sort(types, types + 2);
+    dual_entity_type_t entityType;
+    entityType.type = { types, 2 };
+    entityType.meta = { nullptr, 0 };
+    std::vector<dual_entity_t> ents;
+    auto init = [&](dual_chunk_view_t* inView) {
+        auto x = (float*)dualV_get_field_rw(inView, type_soa, 0);
+        auto y = (float*)dualV_get_field_rw(inView, type_soa, 1);
+        auto z = (float*)dualV_get_field_rw(inView, type_soa, 2);
+        // each field is a sub column of chunk capacity
+        EXPECT_EQ((char*)y - (char*)x, (char*)z - (char*)y);
+        EXPECT_GE((size_t)((char*)y - (char*)x), sizeof(float) * inView->count);
+        auto es = dualV_get_entities(inView);
+        for (uint32_t i = 0; i < inView->count; ++i)
+        {
+            x[i] = (float)ents.size();
+            y[i] = x[i] * 2;
+            z[i] = x[i] * 3;
+            ents.push_back(es[i]);
+        }
+    };
+    dualS_allocate_type(storage, &entityType, 100, DUAL_LAMBDA(init));
+    ASSERT_EQ(ents.size(), 100u);
+
+    auto check = [&](dual_entity_t e, float value) {
+        dual_chunk_view_t view;
+        dualS_access(storage, e, &view);
+        EXPECT_EQ(*(const float*)dualV_get_field_ro(&view, type_soa, 0), value);
+        EXPECT_EQ(*(const float*)dualV_get_field_ro(&view, type_soa, 1), value * 2);
+        EXPECT_EQ(*(const float*)dualV_get_field_ro(&view, type_soa, 2), value * 3);
+    };
+    // fields move with entity when casting and destroying
+    {
+        dual_chunk_view_t view;
+        dualS_access(storage, ents[10], &view);
+        dual_delta_type_t deltaType;
+        zero(deltaType);
+        deltaType.added = { { &type_test2, 1 } };
+        dualS_cast_view_delta(storage, &view, &deltaType, nullptr, nullptr);
+        check(ents[10], 10.f);
+        dualS_access(storage, ents[0], &view);
+        dualS_destroy(storage, &view);
+        check(ents[99], 99.f);
+    }
+    // fields are duplicated when instantiating
+    {
+        dual_chunk_view_t view;
+        auto callback = [&](dual_chunk_view_t* inView) { view = *inView; };
+        dualS_instantiate(storage, ents[5], 3, DUAL_LAMBDA(callback));
+        auto y = (const float*)dualV_get_field_ro(&view, type_soa, 1);
+        EXPECT_EQ(y[0], 10.f);
+        EXPECT_EQ(y[2], 10.f);
+    }
+    // command payload is scattered to fields
+    {
+        auto buffer = dualB_create(storage);
+        soa value = { 1.f, 2.f, 3.f };
+        dualB_set(buffer, ents[20], type_soa, &value);
+        dualB_playback(buffer);
+        dualB_release(buffer);
+        check(ents[20], 1.f);
+    }
+
+    dual_type_description_t desc;
+    zero(desc);
+    desc.name = "soa_managed";
+    desc.size = sizeof(soa);
+    desc.elementSize = sizeof(float);
+    desc.alignment = alignof(soa);
+    desc.flags = DTF_SOA;
+    desc.callback.destructor = +[](dual_chunk_t* chunk, EIndex index, char* data) {};
+    EXPECT_EQ(dualT_register_type(&desc), dual::kInvalidTypeIndex);
+    // callbacks would be called with a slice of one field
+    desc.callback = {};
+    desc.callback.constructor = +[](dual_chunk_t* chunk, EIndex index, char* data) {};
+    EXPECT_EQ(dualT_register_type(&desc), dual::kInvalidTypeIndex);
+    desc.callback = {};
+    desc.callback.serialize = +[](dual_chunk_t* chunk, EIndex index, char* data, EIndex count, const dual_serializer_v* v, void* s) {};
+    EXPECT_EQ(dualT_register_type(&desc), dual::kInvalidTypeIndex);
+}
+
+TEST_F(APITest, mask_runs)
+{
+    dual_type_index_t types[] = { type_test, type_test2, dualT_get_mask_type() };
+    std::sort(types, types + 3);
+    dual_entity_type_t entityType;
+    entityType.type = { types, 3 };
+    entityType.meta = { nullptr, 0 };
+    std::vector<dual_entity_t> ents;
+    auto init = [&](dual_chunk_view_t* inView) {
+        auto es = dualV_get_entities(inView);
+        ents.insert(ents.end(), es, es + inView->count);
+    };
+    dualS_allocate_type(storage, &entityType, 300, DUAL_LAMBDA(init));
+    ASSERT_EQ(ents.size(), 300u);
+    // runs crossing 64 entity words and single holes
+    auto disabled = [](size_t i) { return (i >= 60 && i < 200) || i % 7 == 0; };
+    dual_type_set_t toggled = { &type_test2, 1 };
+    for (size_t i = 0; i < ents.size(); ++i)
+    {
+        if (!disabled(i))
+            continue;
+        dual_chunk_view_t view;
+        dualS_access(storage, ents[i], &view);
+        dualS_disable_components(&view, &toggled);
+    }
+
+    auto collect = [&](dual_filter_t& filter, dual_meta_filter_t& meta) {
+        std::vector<dual_entity_t> result;
+        auto callback = [&](dual_chunk_view_t* view) {
+            EXPECT_GT(view->count, 0u);
+            auto es = dualV_get_entities(view);
+            result.insert(result.end(), es, es + view->count);
+        };
+        dualS_query(storage, &filter, &meta, DUAL_LAMBDA(callback));
+        std::sort(result.begin(), result.end());
+        return result;
+    };
+    // e1 from setup has no type_test2
+    std::vector<dual_entity_t> enabled, disabledEnts = { e1 };
+    for (size_t i = 0; i < ents.size(); ++i)
+        (disabled(i) ? disabledEnts : enabled).push_back(ents[i]);
+    std::sort(enabled.begin(), enabled.end());
+    std::sort(disabledEnts.begin(), disabledEnts.end());
+
+    dual_filter_t filter;
+    zero(filter);
+    dual_meta_filter_t meta;
+    zero(meta);
+    filter.all = { &type_test2, 1 };
+    EXPECT_EQ(collect(filter, meta), enabled);
+    filter.all = { &type_test, 1 };
+    filter.none = { &type_test2, 1 };
+    EXPECT_EQ(collect(filter, meta), disabledEnts);
+
+    // chunks not written after the timestamp are skipped
+    dualS_set_version(storage, 10);
+    meta.changed = { &type_test2, 1 };
+    meta.timestamp = 10;
+    filter.all = { &type_test2, 1 };
+    filter.none = { nullptr, 0 };
+    EXPECT_TRUE(collect(filter, meta).empty());
+    meta.timestamp = 9;
+    {
+        dual_chunk_view_t view;
+        dualS_access(storage, ents[0], &view);
+        dualV_get_owned_rw(&view, type_test2);
+    }
+    EXPECT_EQ(collect(filter, meta), enabled);
+}
+
+TEST_F(JobTest, schedule_for)
+{
+    constexpr uint32_t count = 100000;
+    std::unique_ptr<std::atomic<uint32_t>[]> visited(new std::atomic<uint32_t>[count]);
+    for (uint32_t i = 0; i < count; ++i)
+        visited[i] = 0;
+    auto callback = [&](uint32_t index) { visited[index]++; };
+    dual_counter_t* counter = nullptr;
+    dualJ_schedule_for(count, DUAL_LAMBDA(callback), nullptr, &counter);
+    ASSERT_NE(counter, nullptr);
+    dualJ_wait_counter(counter, 1);
+    dualJ_release_counter(counter);
+    uint32_t wrong = 0;
+    for (uint32_t i = 0; i < count; ++i)
+        wrong += visited[i] != 1;
+    EXPECT_EQ(wrong, 0);
+}
+
+TEST_F(JobTest, many_readers)
+{
+    // writer depends on more readers than job lists hold inline
+    constexpr uint32_t readerCount = 12;
+    constexpr uint32_t count = 64;
+    dual_entity_t resource = dualJ_add_resource();
+    int readonly = 1, readwrite = 0, atomic = 0;
+    dual_resource_operation_t read = { &resource, &readonly, &atomic, 1 };
+    dual_resource_operation_t write = { &resource, &readwrite, &atomic, 1 };
+    std::atomic<uint32_t> reads{ 0 };
+    auto reader = [&](uint32_t) {
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+        reads.fetch_add(1);
+    };
+    for (uint32_t i = 0; i < readerCount; ++i)
+        dualJ_schedule_for(count, DUAL_LAMBDA(reader), &read, nullptr);
+    uint32_t seen = 0;
+    auto writer = [&](uint32_t) { seen = reads.load(); };
+    dual_counter_t* counter = nullptr;
+    dualJ_schedule_for(1, DUAL_LAMBDA(writer), &write, &counter);
+    dualJ_wait_counter(counter, 1);
+    dualJ_release_counter(counter);
+    EXPECT_EQ(seen, readerCount * count);
+    dualJ_wait_all();
+    dualJ_remove_resource(resource);
+}
+
+TEST_F(JobTest, system_graph)
+{
+    dual_type_index_t types[] = { type_test, type_test2 };
+    std::sort(types, types + 2);
+    dual_entity_type_t entityType;
+    entityType.type = { types, 2 };
+    entityType.meta = { nullptr, 0 };
+    auto init = [&](dual_chunk_view_t* view) {
+        auto a = (test*)dualV_get_owned_rw(view, type_test);
+        auto b = (test*)dualV_get_owned_rw(view, type_test2);
+        for (uint32_t i = 0; i < view->count; ++i)
+        {
+            a[i] = 0;
+            b[i] = 0;
+        }
+    };
+    dualS_allocate_type(storage, &entityType, 5000, DUAL_LAMBDA(init));
+
+    auto writer = +[](void*, dual_storage_t*, dual_chunk_view_t* view, dual_type_index_t* localTypes, EIndex) {
+        auto a = (test*)dualV_get_owned_rw_local(view, localTypes[0]);
+        for (uint32_t i = 0; i < view->count; ++i)
+            a[i] += 1;
+    };
+    auto reader = +[](void*, dual_storage_t*, dual_chunk_view_t* view, dual_type_index_t* localTypes, EIndex) {
+        auto a = (const test*)dualV_get_owned_ro_local(view, localTypes[0]);
+        auto b = (test*)dualV_get_owned_rw_local(view, localTypes[1]);
+        for (uint32_t i = 0; i < view->count; ++i)
+            b[i] = a[i] * 2;
+    };
+    auto writeQuery = dualQ_from_literal(storage, "[inout]test");
+    auto readQuery = dualQ_from_literal(storage, "[in]test, [inout]test2");
+    ASSERT_NE(writeQuery, nullptr);
+    ASSERT_NE(readQuery, nullptr);
+    auto graph = dualJ_create_graph(storage);
+    dual_system_description_t desc;
+    zero(desc);
+    desc.batchSize = 256;
+    desc.query = writeQuery;
+    desc.callback = writer;
+    dualJ_add_system(graph, &desc);
+    desc.query = readQuery;
+    desc.callback = reader;
+    dualJ_add_system(graph, &desc);
+
+    dual_filter_t filter;
+    zero(filter);
+    filter.all = { types, 2 };
+    dual_meta_filter_t meta;
+    zero(meta);
+    for (int frame = 0; frame < 3; ++frame)
+    {
+        // new group is picked up by recompiled graph
+        if (frame == 1)
+        {
+            dual_type_index_t refTypes[] = { type_test, type_test2, type_ref };
+            std::sort(refTypes, refTypes + 3);
+            dual_entity_type_t refType;
+            refType.type = { refTypes, 3 };
+            refType.meta = { nullptr, 0 };
+            dualS_allocate_type(storage, &refType, 3000, DUAL_LAMBDA(init));
+        }
+        dual_counter_t* counter = nullptr;
+        dualJ_dispatch_graph(graph, &counter);
+        dualJ_wait_counter(counter, 1);
+        dualJ_release_counter(counter);
+        uint32_t count = 0, wrong = 0;
+        auto check = [&](dual_chunk_view_t* view) {
+            auto a = (const test*)dualV_get_owned_ro(view, type_test);
+            auto b = (const test*)dualV_get_owned_ro(view, type_test2);
+            // entities of new group missed the first frame
+            test expected = dualV_get_owned_ro(view, type_ref) ? frame : frame + 1;
+            for (uint32_t i = 0; i < view->count; ++i)
+                wrong += a[i] != expected || b[i] != expected * 2;
+            count += view->count;
+        };
+        dualS_query(storage, &filter, &meta, DUAL_LAMBDA(check));
+        EXPECT_EQ(count, frame == 0 ? 5000u : 8000u);
+        EXPECT_EQ(wrong, 0u);
+    }
+    dualJ_release_graph(graph);
+}
+
+TEST_F(JobTest, dependency_chain)
+{
+    dual_type_index_t types[] = { type_test, type_test2 };
+    std::sort(types, types + 2);
+    dual_entity_type_t entityType;
+    entityType.type = { types, 2 };
+    entityType.meta = { nullptr, 0 };
+    auto init = [&](dual_chunk_view_t* view) {
+        auto a = (test*)dualV_get_owned_rw(view, type_test);
+        auto b = (test*)dualV_get_owned_rw(view, type_test2);
+        for (uint32_t i = 0; i < view->count; ++i)
+        {
+            a[i] = 1;
+            b[i] = 0;
+        }
+    };
+    dualS_allocate_type(storage, &entityType, 20000, DUAL_LAMBDA(init));
+
+    // steps do not commute, any reordering changes the result
+    auto step = +[](void* u, dual_storage_t*, dual_chunk_view_t* view, dual_type_index_t* localTypes, EIndex) {
+        auto k = *(const test*)u;
+        auto a = (test*)dualV_get_owned_rw_local(view, localTypes[0]);
+        for (uint32_t i = 0; i < view->count; ++i)
+            a[i] = (a[i] * 3 + k) % 1000003;
+    };
+    auto copy = +[](void* u, dual_storage_t*, dual_chunk_view_t* view, dual_type_index_t* localTypes, EIndex) {
+        auto a = (const test*)dualV_get_owned_ro_local(view, localTypes[0]);
+        auto b = (test*)dualV_get_owned_rw_local(view, localTypes[1]);
+        for (uint32_t i = 0; i < view->count; ++i)
+            b[i] = a[i];
+    };
+    auto writeQuery = dualQ_from_literal(storage, "[inout]test");
+    auto readQuery = dualQ_from_literal(storage, "[in]test, [inout]test2");
+    ASSERT_NE(writeQuery, nullptr);
+    ASSERT_NE(readQuery, nullptr);
+    test ks[17];
+    test expected = 1;
+    for (int k = 0; k < 16; ++k)
+    {
+        ks[k] = k;
+        dualJ_schedule_ecs(writeQuery, 512, step, &ks[k], nullptr, nullptr, nullptr);
+        expected = (expected * 3 + k) % 1000003;
+    }
+    dualJ_schedule_ecs(readQuery, 512, copy, nullptr, nullptr, nullptr, nullptr);
+    // write after read should wait for the reader
+    ks[16] = 16;
+    dualJ_schedule_ecs(writeQuery, 512, step, &ks[16], nullptr, nullptr, nullptr);
+    dualJ_wait_storage(storage);
+
+    dual_filter_t filter;
+    zero(filter);
+    filter.all = { types, 2 };
+    dual_meta_filter_t meta;
+    zero(meta);
+    uint32_t count = 0, wrong = 0;
+    auto check = [&](dual_chunk_view_t* view) {
+        auto a = (const test*)dualV_get_owned_ro(view, type_test);
+        auto b = (const test*)dualV_get_owned_ro(view, type_test2);
+        for (uint32_t i = 0; i < view->count; ++i)
+            wrong += b[i] != expected || a[i] != (expected * 3 + 16) % 1000003;
+        count += view->count;
+    };
+    dualS_query(storage, &filter, &meta, DUAL_LAMBDA(check));
+    EXPECT_EQ(count, 20000u);
+    EXPECT_EQ(wrong, 0u);
+}
+
+TEST_F(JobTest, parallel_random_write)
+{
+    // groups are identified by their leader, which collects writes of other entities
+    std::vector<std::pair<const dual_group_t*, dual_entity_t>> leaders;
+    auto init = [&](dual_chunk_view_t* view) {
+        auto a = (test*)dualV_get_owned_rw(view, type_test);
+        auto b = (test*)dualV_get_owned_rw(view, type_test2);
+        for (uint32_t i = 0; i < view->count; ++i)
+        {
+            a[i] = 1;
+            b[i] = 0;
+        }
+        auto group = dualC_get_group(view->chunk);
+        if (leaders.empty() || leaders.back().first != group)
+            leaders.push_back({ group, dualV_get_entities(view)[0] });
+    };
+    for (auto extra : { dual::kInvalidTypeIndex, type_ref, type_test_arr })
+    {
+        dual_type_index_t types[] = { type_test, type_test2, extra };
+        SIndex count = extra == dual::kInvalidTypeIndex ? 2 : 3;
+        std::sort(types, types + count);
+        dual_entity_type_t entityType;
+        entityType.type = { types, count };
+        entityType.meta = { nullptr, 0 };
+        dualS_allocate_type(storage, &entityType, 3000, DUAL_LAMBDA(init));
+    }
+    ASSERT_EQ(leaders.size(), 3u);
+
+    // plain writes to the leader of own group, each group should be processed by one task
+    auto groupWrite = [&](dual_storage_t* storage, dual_chunk_view_t* view, dual_type_index_t* localTypes, EIndex) {
+        auto a = (const test*)dualV_get_owned_ro_local(view, localTypes[0]);
+        auto group = dualC_get_group(view->chunk);
+        auto leader = std::find_if(leaders.begin(), leaders.end(), [&](auto& pair) { return pair.first == group; });
+        dual_chunk_view_t leaderView;
+        dualS_access(storage, leader->second, &leaderView);
+        auto b = (test*)dualV_get_owned_rw(&leaderView, type_test2);
+        for (uint32_t i = 0; i < view->count; ++i)
+            *b += a[i];
+    };
+    // atomic writes to the leader of first group from every task
+    auto atomicWrite = [&](dual_storage_t* storage, dual_chunk_view_t* view, dual_type_index_t* localTypes, EIndex) {
+        auto a = (const test*)dualV_get_owned_ro_local(view, localTypes[0]);
+        dual_chunk_view_t leaderView;
+        dualS_access(storage, leaders[0].second, &leaderView);
+        auto b = (std::atomic<test>*)dualV_get_owned_rw(&leaderView, type_test2);
+        test sum = 0;
+        for (uint32_t i = 0; i < view->count; ++i)
+            sum += a[i];
+        b->fetch_add(sum, std::memory_order_relaxed);
+    };
+    auto groupQuery = dualQ_from_literal(storage, "[in]test, [inout][group]test2");
+    auto atomicQuery = dualQ_from_literal(storage, "[in]test, [atomic][rand]test2");
+    ASSERT_NE(groupQuery, nullptr);
+    ASSERT_NE(atomicQuery, nullptr);
+    dualJ_schedule_ecs(groupQuery, 256, DUAL_LAMBDA(groupWrite), nullptr, nullptr, nullptr);
+    dualJ_schedule_ecs(atomicQuery, 256, DUAL_LAMBDA(atomicWrite), nullptr, nullptr, nullptr);
+    dualJ_wait_storage(storage);
+
+    dual_job_stats_t stats;
+    dualJ_get_stats(groupQuery, &stats);
+    EXPECT_EQ(stats.taskCount, 3u);
+    dualJ_get_stats(atomicQuery, &stats);
+    EXPECT_GT(stats.taskCount, 1u);
+    for (size_t i = 0; i < leaders.size(); ++i)
+    {
+        dual_chunk_view_t view;
+        dualS_access(storage, leaders[i].second, &view);
+        EXPECT_EQ(*(const test*)dualV_get_owned_ro(&view, type_test2), i == 0 ? 3000 + 9000 : 3000);
+    }
+}
+
+TEST_F(JobTest, adaptive_batch)
+{
+    constexpr EIndex count = 50000;
+    dual_type_index_t types[] = { type_test, type_test2 };
+    std::sort(types, types + 2);
+    dual_entity_type_t entityType;
+    entityType.type = { types, 2 };
+    entityType.meta = { nullptr, 0 };
+    auto init = [&](dual_chunk_view_t* view) {
+        auto a = (test*)dualV_get_owned_rw(view, type_test);
+        for (uint32_t i = 0; i < view->count; ++i)
+            a[i] = 0;
+    };
+    dualS_allocate_type(storage, &entityType, count, DUAL_LAMBDA(init));
+
+    std::atomic<uint32_t> visited{ 0 };
+    auto update = [&](dual_storage_t*, dual_chunk_view_t* view, dual_type_index_t* localTypes, EIndex) {
+        auto a = (test*)dualV_get_owned_rw_local(view, localTypes[0]);
+        for (uint32_t i = 0; i < view->count; ++i)
+            a[i] += 1;
+        visited += view->count;
+    };
+    auto query = dualQ_from_literal(storage, "[inout]test, [in]test2");
+    ASSERT_NE(query, nullptr);
+    // first job has no history, second one is sized from measured cost
+    for (int i = 0; i < 2; ++i)
+    {
+        dualJ_schedule_ecs(query, 0, DUAL_LAMBDA(update), nullptr, nullptr, nullptr);
+        dualJ_wait_storage(storage);
+    }
+    EXPECT_EQ(visited.load(), 2 * count);
+
+    dual_job_stats_t stats;
+    dualJ_get_stats(query, &stats);
+    EXPECT_EQ(stats.entityCount, count);
+    EXPECT_EQ(stats.jobCount, 2u);
+    EXPECT_GT(stats.batchSize, 0u);
+    EXPECT_GE(stats.taskCount, 1u);
+    EXPECT_GE((uint64_t)stats.taskCount * stats.batchSize, count);
+    EXPECT_GT(stats.costPerEntity, 0.0);
+
+    dual_filter_t filter;
+    zero(filter);
+    filter.all = { types, 2 };
+    dual_meta_filter_t meta;
+    zero(meta);
+    uint32_t wrong = 0;
+    auto check = [&](dual_chunk_view_t* view) {
+        auto a = (const test*)dualV_get_owned_ro(view, type_test);
+        for (uint32_t i = 0; i < view->count; ++i)
+            wrong += a[i] != 2;
+    };
+    dualS_query(storage, &filter, &meta, DUAL_LAMBDA(check));
+    EXPECT_EQ(wrong, 0u);
+}
+
+TEST_F(JobTest, parallel_instantiate)
+{
+    struct row_t {
+        dual_entity_t e;
+        test value;
+        ref target;
+        bool operator==(const row_t& other) const { return e == other.e && value == other.value && target == other.target; }
+    };
+    // prefab of three entities referencing each other in a cycle, instantiated above kParallelSpawnThreshold
+    constexpr EIndex count = 6000;
+    static_assert(count * 3 >= dual::kParallelSpawnThreshold, "parallel path is not covered");
+    auto build = [&](dual_storage_t* world, bool jobs) {
+        dual_type_index_t types[] = { type_test, type_ref };
+        std::sort(types, types + 2);
+        dual_entity_type_t entityType;
+        entityType.type = { types, 2 };
+        entityType.meta = { nullptr, 0 };
+        dual_entity_t prefab[3];
+        dual_chunk_view_t prefabView;
+        auto setup = [&](dual_chunk_view_t* view) { prefabView = *view; };
+        dualS_allocate_type(world, &entityType, 3, DUAL_LAMBDA(setup));
+        auto values = (test*)dualV_get_owned_rw(&prefabView, type_test);
+        auto refs = (ref*)dualV_get_owned_rw(&prefabView, type_ref);
+        for (int i = 0; i < 3; ++i)
+            prefab[i] = dualV_get_entities(&prefabView)[i];
+        for (int i = 0; i < 3; ++i)
+        {
+            values[i] = (i + 1) * 10;
+            refs[i] = prefab[(i + 1) % 3];
+        }
+        if (jobs)
+        {
+            // storage is bound to job system while jobs are scheduled on it
+            auto query = dualQ_from_literal(world, "[in]test");
+            auto noop = +[](void*, dual_storage_t*, dual_chunk_view_t*, dual_type_index_t*, EIndex) {};
+            dual_counter_t* counter = nullptr;
+            dualJ_schedule_ecs(query, 0, noop, nullptr, nullptr, nullptr, &counter);
+            dualJ_wait_counter(counter, 1);
+            dualJ_release_counter(counter);
+        }
+        std::vector<dual_entity_t> ents;
+        auto collect = [&](dual_chunk_view_t* view) {
+            auto es = dualV_get_entities(view);
+            ents.insert(ents.end(), es, es + view->count);
+        };
+        dualS_instantiate_entities(world, prefab, 3, count, DUAL_LAMBDA(collect));
+        std::vector<row_t> rows;
+        for (auto e : ents)
+        {
+            dual_chunk_view_t view;
+            dualS_access(world, e, &view);
+            rows.push_back({ e, *(const test*)dualV_get_owned_ro(&view, type_test), *(const ref*)dualV_get_owned_ro(&view, type_ref) });
+        }
+        std::sort(rows.begin(), rows.end(), [](const row_t& a, const row_t& b) { return a.e < b.e; });
+        return rows;
+    };
+    auto parallelWorld = dualS_create();
+    auto sequentialWorld = dualS_create();
+    auto parallel = build(parallelWorld, true);
+    auto sequential = build(sequentialWorld, false);
+    dualJ_wait_storage(parallelWorld);
+    ASSERT_EQ(parallel.size(), 3u * count);
+    EXPECT_TRUE(parallel == sequential);
+
+    // references stay inside each instance and follow the prefab cycle
+    uint32_t wrong = 0;
+    for (auto& row : parallel)
+    {
+        auto next = std::lower_bound(parallel.begin(), parallel.end(), row.target, [](const row_t& r, dual_entity_t e) { return r.e < e; });
+        if (next == parallel.end() || next->e != row.target)
+        {
+            wrong++;
+            continue;
+        }
+        wrong += next->value != row.value % 30 + 10;
+    }
+    EXPECT_EQ(wrong, 0u);
+    dualS_release(parallelWorld);
+    dualS_release(sequentialWorld);
+}
+
+TEST_F(JobTest, parallel_image)
+{
+    using test_array = dual::array_component_T<test, 4>;
+    dual_type_index_t types[] = { type_test, type_test_arr, type_managed };
+    std::sort(types, types + 3);
+    dual_entity_type_t entityType;
+    entityType.type = { types, 3 };
+    entityType.meta = { nullptr, 0 };
+    auto callback = [&](dual_chunk_view_t* inView) {
+        auto t = (test*)dualV_get_owned_rw(inView, type_test);
+        auto arrays = (test_array*)dualV_get_owned_rw(inView, type_test_arr);
+        auto es = dualV_get_entities(inView);
+        for (uint32_t i = 0; i < inView->count; ++i)
+        {
+            t[i] = (test)es[i];
+            for (test j = 0; j < (test)(es[i] % 8); ++j)
+                arrays[i].push_back(j);
+        }
+    };
+    constexpr EIndex count = 2 * dual::kParallelSpawnThreshold;
+    dualS_allocate_type(storage, &entityType, count, DUAL_LAMBDA(callback));
+
+    dual_serializer_v writer;
+    writer.stream = +[](void* u, void* data, uint32_t bytes) {
+        auto buffer = (std::vector<char>*)u;
+        buffer->insert(buffer->end(), (char*)data, (char*)data + bytes);
+    };
+    writer.peek = nullptr;
+    writer.is_serialize = +[](void*) { return 1; };
+    auto write = [&](dual_storage_t* world) {
+        std::vector<char> image;
+        dualS_serialize_image(world, &writer, &image);
+        return image;
+    };
+    auto image = write(storage);
+    // reference image and load without job system
+    dualJ_wait_all();
+    auto jobs = dualJ_get_scheduler();
+    dualJ_initialize(nullptr);
+    auto sequentialImage = write(storage);
+    auto sequential = dualS_create();
+    EXPECT_TRUE(dualS_deserialize_image(sequential, sequentialImage.data(), sequentialImage.size()));
+    dualJ_initialize(jobs);
+    EXPECT_TRUE(image == sequentialImage);
+
+    auto parallel = dualS_create();
+    EXPECT_TRUE(dualS_deserialize_image(parallel, image.data(), image.size()));
+    // image does not hold chunk addresses, loaded storages give the same image back
+    EXPECT_TRUE(write(parallel) == image);
+    EXPECT_TRUE(write(sequential) == image);
+    dual_filter_t filter;
+    zero(filter);
+    filter.all = { types, 3 };
+    dual_meta_filter_t meta;
+    zero(meta);
+    auto read = [&](dual_storage_t* world) {
+        std::vector<std::pair<dual_entity_t, std::vector<test>>> rows;
+        auto collect = [&](dual_chunk_view_t* inView) {
+            auto t = (const test*)dualV_get_owned_ro(inView, type_test);
+            auto arrays = (const test_array*)dualV_get_owned_ro(inView, type_test_arr);
+            auto managedValues = (const managed*)dualV_get_owned_ro(inView, type_managed);
+            auto es = dualV_get_entities(inView);
+            for (uint32_t i = 0; i < inView->count; ++i)
+            {
+                std::vector<test> row{ t[i], (test)(bool)managedValues[i] };
+                row.insert(row.end(), arrays[i].begin(), arrays[i].end());
+                rows.push_back({ es[i], std::move(row) });
+            }
+        };
+        dualS_query(world, &filter, &meta, DUAL_LAMBDA(collect));
+        std::sort(rows.begin(), rows.end());
+        return rows;
+    };
+    auto rows = read(storage);
+    EXPECT_EQ(rows.size(), count);
+    EXPECT_TRUE(read(parallel) == rows);
+    EXPECT_TRUE(read(sequential) == rows);
+    dualS_release(parallel);
+    dualS_release(sequential);
+}
+
+TEST_F(JobTest, record_from_jobs)
+{
+    dual_entity_type_t entityType;
+    entityType.type = { &type_test, 1 };
+    entityType.meta = { nullptr, 0 };
+    dual_delta_type_t add;
+    zero(add);
+    add.added = { { &type_test2, 1 } };
+    // each job creates entities and adds and sets components on them in one buffer
+    constexpr uint32_t jobCount = 16;
+    constexpr EIndex perJob = 50;
+    std::vector<dual_entity_t> ents(jobCount * perJob);
+    auto buffer = dualB_create(storage);
+    auto record = [&](uint32_t index) {
+        auto es = ents.data() + index * perJob;
+        dualS_reserve_entities(storage, es, perJob);
+        dualB_spawn_reserved(buffer, &entityType, es, perJob, nullptr, nullptr);
+        for (EIndex i = 0; i < perJob; ++i)
+        {
+            test value = (test)(index * perJob + i);
+            dualB_cast(buffer, es[i], &add);
+            dualB_set(buffer, es[i], type_test, &value);
+            value *= 2;
+            dualB_set(buffer, es[i], type_test2, &value);
+        }
+    };
+    dual_counter_t* counter = nullptr;
+    dualJ_schedule_for(jobCount, DUAL_LAMBDA(record), nullptr, &counter);
+    dualJ_wait_counter(counter, 1);
+    dualJ_release_counter(counter);
+    dualB_playback(buffer);
+    dualB_release(buffer);
+
+    uint32_t wrong = 0;
+    for (size_t i = 0; i < ents.size(); ++i)
+    {
+        if (!dualS_exist(storage, ents[i]))
+        {
+            wrong++;
+            continue;
+        }
+        dual_chunk_view_t view;
+        dualS_access(storage, ents[i], &view);
+        auto t2 = (const test*)dualV_get_owned_ro(&view, type_test2);
+        wrong += *(const test*)dualV_get_owned_ro(&view, type_test) != (test)i || !t2 || *t2 != (test)i * 2;
+    }
+    EXPECT_EQ(wrong, 0u);
+}
+
+TEST_F(JobTest, reserve_from_workers)
+{
+    dual_entity_type_t entityType;
+    entityType.type = { &type_test, 1 };
+    entityType.meta = { nullptr, 0 };
+    std::vector<dual_entity_t> ents;
+    auto callback = [&](dual_chunk_view_t* inView) {
+        auto es = dualV_get_entities(inView);
+        ents.insert(ents.end(), es, es + inView->count);
+    };
+    dualS_allocate_type(storage, &entityType, 2000, DUAL_LAMBDA(callback));
+    std::vector<EIndex> freed;
+    for (size_t i = 0; i < 1500; ++i)
+    {
+        dual_chunk_view_t view;
+        dualS_access(storage, ents[i], &view);
+        dualS_destroy(storage, &view);
+        freed.push_back((EIndex)(ents[i] & ENTITY_ID_MASK));
+    }
+    std::sort(freed.begin(), freed.end());
+    dualS_share_free_entities(storage, 1500);
+
+    // workers reserve through their own slot several times, leaving partial segments behind
+    constexpr uint32_t taskCount = 64;
+    constexpr EIndex perCall = 7;
+    std::vector<dual_entity_t> reserved(taskCount * perCall * 3);
+    auto buffer = dualB_create(storage);
+    auto reserve = [&](uint32_t index) {
+        for (uint32_t k = 0; k < 3; ++k)
+        {
+            auto es = reserved.data() + (index * 3 + k) * perCall;
+            dualS_reserve_entities(storage, es, perCall);
+            dualB_spawn_reserved(buffer, &entityType, es, perCall, nullptr, nullptr);
+        }
+    };
+    auto run = [&]() {
+        dual_counter_t* counter = nullptr;
+        dualJ_schedule_for(taskCount, DUAL_LAMBDA(reserve), nullptr, &counter);
+        dualJ_wait_counter(counter, 1);
+        dualJ_release_counter(counter);
+    };
+    run();
+    auto sorted = reserved;
+    std::sort(sorted.begin(), sorted.end());
+    EXPECT_EQ(std::unique(sorted.begin(), sorted.end()), sorted.end());
+    uint32_t notRecycled = 0;
+    for (auto e : reserved)
+    {
+        EXPECT_FALSE(dualS_exist(storage, e));
+        notRecycled += !std::binary_search(freed.begin(), freed.end(), (EIndex)(e & ENTITY_ID_MASK));
+    }
+    EXPECT_EQ(notRecycled, 0u);
+    dualB_playback(buffer);
+    for (auto e : reserved)
+        EXPECT_TRUE(dualS_exist(storage, e));
+
+    // pack takes partial segments back, later reservations only get new ids
+    dualS_pack_entities(storage);
+    const EIndex alive = 1 + 500 + (EIndex)reserved.size();
+    dual_memory_stats_t stats;
+    dualS_get_memory_stats(storage, &stats);
+    EXPECT_EQ(stats.entityCount, alive);
+    run();
+    dualB_playback(buffer);
+    dualB_release(buffer);
+    sorted = reserved;
+    std::sort(sorted.begin(), sorted.end());
+    EXPECT_EQ(std::unique(sorted.begin(), sorted.end()), sorted.end());
+    uint32_t stale = 0;
+    for (auto e : reserved)
+        stale += (EIndex)(e & ENTITY_ID_MASK) < alive;
+    EXPECT_EQ(stale, 0u);
+    dualS_get_memory_stats(storage, &stats);
+    EXPECT_EQ(stats.entityCount, alive + (EIndex)reserved.size());
+}
+
 void register_test_component()
 {
     using namespace guid_parse::literals;
@@ -241,6 +1836,7 @@ void register_test_component()
         desc.elementSize = desc.size;
         desc.size = desc.size * 10;
         desc.name = "test_arr";
+        desc.guid = "{9F7E1C52-4D3B-4E8A-B1C6-2A5D7E3F8B04}"_guid;
         type_test_arr = dualT_register_type(&desc);
     }
 
@@ -302,7 +1898,8 @@ auto register_managed_component()
         +[](dual_chunk_t* chunk, EIndex index, char* dst, dual_chunk_t* schunk, EIndex sindex, char* src) { *(managed*)dst = std::move(*(managed*)src); },
         +[](dual_chunk_t* chunk, EIndex index, char* data, EIndex count, const dual_serializer_v* v, void* s) {
             if (!v->is_serialize(s))
-                new (data) managed;
+                for (EIndex i = 0; i < count; ++i)
+                    new (data + i * sizeof(managed)) managed;
         },
         nullptr
     };
@@ -332,6 +1929,22 @@ auto register_pinned_component()
     type_pinned_arr = dualT_register_type(&desc);
 }
 
+auto register_soa_component()
+{
+    using namespace guid_parse::literals;
+    dual_type_description_t desc;
+    desc.name = "soa";
+    desc.size = sizeof(soa);
+    desc.entityFieldsCount = 0;
+    desc.entityFields = 0;
+    desc.guid = "{5C0E7B1A-2F4D-4B8E-9A63-D1E8F0B27C45}"_guid;
+    desc.callback = {};
+    desc.flags = DTF_SOA;
+    desc.elementSize = sizeof(float);
+    desc.alignment = alignof(soa);
+    type_soa = dualT_register_type(&desc);
+}
+
 int main(int argc, char** argv)
 {
     ::testing::InitGoogleTest(&argc, argv);
@@ -339,6 +1952,11 @@ int main(int argc, char** argv)
     register_ref_component();
     register_managed_component();
     register_pinned_component();
+    register_soa_component();
+    ftl::TaskScheduler scheduler;
+    ftl::TaskSchedulerInitOptions options;
+    scheduler.Init(options);
+    dualJ_initialize((dual_scheduler_t*)&scheduler);
     auto result = RUN_ALL_TESTS();
     dual_shutdown();
     return result;
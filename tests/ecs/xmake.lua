@@ -3,4 +3,11 @@ target("ecs-test")
     add_deps("SkrRT")
     add_packages("gtest")
     add_files("capi/main.cpp")
-    set_languages("c++17")
\ No newline at end of file
+    set_languages("c++17")
+
+target("ecs-benchmark")
+    set_kind("binary")
+    add_deps("SkrRT")
+    add_packages("benchmark")
+    add_files("benchmark/main.cpp")
+    set_languages("c++17")
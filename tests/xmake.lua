@@ -1,4 +1,5 @@
 add_requires("gtest")
+add_requires("benchmark")
 includes("ecs/xmake.lua")
 includes("fs/xmake.lua")
 includes("resource/xmake.lua")
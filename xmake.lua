@@ -27,6 +27,12 @@ option("build_tests")
     set_description("Toggle to build tests of SakuraRuntime")
 option_end()
 
+option("dual_entity_64")
+    set_default(false)
+    set_showmenu(true)
+    set_description("Toggle to use 64 bit entity handles in ECS (32 bit id and version)")
+option_end()
+
 set_languages("c11", "cxx17")
 
 include_dir_list = {"include"}
@@ -70,6 +76,9 @@ target("SkrRT")
     -- runtime compile definitions
     add_defines("MI_SHARED_LIB", "RUNTIME_SHARED", "EA_DLL", {public = true})
     add_defines("MI_SHARED_LIB_EXPORT", "RUNTIME_API=RUNTIME_EXPORT", "EASTL_API=EA_EXPORT", "EASTL_EASTDC_API=EA_EXPORT")
+    if has_config("dual_entity_64") then
+        add_defines("DUAL_ENTITY_64", {public = true})
+    end
     -- fetch vk includes
     add_rules("utils.fetch-vk-includes")
     -- add internal shaders